@@ -54,15 +54,13 @@ protected:
 
   void appendCRC(uint8_t *buff, uint16_t &size);
   void addBits(uint8_t *buff, uint16_t &size, uint32_t value, uint8_t numBits);
-  void putBits(uint8_t *buff, uint32_t value, uint8_t numBits);
   void addString(uint8_t *buff, uint16_t &size, const string &name, uint8_t maxChars);
   void finalize(uint8_t *buff, uint16_t &size, TXPacket &packet);
+
+  // Frames the packet's payload for transmission: FCS, bit stuffing, HDLC flags, ramp bits and NRZI
+  static void frame(TXPacket &packet, uint16_t fcs);
 private:
-  void bitStuff(uint8_t *buff, uint16_t &size);
-  void constructHDLCFrame(uint8_t *buff, uint16_t &size);
-  void nrziEncode(uint8_t *buff, uint16_t &size, TXPacket &packet);
   void payloadToBytes(uint8_t *bitVector, uint16_t numBits, uint8_t *bytes);
-  void reverseEachByte(uint8_t *bitVector, uint16_t numBits);
 };
 
 #if 0
@@ -104,16 +102,23 @@ public:
 class AISMessage18 : public AISMessage
 {
 public:
-  float latitude;
-  float longitude;
-  float sog;
-  float cog;
+  int32_t latitude;       // 1/10000 minutes
+  int32_t longitude;      // 1/10000 minutes
+  uint16_t sog;           // 0.1 knots
+  uint16_t cog;           // 0.1 degrees
   time_t utc;
 
   AISMessage18();
 
   //bool decode(const RXPacket &packet);
   void encode(const StationData &data, TXPacket &packet);
+
+  /*
+   * Dead-reckons the position in a packet made by encode() to the given time, which is age milliseconds
+   * after the fix, and updates the time stamp. The packet is only framed again if a field changed.
+   * This runs at the start of the slot the packet may go out in, so it has to be quick.
+   */
+  static void extrapolate(TXPacket &packet, time_t utc, uint32_t age);
 };
 
 /**
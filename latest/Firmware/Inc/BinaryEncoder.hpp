@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef BINARYENCODER_HPP_
+#define BINARYENCODER_HPP_
+
+#include "RXPacket.hpp"
+#include "Events.hpp"
+
+
+/**
+ * Compact alternative to NMEA output. Every record is followed by its CRC-16/X.25 (LSB first),
+ * then COBS encoded and terminated with a zero byte. Multi-byte fields are little endian.
+ *
+ * AIS:   0x01, ITU channel, slot (2), RSSI, fill bits, payload (MSB first, padded to a whole byte)
+ * GNSS:  0x02, UTC (4), latitude (4), longitude (4), SOG (2), COG (2)
+ * Text:  0x03, ASCII line as it would appear in NMEA mode
+ *
+ * Coordinates are signed 1/10000 minutes, like in AIS messages. SOG is in 0.1 knots and COG in 0.1 degrees.
+ */
+typedef enum
+{
+  RECORD_AIS = 1,
+  RECORD_GNSS = 2,
+  RECORD_TEXT = 3
+} BinaryRecordType;
+
+// Enough for the largest packet we accept as well as a full line of text
+#define BINARY_FRAME_BUFFER_SIZE     160
+
+
+class BinaryEncoder
+{
+public:
+  /**
+   * Each of these writes a complete frame (including the delimiter) into the buffer and returns its length,
+   * or 0 if it doesn't fit.
+   */
+  static uint16_t encode(RXPacket &packet, uint8_t *buffer, uint16_t size);
+  static uint16_t encode(const GPSFix &fix, uint8_t *buffer, uint16_t size);
+  static uint16_t encode(const char *text, uint8_t *buffer, uint16_t size);
+  static uint16_t encode(const char *text, uint16_t length, uint8_t *buffer, uint16_t size);
+private:
+  static uint16_t frame(uint8_t *record, uint16_t length, uint8_t *buffer, uint16_t size);
+};
+
+#endif /* BINARYENCODER_HPP_ */
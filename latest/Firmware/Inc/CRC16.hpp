@@ -0,0 +1,50 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef CRC16_HPP_
+#define CRC16_HPP_
+
+#include <inttypes.h>
+
+/**
+ * CRC-16/X.25, the HDLC frame check sequence. HDLC sends every byte LSB first,
+ * so the bytes here are simply the AIS payload bytes in their natural (MSB first) form.
+ */
+class CRC16
+{
+public:
+  static const uint16_t INITIAL_VALUE = 0xffff;
+
+  // What update() arrives at after running over a frame plus its own (valid) FCS
+  static const uint16_t GOOD_RESIDUE = 0xf0b8;
+
+  // Incremental form, cheap enough for interrupt context
+  static inline uint16_t update(uint16_t crc, uint8_t byte)
+  {
+    return (crc >> 8) ^ TABLE[(crc ^ byte) & 0xff];
+  }
+
+  // The complete FCS of a buffer, using the hardware CRC unit if the BSP provides one
+  static uint16_t compute(const uint8_t *data, uint16_t length);
+private:
+  static const uint16_t TABLE[256];
+};
+
+#endif /* CRC16_HPP_ */
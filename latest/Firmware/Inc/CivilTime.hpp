@@ -0,0 +1,45 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef CIVILTIME_HPP_
+#define CIVILTIME_HPP_
+
+#include <inttypes.h>
+#include <time.h>
+
+/**
+ * Integer-only conversions between UTC timestamps and proleptic Gregorian dates. No time zones,
+ * no allocation and no libc state, unlike mktime() and localtime_r().
+ */
+class CivilTime
+{
+public:
+  // Days since 1970-01-01. Month is 1-12 and day is 1-31.
+  static int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day);
+  static void civilFromDays(int32_t days, int32_t &year, uint32_t &month, uint32_t &day);
+
+  // Seconds are allowed to be 60 (leap second), which is the same as 0 of the following minute
+  static time_t toUTC(int32_t year, uint32_t month, uint32_t day, uint32_t hour, uint32_t minute, uint32_t second);
+
+  // Fills in everything, including the day of week and day of year. Month and year follow struct tm conventions.
+  static void fromUTC(time_t utc, struct tm &result);
+};
+
+#endif /* CIVILTIME_HPP_ */
@@ -0,0 +1,64 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef CONFIGDATA_H_
+#define CONFIGDATA_H_
+
+#include <inttypes.h>
+
+#define CONFIG_DATA_MAGIC 0xC0F1DA7A
+#define GNSS_FIX_MAGIC    0x6F1C5A7E
+
+#define GNSS_FILTER_SIZE  8
+
+/**
+ * GNSS passthrough filter entry. The ID is the talker + sentence ID (e.g. "GPGSV"), not NUL terminated,
+ * where '-' matches any character (so "--GSV" matches all GSV sentences). An ID starting with NUL marks
+ * the end of the table.
+ */
+typedef struct
+{
+  char            id[5];
+  uint8_t         ratio;              // 0 blocks all sentences, otherwise one in every N passes
+} GNSSFilterEntry;
+
+/**
+ * Operational settings, persisted separately from station data so they survive a change of vessel.
+ */
+typedef struct
+{
+  uint32_t        magic;              // Magic value to indicate valid data (as opposed to erased FLASH/EEPROM)
+  uint32_t        terminalBaudRate;   // Main UART baud rate, only saved after the host has confirmed it works
+  GNSSFilterEntry gnssFilter[GNSS_FILTER_SIZE]; // Evaluated in order, first match wins. Unmatched sentences pass.
+} ConfigData;
+
+/**
+ * The last known fix, kept to aid the receiver after a power cycle.
+ */
+typedef struct
+{
+  uint32_t        magic;
+  uint32_t        utc;
+  int32_t         lat;                // 1/10000 minutes
+  int32_t         lng;                // 1/10000 minutes
+} GNSSFixData;
+
+
+#endif /* CONFIGDATA_H_ */
@@ -24,6 +24,7 @@
 // This singleton manages user-definable configuration data stored in Flash (or EEPROM).
 
 #include "StationData.h"
+#include "ConfigData.h"
 
 // Defining this as a union of data fields or 32 double words, as the L4 expects flash writes to be 8 bytes long
 typedef union
@@ -42,6 +43,14 @@ public:
   // Station data is separate from other configuration values and occupies a different address
   bool writeStationData(const StationData &data);
   bool readStationData(StationData &data);
+
+  // Other configuration values take effect immediately, so writing them does not reboot
+  bool writeConfigData(const ConfigData &data);
+  bool readConfigData(ConfigData &data);
+
+  // The last fix is saved periodically, so writing it does not reboot either
+  bool writeGNSSFix(const GNSSFixData &data);
+  bool readGNSSFix(GNSSFixData &data);
   void resetToDefaults();
 private:
   Configuration();
@@ -24,9 +24,26 @@
 #include <vector>
 #include <string>
 #include "config.h"
+#include "BinaryEncoder.hpp"
 
 using namespace std;
 
+/**
+ * When the UART is saturated, lower priorities are shed first.
+ * AIS output is only lost when the transmit buffer is completely full.
+ */
+typedef enum {
+  PRIORITY_AIS = 0,
+  PRIORITY_GNSS,
+  PRIORITY_PROPRIETARY,
+  PRIORITY_COUNT
+} OutputPriority;
+
+typedef enum {
+  OUTPUT_NMEA = 0,
+  // Everything is sent as BinaryEncoder frames, including text
+  OUTPUT_BINARY
+} OutputMode;
 
 class DataTerminal : public EventConsumer
 {
@@ -37,17 +54,86 @@ public:
 
   void processEvent(const Event &e);
 
+  /**
+   * Output is queued and sent in the background, so these return immediately.
+   * They must only be called from thread context. Lines that don't fit are dropped.
+   */
 #ifdef MULTIPLEXED_OUTPUT
-  void write(const char* cls, const char* line);
+  void write(const char* cls, const char* line, OutputPriority priority);
+  void write(const char* cls, const char* line, uint16_t length, OutputPriority priority);
 #else
-  void write(const char* line);
+  void write(const char* line, OutputPriority priority);
+  void write(const char* line, uint16_t length, OutputPriority priority);
 #endif
+
+  // A complete frame from BinaryEncoder
+  void writeFrame(const uint8_t *frame, uint16_t size, OutputPriority priority);
+
+  /**
+   * Like write(), but the time at which the line starts going out is recorded. That's when its first byte
+   * enters the UART, which may still be sending up to two characters ahead of it.
+   */
+  void writeMarked(const char *line, OutputPriority priority);
+
+  // Whether the last marked line has started going out, and bsp_get_cycle_count() when it did
+  bool markTime(uint32_t &cycles) const;
+
+  void setOutputMode(OutputMode mode);
+  OutputMode outputMode() const;
+
+  /**
+   * Baud rate changes are announced at the old rate, then take effect once that has gone out.
+   * Unless confirmed within TERMINAL_BAUD_CONFIRM_TIMEOUT, the old rate is restored.
+   * Only a confirmed rate is persisted.
+   */
+  bool requestBaudRate(uint32_t rate);
+  void confirmBaudRate();
+
+  // Must be called from the main loop, as the baud rate timeouts don't depend on any events
+  void poll();
+
+  // Called by the BSP in interrupt context
+  uint16_t nextOutputChunk(const char **data);
 private:
   DataTerminal();
   void processCommand(const char*);
 
   void _write(const char* s);
+  void writeText(const char *s, uint16_t length, OutputPriority priority);
+  void queue(const char **parts, const uint16_t *lengths, uint8_t count, OutputPriority priority);
+  bool admit(OutputPriority priority, uint16_t queued);
+  void reportShedding();
+  void reportBaudRate(uint32_t rate, const char *status);
+  bool isOutputIdle() const;
 private:
+  char mTXBuffer[TERMINAL_TX_BUFFER_SIZE];
+  volatile uint16_t mTXHead;
+  volatile uint16_t mTXTail;
+  volatile uint16_t mTXInFlight;
+
+  bool mMarkNext;
+  volatile int16_t mMarkPosition;   // Of the marked line in mTXBuffer, -1 once it's gone out (or if there's none)
+  volatile bool mMarkSent;
+  volatile uint32_t mMarkCycles;
+
+  OutputMode mOutputMode;
+
+  typedef enum {
+    BAUD_IDLE,
+    BAUD_DRAINING,
+    BAUD_CONFIRMING
+  } BaudState;
+
+  BaudState mBaudState;
+  uint32_t mBaudRate;
+  uint32_t mPendingBaudRate;
+  uint32_t mPreviousBaudRate;
+  uint32_t mBaudDeadline;
+  uint8_t mFrame[BINARY_FRAME_BUFFER_SIZE];
+
+  uint32_t mSeconds;
+  uint16_t mShed[PRIORITY_COUNT];
+
   char mCmdBuffer[64];
   size_t mCmdBuffPos;
   vector<string> mCmdTokens;
@@ -21,13 +21,30 @@
 #ifndef EVENTQUEUE_HPP_
 #define EVENTQUEUE_HPP_
 
-#include <map>
-#include "CircularQueue.hpp"
+#include "SPSCQueue.hpp"
+#include "MPMCQueue.hpp"
 #include "Events.hpp"
 
 
 using namespace std;
 
+/*
+ * Events are dispatched in lanes, highest priority first, so a clock tick (which is when RadioManager
+ * assigns TX packets) never waits behind a burst of received packets whose output blocks on the UART.
+ */
+typedef enum {
+  LANE_TIMING = 0,    // Clock ticks, fixes and interrogations
+  LANE_RX,            // AIS packets, GNSS sentences and RSSI samples
+  LANE_IO,            // Proprietary sentences, debug output, commands and DFU requests
+  EVENT_LANES
+} EventLane;
+
+typedef struct {
+  uint32_t events;        // Dispatched since the last report
+  uint32_t maxLatency;    // Longest wait from push() to dispatch (ms)
+  uint32_t overBudget;    // How many waited longer than the lane's budget
+} EventLaneStats;
+
 class EventQueue
 {
 public:
@@ -36,7 +53,7 @@ public:
   void init();
 
   /*
-   * Consumer registration
+   * Consumer registration. Registering a consumer again replaces its event mask.
    */
   void addObserver(EventConsumer *c, uint32_t eventMask);
 
@@ -54,11 +71,47 @@ public:
    * This method must be called repeatedly by an RTOS task or main() (never an ISR)
    */
   void dispatch();
+
+  /*
+   * Latency seen by a lane since the last call, which starts a new period. Thread context only.
+   */
+  EventLaneStats takeLaneStats(EventLane lane);
+  static const char *laneName(EventLane lane);
+  static uint32_t laneBudget(EventLane lane);
 private:
   EventQueue();
-  CircularQueue<Event*> mISRQueue;
-  CircularQueue<Event*> mTaskQueue;
-  map<EventConsumer *, uint32_t> mConsumers;
+  void deliver(const Event &e);
+  void sortIntoLanes();
+  bool sortIntoLane(Event *e);
+  int nextLane();
+  static EventLane laneOf(EventType type);
+private:
+  static const uint8_t MAX_CONSUMERS = 16;
+
+  // ISRs of different priorities push into the first, only the main task into the second
+  MPMCQueue<Event*, 64> mISRQueue;
+  SPSCQueue<Event*, 32> mTaskQueue;
+  static_assert(ISR_EVENT_POOL_SIZE <= 64 && THREAD_EVENT_POOL_SIZE <= 32, "Every pooled event must fit its queue");
+
+  /*
+   * Only dispatch() touches the lanes. An event whose lane is full waits at the head of its queue above.
+   * The RX lane holds every event the ISR pool has, and the I/O lane every one that can get a text buffer.
+   */
+  SPSCQueue<Event*, 16> mTimingLane;
+  SPSCQueue<Event*, 64> mRXLane;
+  SPSCQueue<Event*, 32> mIOLane;
+  static_assert(ISR_EVENT_POOL_SIZE <= 64 && TEXT_POOL_SIZE < 32, "Lanes too small for the pools");
+
+  Event *mStalledISREvent = nullptr;
+  Event *mStalledTaskEvent = nullptr;
+  EventLaneStats mLaneStats[EVENT_LANES];
+
+  /*
+   * Consumers occupy slots in the order they registered. For every event type bit there is a mask of
+   * the slots that want it, so dispatching only visits interested consumers.
+   */
+  EventConsumer *mConsumers[MAX_CONSUMERS];
+  uint16_t mSubscribers[32];
 };
 
 #endif /* EVENTQUEUE_HPP_ */
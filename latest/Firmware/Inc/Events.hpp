@@ -29,6 +29,7 @@
 #include "RXPacket.hpp"
 #include "ObjectPool.hpp"
 #include "AISChannels.h"
+#include "config.h"
 //#include "RadioManager.hpp"
 
 using namespace std;
@@ -37,22 +38,39 @@ typedef struct {
   char sentence[120];
 } NMEABuffer;
 
+// A line of GNSS input, in place in GNSSInput's DMA buffer. Not NUL terminated.
+typedef struct {
+  const char *data;
+  uint8_t length;
+} GNSSSlice;
+
+// Fixed point in the units AIS uses, so these go into messages as they are
 typedef struct {
   time_t utc;
-  float lat;
-  float lng;
-  float speed;
-  float cog;
+  int32_t lat;        // 1/10000 minutes, positive north
+  int32_t lng;        // 1/10000 minutes, positive east
+  uint16_t speed;     // 0.1 knots
+  uint16_t cog;       // 0.1 degrees
 } GPSFix;
 
 typedef struct {
   time_t utc;
+  uint32_t uptime;    // bsp_get_uptime_ms() at the PPS
+  uint32_t cycles;    // bsp_get_cycle_count() at the PPS
+  int16_t slot;       // AIS slot the PPS fell in, -1 if the slot timer isn't running
+  uint16_t slotOffset; // Microseconds into that slot
 } ClockTick;
 
 typedef struct {
   char buffer[120];
 } DebugMessage;
 
+// Events that carry text point to one of these, so the events themselves stay small
+typedef union {
+  NMEABuffer nmeaBuffer;
+  DebugMessage debugMessage;
+} TextBuffer;
+
 typedef enum {
   OP_GET,
   OP_SET
@@ -73,7 +91,8 @@ class Event
 {
 public:
   EventType type;
-  uint32_t flags;
+  uint16_t flags;
+  uint16_t queued;      // Low 16 bits of bsp_get_uptime_ms() when it was pushed, for lane latency
 
   Event();
 
@@ -90,14 +109,18 @@ public:
   // This is an object, so it can't be a member of the union ...
   RXPacket *rxPacket;
 
+  // Drawn from the text pool by EventPool::newEvent() for the types that carry text, null otherwise
+  TextBuffer *text;
+
   union {
-    NMEABuffer nmeaBuffer;
+    NMEABuffer *nmeaBuffer;
+    GNSSSlice gnssSlice;
     GPSFix gpsFix;
-    DebugMessage debugMessage;
+    DebugMessage *debugMessage;
     ClockTick clock;
     Interrogation interrogation;
     RSSISample rssiSample;
-    DebugMessage command;
+    DebugMessage *command;
   };
 };
 
@@ -126,13 +149,16 @@ public:
   uint32_t maxUtilization();
   RXPacket *newRXPacket();
   void releaseRXPacket(RXPacket *);
+  void releaseText(TextBuffer *);
 private:
   EventPool();
+  bool carriesText(EventType type);
 
 private:
-  ObjectPool<Event>     mISRPool;
-  ObjectPool<Event>     mThreadPool;
-  ObjectPool<RXPacket>  mRXPool;
+  ObjectPool<Event, ISR_EVENT_POOL_SIZE>        mISRPool;
+  ObjectPool<Event, THREAD_EVENT_POOL_SIZE>     mThreadPool;
+  ObjectPool<TextBuffer, TEXT_POOL_SIZE>        mTextPool;
+  ObjectPool<RXPacket, 20>                      mRXPool;
 };
 
 #endif /* EVENTS_HPP_ */
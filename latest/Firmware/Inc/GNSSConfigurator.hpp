@@ -0,0 +1,101 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef GNSSCONFIGURATOR_HPP_
+#define GNSSCONFIGURATOR_HPP_
+
+#include <inttypes.h>
+#include "NMEASentence.hpp"
+
+
+class GNSSConfiguratorDelegate
+{
+public:
+  virtual ~GNSSConfiguratorDelegate()
+  {
+  }
+
+  // Must not return before the command has left the UART, as a baud rate change may follow
+  virtual void sendGNSSCommand(const char *command)=0;
+  virtual void setGNSSBaudRate(uint32_t rate)=0;
+};
+
+/**
+ * Brings the GNSS receiver to the baud rate, sentence set and fix interval in config.h, one PMTK
+ * command at a time, waiting for each to be acknowledged. A step that still fails after a few attempts
+ * is skipped, so the worst outcome is a receiver running on its defaults.
+ *
+ * There is no hardware or clock access in here. Time is passed in, commands go out through the delegate
+ * and whatever the receiver sends comes in through onSentence().
+ */
+class GNSSConfigurator
+{
+public:
+  enum Step
+  {
+    STEP_BAUD_RATE      = 0x01,
+    STEP_SENTENCES      = 0x02,
+    STEP_FIX_INTERVAL   = 0x04
+  };
+
+  GNSSConfigurator(GNSSConfiguratorDelegate *delegate);
+
+  // The receiver has just been powered on
+  void start(uint32_t now);
+  void stop();
+
+  // Handles timeouts. Must be called regularly while busy.
+  void poll(uint32_t now);
+
+  // Every valid sentence from the receiver while busy
+  void onSentence(const NMEASentence &sentence, uint32_t now);
+
+  bool busy() const;
+  uint32_t baudRate() const;
+
+  // The steps that were acknowledged (or verified, for the baud rate)
+  uint8_t completedSteps() const;
+private:
+  enum State
+  {
+    STATE_IDLE,
+    STATE_PROBING,
+    STATE_VERIFYING_BAUD,
+    STATE_AWAITING_ACK
+  };
+
+  void probeFailed(uint32_t now);
+  void nextStep(uint32_t now);
+  void sendCommand(uint32_t now);
+  void finishStep(bool success, uint32_t now);
+  void setBaudRate(uint32_t rate);
+private:
+  GNSSConfiguratorDelegate *mDelegate;
+  State mState;
+  uint8_t mStep;
+  uint8_t mCompleted;
+  uint8_t mAttempts;
+  uint32_t mBaudRate;
+  uint32_t mPreviousBaudRate;
+  uint32_t mSwitchTime;
+  uint32_t mDeadline;
+};
+
+#endif /* GNSSCONFIGURATOR_HPP_ */
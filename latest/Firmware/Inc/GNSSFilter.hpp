@@ -0,0 +1,69 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef GNSSFILTER_HPP_
+#define GNSSFILTER_HPP_
+
+#include "ConfigData.h"
+
+
+/**
+ * Decides which GNSS sentences are passed through to the data terminal. Matching only looks at
+ * the sentence ID, so it's cheap enough to run on every line as it arrives. Lines are taken in place,
+ * so they are not NUL terminated and nothing past their length is read.
+ */
+class GNSSFilter
+{
+public:
+  static GNSSFilter &instance();
+
+  // Loads the persisted table
+  void init();
+
+  // Adds or replaces the entry for an ID. Returns false if the ID is malformed or the table is full.
+  bool set(const char *id, uint8_t ratio);
+  void clear();
+
+  // Persists the current table and reports it
+  void save();
+
+  // Emits the current table as a $PAIGFL sentence
+  void report();
+
+  // True if the sentence would never pass. Safe to call from interrupt context.
+  bool isBlocked(const char *sentence, uint8_t length) const;
+
+  // Applies decimation, so it must be called exactly once for every sentence that's a candidate for output
+  bool pass(const char *sentence, uint8_t length);
+private:
+  GNSSFilter();
+  int8_t match(const GNSSFilterEntry *table, const char *sentence, uint8_t length) const;
+
+  // The next table to edit
+  GNSSFilterEntry *spare();
+  void publish(GNSSFilterEntry *table);
+private:
+  // Double buffered, so the interrupt side always sees a complete table
+  GNSSFilterEntry mTables[2][GNSS_FILTER_SIZE];
+  GNSSFilterEntry * volatile mActive;
+  uint8_t mCounts[GNSS_FILTER_SIZE];
+};
+
+#endif /* GNSSFILTER_HPP_ */
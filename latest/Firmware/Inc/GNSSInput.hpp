@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef GNSSINPUT_HPP_
+#define GNSSINPUT_HPP_
+
+#include <inttypes.h>
+#include "Events.hpp"
+#include "config.h"
+
+// Anything longer between line feeds is garbage
+#define GNSS_MAX_LINE_LENGTH    96
+
+// Reference counting granularity. A line never spans more than two segments.
+#define GNSS_RX_SEGMENTS        8
+
+/*
+ * Called in interrupt context for every complete line. Returns true if it took the reference, which
+ * must then be released with GNSSInput::release().
+ */
+typedef bool(*gnss_line_callback)(const GNSSSlice &slice);
+
+/**
+ * GNSS input lands in a circular DMA buffer and lines are handed out where they are. The buffer is split
+ * in segments which count the slices in them, and reception pauses if the DMA is about to overwrite
+ * one that's still referenced. Lines are handed out as soon as they end, so only slices the task has
+ * been sitting on for a while can ever be in the way. Characters are dropped while paused, which only breaks the line they're in.
+ *
+ * A line that wraps around is made contiguous by copying its beginning past the end of the buffer.
+ */
+class GNSSInput
+{
+public:
+  static GNSSInput &instance();
+
+  void init(gnss_line_callback cb);
+
+  // Called by the BSP in interrupt context with the position of the next character to be received
+  void onReceive(uint32_t position);
+
+  // Safe to call from any context
+  void release(const GNSSSlice &slice);
+private:
+  GNSSInput();
+  void reference(const GNSSSlice &slice, int8_t delta);
+  bool isClearAhead(uint32_t position) const;
+private:
+  char mBuffer[GNSS_RX_BUFFER_SIZE + GNSS_MAX_LINE_LENGTH];
+  volatile uint8_t mReferences[GNSS_RX_SEGMENTS];
+  uint32_t mScanned;
+  uint32_t mLineStart;
+  volatile bool mPaused;
+  gnss_line_callback mCallback;
+};
+
+#endif /* GNSSINPUT_HPP_ */
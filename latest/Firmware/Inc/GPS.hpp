@@ -24,6 +24,10 @@
 #include <inttypes.h>
 #include <time.h>
 #include "EventQueue.hpp"
+#include "NMEASentence.hpp"
+#include "GNSSConfigurator.hpp"
+#include "SlotClock.hpp"
+#include "config.h"
 
 class GPSDelegate
 {
@@ -35,7 +39,7 @@ public:
 	virtual void timeSlotStarted(uint32_t slotNumber)=0;
 };
 
-class GPS : public EventConsumer
+class GPS : public EventConsumer, public GNSSConfiguratorDelegate
 {
 public:
 	static GPS &instance();
@@ -44,7 +48,13 @@ public:
 	void init();
 	void enable();
 	void disable();
+	// Drives the receiver configuration, so it's called from the main loop
+	void poll();
+#if GNSS_RX_DMA
+	bool onLine(const GNSSSlice &slice);
+#else
 	void onRX(char c);
+#endif
 	void onPPS();
 	void startTimer();
 	void stopTimer();
@@ -53,30 +63,59 @@ public:
 	time_t UTC();
 	struct tm &time();
 	uint32_t aisSlot();
-	double lat();
-	double lng();
+	// 1/10000 minutes
+	int32_t lat();
+	int32_t lng();
 	void setDelegate(GPSDelegate *delegate);
 
 	void onIRQ(uint32_t mask, void *data);
 	void processEvent(const Event &event);
 
+	void sendGNSSCommand(const char *command);
+	void setGNSSBaudRate(uint32_t rate);
+
 private:
 	GPS();
-	void processLine(const char *buff);
-	void parseSentence(const char *buff);
+	void processLine(const char *buff, uint8_t length);
+	void parseSentence(const NMEASentence &sentence);
+	// Lines aren't NUL terminated, so these look no further than the length
+	static bool isRMC(const char *buff, uint8_t length);
+	static bool isPMTKAck(const char *buff, uint8_t length);
+	void reportSlotClock();
+	void aidReceiver();
+	void saveFix();
+	void reportTTFF();
+	bool resume();
 private:
+#if !GNSS_RX_DMA
 	char mBuff[100];
 	uint8_t mBuffPos;
+#endif
 	time_t mUTC;
-	float mLat;
-	float mLng;
+	uint8_t mSecond;
+	int32_t mLat;
+	int32_t mLng;
 	bool mStarted;
 	uint32_t mSlotNumber;
 	GPSDelegate *mDelegate;
-	float mCOG;
-	float mSpeed;
-	uint32_t mPeriod;
+	uint16_t mCOG;
+	uint16_t mSpeed;
 	struct tm mTime;
+	GNSSConfigurator mConfigurator;
+	SlotClock mSlotClock;
+	SlotClockState mClockState;
+	uint32_t mClockReportTime;
+	uint32_t mEnableTime;
+	uint32_t mFixUTC;           // Of mLat and mLng, 0 if there hasn't been a fix since the receiver was enabled
+	uint32_t mFixSaveTime;
+	bool mFixSaved;
+	bool mAidingPending;
+	bool mAided;
+	uint32_t mPPSUptime;
+	uint32_t mPPSCycles;
+	uint32_t mResumeUTC;        // From before a warm reset, to pick up the time at the first PPS
+	uint32_t mResumeOffset;     // Milliseconds from the PPS of mResumeUTC to the reset
+	bool mResumed;              // Until the first RMC confirms the time resume() picked up
 };
 
 #endif /* GPS_HPP_ */
@@ -0,0 +1,76 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef HDLCDECODER_HPP_
+#define HDLCDECODER_HPP_
+
+#include <inttypes.h>
+#include "RXPacket.hpp"
+
+
+/**
+ * Table-driven NRZI/HDLC decoder. Instead of running a state machine for every bit,
+ * it consumes groups of up to 8 raw NRZI levels and relies on lookup tables for NRZI decoding,
+ * start/end flag detection and bit de-stuffing. The resulting RXPacket contents are identical
+ * to what the original bit-by-bit implementation produced.
+ */
+class HDLCDecoder
+{
+public:
+  typedef enum
+  {
+    NO_EVENT,           // All levels were consumed
+    FRAME_STARTED,      // Preamble and start flag detected, what follows is packet data
+    FRAME_COMPLETE,     // End flag detected, the packet is complete
+    FRAME_ABORTED       // Too many consecutive 1s or an oversized packet
+  } Result;
+
+  HDLCDecoder();
+
+  void reset();
+  bool inFrame() const;
+
+  /**
+   * Decodes up to 8 raw levels from the data pin. They are left-aligned in "levels" (bit 7 is the
+   * earliest one) and "count" of them are valid. Decoding stops after the first event, and both
+   * arguments are updated to reflect what remains. The caller is expected to act on the event
+   * (and possibly reset the decoder) before feeding the remaining levels back in.
+   */
+  Result decode(uint8_t &levels, uint8_t &count, RXPacket &packet);
+
+  /**
+   * How many more levels (at most 8) can be collected before decoding, without any but the last one
+   * being able to complete or abort a frame. Decoding in batches of that size keeps every receiver restart
+   * at the level that caused it, as it was when every bit was decoded in its own clock interrupt.
+   */
+  uint8_t levelsBeforeEvent(uint16_t packetSize) const;
+private:
+  uint8_t scanPreamble(uint8_t bits, uint8_t count);
+  uint8_t decodeFrame(uint8_t bits, uint8_t count, RXPacket &packet, Result &result);
+private:
+  uint8_t   mLastLevel;
+  bool      mInFrame;
+  uint16_t  mBitWindow;
+  uint8_t   mOneBitCount;
+  uint16_t  mRXByte;
+  uint8_t   mBitCount;
+};
+
+#endif /* HDLCDECODER_HPP_ */
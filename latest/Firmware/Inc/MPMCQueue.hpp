@@ -0,0 +1,117 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef MPMCQUEUE_HPP_
+#define MPMCQUEUE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Bounded ring for any number of producer and consumer contexts, such as ISRs at different priorities.
+ * It is D. Vyukov's design: each cell carries a sequence number that says whose turn it is. A context claims
+ * a cell by advancing the enqueue (or dequeue) position with a compare-and-swap, which is LDREX/STREX on the
+ * Cortex-M4, and hands it over with a release store of the sequence number.
+ *
+ * Nothing ever waits for a context it may have preempted. A cell claimed by a preempted producer just reads
+ * as "empty" to the consumers (and a cell claimed by a preempted consumer reads as "full" to the producers)
+ * until the preempted context resumes. The only retries are after losing a compare-and-swap to a context
+ * that got further.
+ */
+template<typename T, size_t N> class MPMCQueue
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MPMCQueue capacity must be a power of 2");
+public:
+  MPMCQueue()
+    : mEnqueuePosition(0), mDequeuePosition(0)
+  {
+    for ( uint32_t i = 0; i < N; ++i )
+      mCells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool push(const T &element)
+  {
+    Cell *cell;
+    uint32_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+    for ( ;; )
+      {
+        cell = &mCells[position & (N - 1)];
+        int32_t diff = (int32_t)(cell->sequence.load(std::memory_order_acquire) - position);
+        if ( diff == 0 )
+          {
+            if ( mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+              break;
+          }
+        else if ( diff < 0 )
+          {
+            return false;
+          }
+        else
+          {
+            position = mEnqueuePosition.load(std::memory_order_relaxed);
+          }
+      }
+
+    cell->data = element;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &element)
+  {
+    Cell *cell;
+    uint32_t position = mDequeuePosition.load(std::memory_order_relaxed);
+    for ( ;; )
+      {
+        cell = &mCells[position & (N - 1)];
+        int32_t diff = (int32_t)(cell->sequence.load(std::memory_order_acquire) - (position + 1));
+        if ( diff == 0 )
+          {
+            if ( mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed) )
+              break;
+          }
+        else if ( diff < 0 )
+          {
+            return false;
+          }
+        else
+          {
+            position = mDequeuePosition.load(std::memory_order_relaxed);
+          }
+      }
+
+    element = cell->data;
+    cell->sequence.store(position + N, std::memory_order_release);
+    return true;
+  }
+
+private:
+  typedef struct {
+    std::atomic<uint32_t> sequence;
+    T data;
+  } Cell;
+
+  Cell mCells[N];
+  std::atomic<uint32_t> mEnqueuePosition;
+  std::atomic<uint32_t> mDequeuePosition;
+};
+
+#endif /* MPMCQUEUE_HPP_ */
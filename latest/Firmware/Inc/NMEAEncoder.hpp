@@ -22,10 +22,11 @@
 #ifndef NMEAENCODER_HPP_
 #define NMEAENCODER_HPP_
 
-#include <vector>
-#include <string>
 #include "RXPacket.hpp"
-using namespace std;
+
+
+// Enough for the 2 sentences that the largest packet we accept (MAX_AIS_RX_PACKET_SIZE) can produce
+#define NMEA_ENCODER_BUFFER_SIZE      160
 
 
 class NMEAEncoder
@@ -34,9 +35,12 @@ public:
   NMEAEncoder();
   virtual ~NMEAEncoder();
 
-  void encode(RXPacket &packet, vector<string> &sentences);
-private:
-  uint8_t nmeaCRC(const char* buff);
+  /**
+   * Writes the !AIVDM sentence(s) for a packet into the buffer, each one terminated with CRLF,
+   * followed by a NUL. Returns the length of what was written. Only whole sentences are written,
+   * so a buffer smaller than NMEA_ENCODER_BUFFER_SIZE may result in truncated output.
+   */
+  uint16_t encode(RXPacket &packet, char *buffer, uint16_t size);
 private:
   uint8_t mSequence;
 };
@@ -21,23 +21,49 @@
 #ifndef __NMEA_H__
 #define __NMEA_H__
 
-#include <string>
-#include <vector>
+#include <inttypes.h>
 
-using namespace std;
+// Enough for GSV, which is the longest sentence the GNSS sends
+#define NMEA_MAX_FIELDS     24
 
+/**
+ * A view of an NMEA sentence in a caller's buffer, which must outlive it. Parsing is a single pass
+ * that validates the checksum and records where each field starts, so nothing is copied or allocated.
+ * Fields end at the next ',' or the '*', so they are not NUL terminated.
+ */
 class NMEASentence
 {
 public:
-  NMEASentence(const string &raw);
-  const string &code() const;
-  const vector<string> &fields() const;
-  const string &raw() const;
+  NMEASentence(const char *raw);
+
+  // For sentences that aren't NUL terminated
+  NMEASentence(const char *raw, uint8_t length);
+
+  // True if the sentence is well formed and its checksum matches
+  bool isValid() const;
+
+  // Field 0 is the address (e.g. "GPRMC") without the leading '$' or '!'
+  uint8_t numFields() const;
+  const char *field(uint8_t index) const;
+  uint8_t fieldLength(uint8_t index) const;
+
+  // Compares the sentence ID (e.g. "RMC"), ignoring the talker
+  bool is(const char *sentenceID) const;
+
+  // Decimal digits at an offset into a field. Returns -1 if any are missing.
+  int32_t digits(uint8_t index, uint8_t offset, uint8_t count) const;
+
+  const char *raw() const;
+
+  // Of the whole line, including anything after the checksum
+  uint8_t length() const;
 private:
   bool parse();
-  const string &mRaw;
-  string mCode;
-  vector<string> mFields;
+  const char *mRaw;
+  uint8_t mLength;
+  uint8_t mStarts[NMEA_MAX_FIELDS + 1];
+  uint8_t mNumFields;
+  bool mValid;
 };
 
 #endif
@@ -21,68 +21,110 @@
 #ifndef OBJECTPOOL_HPP_
 #define OBJECTPOOL_HPP_
 
-using namespace std;
-
-
-#include "printf_serial.h"
+#include <stdint.h>
+#include <atomic>
 #include "_assert.h"
-#include "CircularQueue.hpp"
-#include "Utils.hpp"
 
 
-template<typename T> class ObjectPool
+/*
+ * Usage accounting shared by all pools. Every pool puts itself on a list at construction,
+ * so Stats can report all of them as $PAIPOL sentences.
+ */
+class PoolStats
 {
 public:
+  const char *name() const;
+  uint32_t size() const;
+  uint32_t bytes() const;
+  uint32_t utilization() const;
+  uint32_t maxUtilization() const;
+  uint32_t failures() const;
+
+  static PoolStats *first();
+  PoolStats *next() const;
+protected:
+  PoolStats(const char *name, uint32_t size, uint32_t bytes);
+
+  void allocated();
+  void released();
+  void failed();
+private:
+  const char              *mName;
+  uint32_t                mSize;
+  uint32_t                mBytes;
+  std::atomic<uint32_t>   mUtilization;
+  std::atomic<uint32_t>   mMaxUtilization;
+  std::atomic<uint32_t>   mFailures;
+  PoolStats               *mNext;
+};
 
-  ObjectPool<T>(uint32_t size)
-    : mQueue(size)
+/*
+ * N objects in a contiguous array, constructed once. The free list is a stack of array indices
+ * with a separate link per object; a link can't share the object's storage because pooled objects
+ * keep state across get()/put() (Event::rxPacket must stay null, for instance).
+ *
+ * get() and put() are O(1) and safe from any thread or ISR. The head of the stack is an index
+ * and a tag in one word, swapped with compare-and-swap (LDREX/STREX). The tag changes on every
+ * operation, so a context that was preempted between reading the head and swapping it can't
+ * swap in a stale link after others have taken and returned the same object (the ABA problem).
+ */
+template<typename T, uint32_t N> class ObjectPool : public PoolStats
+{
+  static_assert(N > 0 && N < 0xffff, "ObjectPool size must fit a 16-bit index");
+public:
+  ObjectPool(const char *name)
+    : PoolStats(name, N, sizeof(ObjectPool))
   {
-    mSize = size;
-    mUtilization = 0;
-    mMaxUtilization = 0;
+    for ( uint16_t i = 0; i < N; ++i )
+      mNextFree[i].store(i + 1, std::memory_order_relaxed);
 
-    //printf_serial_now("ObjectPool @%p\r\n", this);
-    for ( uint32_t i = 0; i < mSize; ++i )
-      {
-        T *p = new T();
-        ASSERT_VALID_PTR(p);
-        mQueue.push(p);
-        //printf_serial_now("\t@%p\r\n", p);
-      }
+    mFreeList.store(0, std::memory_order_relaxed);
   }
 
   T *get()
   {
-    T *result = nullptr;
-    mQueue.pop(result);
-    return result;
+    uint32_t head = mFreeList.load(std::memory_order_acquire);
+    for ( ;; )
+      {
+        uint16_t index = head & 0xffff;
+        if ( index == NONE )
+          {
+            failed();
+            return nullptr;
+          }
+
+        uint32_t newHead = (head & 0xffff0000) + 0x10000 + mNextFree[index].load(std::memory_order_relaxed);
+        if ( mFreeList.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire) )
+          {
+            allocated();
+            return &mObjects[index];
+          }
+      }
   }
 
   void put(T* o)
   {
-    mQueue.push(o);
-  }
-
-  uint32_t maxUtilization()
-  {
-    return mMaxUtilization;
-  }
+    ASSERT(o >= mObjects && o < mObjects + N);
+    uint16_t index = o - mObjects;
 
-  uint32_t utilization()
-  {
-    return mUtilization;
-  }
+    uint32_t head = mFreeList.load(std::memory_order_relaxed);
+    for ( ;; )
+      {
+        mNextFree[index].store(head & 0xffff, std::memory_order_relaxed);
+        uint32_t newHead = (head & 0xffff0000) + 0x10000 + index;
+        if ( mFreeList.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed) )
+          break;
+      }
 
-  uint32_t size()
-  {
-    return mSize;
+    released();
   }
 
 private:
-  uint32_t          mSize;
-  uint32_t          mUtilization;
-  uint32_t          mMaxUtilization;
-  CircularQueue<T*> mQueue;
+  static const uint16_t   NONE = N;
+
+  T                       mObjects[N];
+  std::atomic<uint16_t>   mNextFree[N];
+  std::atomic<uint32_t>   mFreeList;      // Tag in the upper half, index of the first free object in the lower
 };
 
 #endif /* OBJECTPOOL_HPP_ */
@@ -69,12 +69,12 @@ public:
   uint8_t rssi() const;
   void setRSSI(uint8_t);
 private:
-  void addBit(uint8_t bit);
-  void addBitCRC(uint8_t bit);
+  void addBits(uint8_t bits, uint8_t count);
 private:
   struct
   {
-    uint8_t mPacket[MAX_AIS_RX_PACKET_SIZE/8+1];
+    // Payload bits in MSB order, so fields can be extracted with a couple of shifts
+    uint32_t mPacket[MAX_AIS_RX_PACKET_SIZE/32+1];
     uint16_t mSize;
     uint16_t mCRC;
     mutable uint8_t mType;
@@ -23,6 +23,7 @@
 
 #include "Events.hpp"
 #include "NMEAEncoder.hpp"
+#include "BinaryEncoder.hpp"
 #include <vector>
 #include "Configuration.hpp"
 
@@ -53,7 +54,8 @@ private:
   };
 
   NMEAEncoder mEncoder;
-  std::vector<std::string> mSentences;
+  char mNMEABuffer[NMEA_ENCODER_BUFFER_SIZE];
+  uint8_t mFrameBuffer[BINARY_FRAME_BUFFER_SIZE];
   StationData mStationData;
 };
 
@@ -25,7 +25,7 @@
 #include "Transceiver.hpp"
 #include "GPS.hpp"
 #include "TXPacket.hpp"
-#include "CircularQueue.hpp"
+#include "SPSCQueue.hpp"
 #include "EventQueue.hpp"
 #include "AISChannels.h"
 
@@ -38,6 +38,10 @@ public:
   void init();
   void start();
   void onBitClock(uint8_t ic);
+#if RX_IC_CAPTURE
+  void onCapturedSamples(const uint16_t *samples, uint32_t count, uint32_t position);
+  void onRXRSSITime();
+#endif
   void timeSlotStarted(uint32_t slotNumber);
 
   void scheduleTransmission(TXPacket *p);
@@ -59,7 +63,7 @@ private:
   bool mInitializing;
   time_t mUTC;
 
-  CircularQueue<TXPacket*>  mTXQueue;
+  SPSCQueue<TXPacket*, MAX_TX_PACKETS_IN_QUEUE>  mTXQueue;
 };
 
 #endif /* RADIOMANAGER_HPP_ */
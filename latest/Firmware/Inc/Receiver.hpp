@@ -25,6 +25,7 @@
 #include "RadioState.hpp"
 #include "RFIC.hpp"
 #include "AISChannels.h"
+#include "HDLCDecoder.hpp"
 
 
 
@@ -49,6 +50,11 @@ public:
   virtual void onBitClock();
   virtual void timeSlotStarted(uint32_t slot);
   void switchToChannel(VHFChannel channel);
+#if RX_IC_CAPTURE
+  void enableCapture();
+  void processCapturedSamples(const uint16_t *samples, uint32_t count, uint32_t position);
+  void latchRSSI();
+#endif
 protected:
   typedef enum
   {
@@ -58,24 +64,34 @@ protected:
   } Action;
 
   void startListening(VHFChannel channel, bool reconfigGPIOs);
-  bool addBit(uint8_t bit);
   void resetBitScanner();
+  void processLevel(uint8_t level);
+  void startSlot(uint32_t slot);
   uint8_t reportRSSI();
+  uint8_t slotRSSI();
   void pushPacket();
-  Action processNRZIBit(uint8_t level);
+  Action decodeLevels();
+  void sizeBatch(uint16_t packetSize);
   virtual void configureGPIOsForRX();
 protected:
   RXPacket *mRXPacket = nullptr;
-  uint16_t mBitWindow;
-  uint8_t mLastNRZIBit;
-  uint32_t mBitCount;
-  uint32_t mOneBitCount;
-  BitState mBitState;
-  uint8_t mRXByte;
+  HDLCDecoder mDecoder;
+  uint8_t mLevels;
+  uint8_t mLevelCount;
+  uint8_t mBatchSize;
   VHFChannel mChannel;
   int mSlotBitNumber;
   VHFChannel mNextChannel;
   uint32_t mTimeSlot = 0xffffffff;
+#if RX_IC_CAPTURE
+  bool mCapturing = false;
+  volatile bool mSlotPending = false;
+  volatile uint32_t mPendingSlot = 0xffffffff;
+  volatile uint32_t mPendingSlotPosition = 0;
+  volatile uint8_t mLatchedRSSI = 0;
+  volatile uint32_t mLatchedRSSISlot = 0xffffffff;
+  uint32_t mCapturePosition = 0;
+#endif
 };
 
 #endif /* RECEIVER_HPP_ */
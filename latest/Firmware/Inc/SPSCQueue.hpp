@@ -0,0 +1,91 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef SPSCQUEUE_HPP_
+#define SPSCQUEUE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Bounded ring for exactly one producer and one consumer context, which may preempt each other.
+ * The producer only ever writes mHead and the consumer only ever writes mTail, so no read-modify-write
+ * is needed. The release stores publish the element (or the free slot) to the other side's acquire loads.
+ *
+ * The indices run freely and wrap at 2^32, which is why the capacity must be a power of 2.
+ */
+template<typename T, size_t N> class SPSCQueue
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SPSCQueue capacity must be a power of 2");
+public:
+  SPSCQueue()
+    : mHead(0), mTail(0)
+  {
+  }
+
+  // Consumer side
+  bool empty() const
+  {
+    return mTail.load(std::memory_order_relaxed) == mHead.load(std::memory_order_acquire);
+  }
+
+  // Producer side
+  bool push(const T &element)
+  {
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    if ( head - mTail.load(std::memory_order_acquire) == N )
+      return false;
+
+    mBuffer[head & (N - 1)] = element;
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Copies the oldest element without removing it.
+  bool peek(T &element) const
+  {
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    if ( tail == mHead.load(std::memory_order_acquire) )
+      return false;
+
+    element = mBuffer[tail & (N - 1)];
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T &element)
+  {
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    if ( tail == mHead.load(std::memory_order_acquire) )
+      return false;
+
+    element = mBuffer[tail & (N - 1)];
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::atomic<uint32_t> mHead;
+  std::atomic<uint32_t> mTail;
+  T mBuffer[N];
+};
+
+#endif /* SPSCQUEUE_HPP_ */
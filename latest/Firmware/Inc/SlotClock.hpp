@@ -0,0 +1,97 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef SLOTCLOCK_HPP_
+#define SLOTCLOCK_HPP_
+
+#include <inttypes.h>
+
+typedef enum {
+  SLOT_CLOCK_STOPPED = 0,
+  SLOT_CLOCK_ACQUIRING,
+  SLOT_CLOCK_LOCKED,
+  SLOT_CLOCK_HOLDOVER,
+  // Without PPS for too long, the timer has to be stopped
+  SLOT_CLOCK_EXPIRED
+} SlotClockState;
+
+/**
+ * Software PLL for the SOTDMA slot timer. The timer's phase is measured at every PPS and the length of
+ * each slot is trimmed (with fractional counts dithered over successive slots) to cancel the MCU clock's
+ * frequency error and slew out the phase error. Without PPS, slots keep the last frequency estimate.
+ *
+ * There is no hardware access in here, all times are in timer counts.
+ */
+class SlotClock
+{
+public:
+  // The timer clock in Hz
+  SlotClock(uint32_t clock);
+
+  // The timer has just been started on a slot boundary, at a PPS
+  void start();
+
+  /**
+   * The timer's counter at a PPS, which is half way through a slot on odd seconds. Returns false if the
+   * phase error is too large to slew, in which case the caller must step the counter.
+   */
+  bool onPPS(uint32_t counter, bool evenSecond);
+
+  // Called at every slot boundary. Returns the length of the slot after this one.
+  uint32_t onSlot();
+
+  SlotClockState state() const;
+
+  // Length of the slot in progress, in counts
+  uint32_t slotLength() const;
+
+  // In parts per billion. Positive if the MCU clock is fast.
+  int32_t frequencyError() const;
+
+  // The raw estimate, so it can be carried across a warm reset
+  int32_t frequency() const;
+  void setFrequency(int32_t frequency);
+
+  // As of the last PPS, in nanoseconds. Positive if slots start early.
+  int32_t phaseError() const;
+
+  // Seconds without PPS
+  uint32_t holdoverTime() const;
+private:
+  void updatePeriod();
+  int32_t toNanoseconds(int64_t counts) const;
+private:
+  uint32_t mClock;
+  SlotClockState mState;
+  uint32_t mNominalPeriod;      // 1/256 counts
+  uint32_t mPeriod;             // 1/256 counts
+  uint32_t mFraction;           // 1/256 counts
+  uint32_t mCurrentSlot;        // Counts
+  uint32_t mNextSlot;           // Counts
+  int32_t mFrequency;           // 1/256 counts per second
+  int32_t mWander;              // 1/256 counts per second
+  int32_t mCorrection;          // Counts to slew out over the next second
+  int32_t mResidual;            // Expected phase error at the next PPS
+  int32_t mPhaseError;
+  uint32_t mSlotsSincePPS;
+  uint8_t mGoodPPS;
+};
+
+#endif /* SLOTCLOCK_HPP_ */
@@ -19,12 +19,20 @@ public:
 
   void processEvent(const Event &e);
 
+  // Milliseconds from a transmitted position report's fix to its slot. Called from the bit clock ISR.
+  void recordTXFixAge(uint32_t age);
+
 private:
   Stats();
 public:
   int eventQueuePopFailures       = 0;
   int eventQueuePushFailures      = 0;
   int rxPacketPoolPopFailures     = 0;
+  int terminalTXOverflows         = 0;
+  int terminalTXHighWater         = 0;
+  int txFixAge                    = 0;
+  int txFixAgeMax                 = 0;
+  int rxCaptureOverruns           = 0;
 };
 
 
@@ -25,6 +25,16 @@
 #include "config.h"
 #include <time.h>
 
+// The fix a position report was encoded with, so it can be brought forward to the slot it goes out in
+typedef struct {
+  time_t utc;         // Time of the fix, 0 if the packet carries no position
+  int32_t lat;        // 1/10000 minutes
+  int32_t lng;        // 1/10000 minutes
+  float north;        // 1/10000 minutes of latitude per second
+  float east;         // 1/10000 minutes of longitude per second
+  uint32_t age;       // Milliseconds from the fix to the start of the last slot the packet waited for
+} TXFix;
+
 class TXPacket
 {
 public:
@@ -46,6 +56,14 @@ public:
   void setMessageType(const char*);
   const char *messageType();
 
+  // The unframed payload, kept so fields can be changed and the packet framed again
+  void setPayload(const uint8_t *bytes, uint8_t length);
+  uint8_t *payload();
+  uint8_t payloadLength();
+  void rewind();
+
+  TXFix &fix();
+
   void configure(VHFChannel channel);
   void reset();
 
@@ -54,6 +72,9 @@ public:
   bool isTestPacket();
 private:
   uint8_t mPacket[MAX_AIS_TX_PACKET_SIZE/8+1];
+  uint8_t mPayload[MAX_AIS_TX_PACKET_SIZE/8];
+  uint8_t mPayloadLength;
+  TXFix mFix;
   uint16_t mSize;
   uint16_t mPosition;
   VHFChannel mChannel;
@@ -72,7 +93,9 @@ public:
   TXPacket *newTXPacket(VHFChannel channel);
   void deleteTXPacket(TXPacket*);
 private:
-  ObjectPool<TXPacket> *mPool;
+  TXPacketPool();
+private:
+  ObjectPool<TXPacket, 4> mPool;
 };
 
 
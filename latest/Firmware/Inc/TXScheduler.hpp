@@ -30,15 +30,17 @@ private:
   time_t positionReportTimeInterval();
   void queueMessage18(VHFChannel channel);
   void queueMessage24(VHFChannel channel);
+  void saveState();
 private:
   VHFChannel mPositionReportChannel;
   VHFChannel mStaticDataChannel;
   time_t mUTC;
   time_t mLast18Time;
   time_t mLast24Time;
-  float mAvgSpeed;
+  uint32_t mAvgSpeed;     // 1/160 knots, for some precision below the 0.1 knots of a fix
   StationData mStationData;
   GPSFix mLastGPSFix;
+  bool mResumed;
 };
 
 #endif /* TXSCHEDULER_HPP_ */
@@ -0,0 +1,49 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef TIMEOUTPUT_HPP_
+#define TIMEOUTPUT_HPP_
+
+#include "Events.hpp"
+
+/**
+ * Our own time sentences, sent as soon as possible after every PPS:
+ *
+ * $GPZDA,hhmmss.00,dd,mm,yyyy,00,00 for the second that started at the PPS edge
+ * $PAITIM,hhmmss,<slot>,<offset>,<latency>
+ *
+ * where slot is the AIS slot (0-2249) the edge fell in and offset is how far into that slot it was, in
+ * microseconds. Both are empty while the slot timer isn't running. Latency is how many microseconds after
+ * its PPS edge the previous $GPZDA started going out, empty if it didn't go out.
+ */
+class TimeOutput : public EventConsumer
+{
+public:
+  static TimeOutput &instance();
+
+  void init();
+  void processEvent(const Event &e);
+private:
+  TimeOutput();
+private:
+  uint32_t mPPSCycles;        // Of the last $GPZDA
+};
+
+#endif /* TIMEOUTPUT_HPP_ */
@@ -57,6 +57,7 @@ private:
   void configureGPIOsForTX(tx_power_level pwr);
   void setTXPower(tx_power_level pwr);
   void reportTXEvent();
+  void updatePosition(uint32_t slot);
 private:
   TXPacket    *mTXPacket;
   time_t      mUTC;
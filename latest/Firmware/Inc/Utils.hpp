@@ -36,13 +36,16 @@ public:
   static void tokenize(const string &str, char delim, vector<string> &result);
 
   static int toInt(const std::string &);
-  static uint16_t crc16(uint8_t* data, uint16_t len);
-  static uint16_t reverseBits(uint16_t data);
 
   // NMEA-specific
-  static float latitudeFromNMEA(const string &decimal, const string &hemisphere);
-  static float longitudeFromNMEA(const string &decimal, const string &hemisphere);
-  static uint32_t coordinateToUINT32(double value);
+  /*
+   * These take the fields as they appear in a sentence (i.e. not NUL terminated). Coordinates are
+   * in 1/10000 minutes (as used by AIS), speed and course in tenths. Extra decimals are truncated.
+   */
+  static int32_t latitudeFromNMEA(const char *decimal, char hemisphere);
+  static int32_t longitudeFromNMEA(const char *decimal, char hemisphere);
+  static int32_t coordinateFromNMEA(const char *decimal, uint8_t degreeDigits, bool negative);
+  static uint32_t tenthsFromNMEA(const char *decimal);
   static float coordinateFromUINT32(uint32_t aisCoordinate, uint8_t numBits);
 
   // ARM-specific utilities
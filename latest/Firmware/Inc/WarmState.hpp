@@ -0,0 +1,76 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#ifndef WARMSTATE_HPP_
+#define WARMSTATE_HPP_
+
+#include <inttypes.h>
+#include "Events.hpp"
+
+/**
+ * Everything that takes minutes to rebuild after a reset
+ */
+typedef struct
+{
+  // GPS
+  uint32_t        utc;                    // Of the second that started at the last PPS, 0 if unknown
+  uint32_t        ppsUptime;              // bsp_get_uptime_ms() at that PPS
+  int32_t         slotClockFrequency;     // SlotClock's estimate, 1/256 counts per second
+
+  // NoiseFloorDetector
+  uint8_t         noiseFloorA;
+  uint8_t         noiseFloorB;
+
+  // TXScheduler
+  uint8_t         positionReportChannel;
+  uint8_t         staticDataChannel;
+  uint32_t        last18Time;
+  uint32_t        last24Time;
+  uint32_t        avgSpeed;
+  GPSFix          lastFix;
+} WarmStateData;
+
+/**
+ * Keeps WarmStateData in RAM that is not initialized at startup, protected by a magic value and a CRC so that
+ * it is only trusted after a software or watchdog reset. Owners update their own part and commit(), all from
+ * thread context.
+ */
+class WarmState
+{
+public:
+  static WarmState &instance();
+
+  // Must be called before anything asks for restored()
+  void init();
+
+  // As it was at startup, or nullptr after a cold start
+  const WarmStateData *restored() const;
+
+  WarmStateData &data();
+  void commit();
+private:
+  WarmState();
+  uint16_t crc() const;
+private:
+  WarmStateData mRestored;
+  bool mValid;
+};
+
+#endif /* WARMSTATE_HPP_ */
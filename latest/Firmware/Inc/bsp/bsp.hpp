@@ -21,6 +21,7 @@
 #define INC_BSP_HPP_
 
 #include "StationData.h"
+#include "ConfigData.h"
 #include "config.h"
 
 // Current board revision is 5.0
@@ -35,6 +36,8 @@
  */
 
 void bsp_hw_init();
+
+// Blocking output on the main UART, bypassing anything queued for non-blocking output. Only meant for emergencies.
 void bsp_write_char(const char c);
 void bsp_write_string(const char *s);
 void bsp_set_rx_mode();
@@ -42,7 +45,21 @@ void bsp_set_tx_mode();
 void bsp_start_wdt();
 void bsp_refresh_wdt();
 uint32_t bsp_get_system_clock();
+uint32_t bsp_get_uptime_ms();
+// Free-running at bsp_get_system_clock(), for timing things to the cycle. Wraps every minute or so.
+uint32_t bsp_get_cycle_count();
 void bsp_reboot();
+
+typedef enum
+{
+  RESET_COLD = 0,       // Power-on, brown-out or the reset pin
+  RESET_SOFTWARE,
+  RESET_WATCHDOG
+} reset_cause;
+
+reset_cause bsp_get_reset_cause();
+// How long we had been up when bsp_reboot() caused the last reset, 0 if it didn't
+uint32_t bsp_get_reboot_uptime();
 void bsp_enter_dfu();
 void bsp_gnss_on();
 void bsp_gnss_off();
@@ -58,6 +75,41 @@ typedef void(*char_input_cb)(char c);
 void bsp_set_gnss_input_callback(char_input_cb cb);
 void bsp_set_terminal_input_callback(char_input_cb cb);
 
+/**
+ * Non-blocking output on the main UART. Whenever the UART transmitter goes idle, the BSP calls this
+ * from an interrupt to get the next contiguous chunk of output and sends it with DMA. The data must remain
+ * intact until the next call, which implies that the previous chunk has been sent.
+ */
+typedef uint16_t(*tx_pull_callback)(const char **data);
+void bsp_set_terminal_output_callback(tx_pull_callback cb);
+
+// Must be called whenever new output is available
+void bsp_kick_terminal_output();
+
+// Takes effect after the character being shifted out (if any), but does not wait for queued output
+void bsp_set_terminal_baud_rate(uint32_t rate);
+
+// Only boards that define GNSS_NMEA_TX_PIN can send commands to the GNSS. On the rest, output goes nowhere.
+bool bsp_gnss_can_transmit();
+
+// Blocking, returns once the last character has been shifted out
+void bsp_write_gnss_string(const char *s);
+void bsp_set_gnss_baud_rate(uint32_t rate);
+
+#if GNSS_RX_DMA
+/**
+ * Circular DMA reception of GNSS input into a caller's buffer, which replaces the GNSS input callback.
+ * The callback runs in interrupt context for every line feed, whenever the line goes idle and whenever half
+ * the buffer has been filled, with the position (a free running character count) of the next character to be received.
+ */
+typedef void(*gnss_rx_callback)(uint32_t position);
+void bsp_start_gnss_rx(char *buffer, uint16_t size, gnss_rx_callback cb);
+uint32_t bsp_get_gnss_rx_position();
+
+// Input is dropped while paused
+void bsp_set_gnss_rx_paused(bool paused);
+#endif
+
 // Callback for GPIO and other interrupts
 typedef void(*irq_callback)();
 
@@ -67,20 +119,60 @@ void bsp_set_gnss_sotdma_timer_callback(irq_callback cb);
 void bsp_set_trx_clk_callback(irq_callback cb);
 void bsp_set_rx_clk_callback(irq_callback cb);
 
+#if RX_IC_CAPTURE
+/**
+ * Hardware capture of the RX IC data pin. Each sample is the value of the data pin's GPIO port
+ * at a rising edge of the RX IC clock. Samples are delivered in order from a lower priority interrupt,
+ * along with the capture position (a free running sample count) of the first one. Samples that were
+ * overwritten before they could be delivered are skipped, so a delivery can start at a later position
+ * than the previous one ended.
+ */
+typedef void(*capture_callback)(const uint16_t *samples, uint32_t count, uint32_t position);
+
+// Replaces the RX IC clock callback
+void bsp_set_rx_capture_callback(capture_callback cb);
+
+// The position of the next sample to be captured
+uint32_t bsp_get_rx_capture_position();
+
+// Requests delivery of everything captured so far, without waiting for the buffer to fill up
+void bsp_flush_rx_capture();
+
+/**
+ * Called from the SOTDMA timer interrupt in every slot, the given number of bit periods after the slot
+ * started. This is when the RX IC's RSSI must be read, as the captured samples are processed much later.
+ */
+void bsp_set_rx_rssi_callback(irq_callback cb, uint32_t bits);
+#endif
+
 // Abstraction of the SOTDMA hardware timer
 void bsp_start_sotdma_timer();
 void bsp_stop_sotdma_timer();
 uint32_t bsp_get_sotdma_timer_value();
 void bsp_set_sotdma_timer_value(uint32_t v);
+// Length of the slot after the one in progress
+void bsp_set_sotdma_timer_period(uint32_t counts);
 
 // Encapsulates the SPI bus
 uint8_t bsp_tx_spi_byte(uint8_t b);
 
+// CRC-16/X.25 of a buffer using the CRC unit. Returns false if the hardware can't be used.
+bool bsp_crc16(const uint8_t *data, uint16_t length, uint16_t &crc);
+
 // Station data persistence support -- this is absolutely board specific (e.g. flash vs EEPROM)
 bool bsp_erase_station_data();
 bool bsp_save_station_data(const StationData &data);
 bool bsp_read_station_data(StationData &data);
 
+// Same for other configuration values, which must be stored separately
+bool bsp_erase_config_data();
+bool bsp_save_config_data(const ConfigData &data);
+bool bsp_read_config_data(ConfigData &data);
+
+// And for the last GNSS fix
+bool bsp_save_gnss_fix(const GNSSFixData &data);
+bool bsp_read_gnss_fix(GNSSFixData &data);
+
 // Board-specific headers go here
 
 #if BOARD_REV == 52
@@ -70,6 +70,105 @@
 // As a class B transponder, we never transmit anything bigger than 240 bits.
 #define MAX_AIS_TX_PACKET_SIZE       256
 
+// Default baud rate of the main UART. The "baud" command can change it to 115200, 230400 or 460800.
+#define TERMINAL_BAUD_RATE         38400
+
+// Milliseconds the host has to confirm a new baud rate ("baud confirm") before the old one is restored
+#define TERMINAL_BAUD_CONFIRM_TIMEOUT 10000
+
+// Output queued for the main UART. At 38400 bps, this takes over 250ms to drain.
+#define TERMINAL_TX_BUFFER_SIZE     1024
+
+/*
+ * When the main UART can't keep up, GNSS passthrough and proprietary sentences are shed to make room for AIS.
+ * Thresholds are in milliseconds of output already queued, at the line rate.
+ */
+#define TERMINAL_SHED_PROPR_MS       100
+#define TERMINAL_DECIMATE_GNSS_MS    100
+#define TERMINAL_SHED_GNSS_MS        200
+
+// While decimating, GNSS sentences only go out every Nth second, so whole epochs are kept
+#define TERMINAL_GNSS_DECIMATION       4
+
+// Seconds between $PAISHD reports. Nothing is reported for periods where nothing was shed.
+#define TERMINAL_SHED_REPORT_INTERVAL 10
+
+/*
+ * The GNSS receiver (Quectel L70R) is configured with PMTK commands when it's enabled. Each step is acknowledged,
+ * and a step that fails leaves the receiver at its default for that setting. Set GNSS_CONFIGURE to 0 to skip all of it.
+ */
+#define GNSS_CONFIGURE                 1
+
+// What the receiver comes up with. It only remembers a different rate while it has backup power.
+#define GNSS_DEFAULT_BAUD_RATE      9600
+#ifndef GNSS_BAUD_RATE
+#define GNSS_BAUD_RATE              9600
+#endif
+
+// Milliseconds between fixes. 200 gives 5 Hz, which needs GNSS_BAUD_RATE to be higher than the default.
+#ifndef GNSS_FIX_INTERVAL
+#define GNSS_FIX_INTERVAL             1000
+#endif
+
+/*
+ * PMTK314 sentence rates, in fixes per sentence (0 = off), for GLL, RMC, VTG, GGA, GSA and GSV.
+ * We only need RMC ourselves. GGA is kept for whatever consumes GNSS passthrough.
+ */
+#define GNSS_SENTENCES              "0,1,0,1,0,0"
+
+#define GNSS_ACK_TIMEOUT             1000
+#define GNSS_PROBE_TIMEOUT           2500
+#define GNSS_CONFIG_RETRIES             3
+
+/*
+ * The last fix is saved every GNSS_FIX_SAVE_INTERVAL seconds (and on the first fix after power-up). Once the
+ * receiver knows the time again, a saved position no older than GNSS_AIDING_MAX_AGE seconds is injected with
+ * PMTK741 to shorten the search. This needs a UART line to the receiver, and boards without one
+ * don't save fixes either.
+ */
+#define GNSS_AIDING                    1
+#define GNSS_FIX_SAVE_INTERVAL      1800
+#define GNSS_AIDING_MAX_AGE        86400
+
+/*
+ * The SOTDMA slot timer is disciplined by the GNSS PPS. Phase errors up to SOTDMA_STEP_THRESHOLD (in microseconds)
+ * are slewed out by trimming the slot length, anything larger is stepped out at once.
+ */
+#define SOTDMA_STEP_THRESHOLD        100
+
+/*
+ * Without PPS, the slot timer keeps going on its last frequency estimate for up to SOTDMA_HOLDOVER seconds,
+ * as long as the predicted timing error stays within SOTDMA_HOLDOVER_BUDGET microseconds. Then it stops.
+ */
+#define SOTDMA_HOLDOVER               60
+#define SOTDMA_HOLDOVER_BUDGET       104    // One bit
+
+// Seconds between $PAISYN reports. State changes are reported right away.
+#define SOTDMA_REPORT_INTERVAL        60
+
+// Send our own $GPZDA and $PAITIM right after every PPS (see TimeOutput.hpp)
+#define TIME_OUTPUT                    1
+
+/*
+ * Event pools. An event is 40 bytes. Events that carry text (proprietary sentences, debug output, commands)
+ * also hold a 120 byte buffer from the text pool until they have been dispatched. The RAM of each pool is
+ * checked against its budget at compile time, and reported in $PAIPOL. The budgets are for the 32-bit target,
+ * so host builds (where an event is mostly 64-bit pointers) don't check the event pools.
+ */
+#define ISR_EVENT_POOL_SIZE           48
+#define THREAD_EVENT_POOL_SIZE        24
+#define TEXT_POOL_SIZE                16
+#define EVENT_POOL_RAM_BUDGET       3200
+#define TEXT_POOL_RAM_BUDGET        2048
+
+/*
+ * Latency budgets (ms) of the event dispatch lanes (see EventQueue.hpp). When any lane's oldest event has waited
+ * longer than its budget, the lane that is furthest over budget (relative to the budget) is served first.
+ */
+#define EVENT_LANE_BUDGET_TIMING      10
+#define EVENT_LANE_BUDGET_RX         100
+#define EVENT_LANE_BUDGET_IO         500
+
 // Maximum allowed backlog in TX queue
 #define MAX_TX_PACKETS_IN_QUEUE        4
 
@@ -77,6 +176,35 @@
 // Set to true to force RSSI sampling at every SOTDMA timer slot on both channels
 #define FULL_RSSI_SAMPLING             1
 
+/*
+ * The most levels the HDLC decoder gets in one go. In the bit clock ISR, this bounds the decoding done in
+ * any one bit period, including the one that pushes a packet. Must be between 1 and 8.
+ */
+#define MAX_RX_DECODE_LEVELS           4
+
+/*
+ * Set to non-zero to have the RX IC data pin sampled by timer/DMA hardware on every clock edge,
+ * with HDLC decoding done in batches from a lower priority interrupt instead of the bit clock ISR.
+ * It can also be defined on the command line.
+ */
+#ifndef RX_IC_CAPTURE
+#define RX_IC_CAPTURE                  0
+#endif
+
+/*
+ * Set to non-zero to receive GNSS input by circular DMA, with an interrupt when the line goes idle
+ * instead of one for every character. Sentences are then processed in place.
+ */
+#define GNSS_RX_DMA                    1
+
+// Must be a power of 2. At 9600 bps, this is about a second of input.
+#define GNSS_RX_BUFFER_SIZE         1024
+
+// Set to non-zero to compute TX frame check sequences with the MCU's CRC unit instead of a lookup table
+#ifndef HARDWARE_CRC
+#define HARDWARE_CRC                   0
+#endif
+
 // Headroom above noise floor (in dB) that constitutes a clear channel for transmission
 #if FULL_RSSI_SAMPLING
 #define TX_CCA_HEADROOM                2
@@ -91,6 +219,14 @@
 #define MIN_MSG_18_TX_INTERVAL        30
 #define MAX_MSG_18_TX_INTERVAL       180
 
+/*
+ * Message 18 is encoded when a fix arrives, but may wait several slots for a clear channel. When this is non-zero,
+ * its position and time stamp are dead-reckoned (from SOG and COG) to the start of the slot it goes out in,
+ * for fixes up to MAX_DEAD_RECKONING_TIME seconds old.
+ */
+#define TX_DEAD_RECKONING              1
+#define MAX_DEAD_RECKONING_TIME       MIN_MSG_18_TX_INTERVAL
+
 // Default interval for message 24 A&B (static data report)
 #define MSG_24_TX_INTERVAL           360
 
@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+
+#
+# Decoder for the binary output mode ("output binary" command).
+#
+# Every frame is a record followed by its CRC-16/X.25 (LSB first), COBS encoded and terminated with a zero byte.
+# See Inc/BinaryEncoder.hpp for the record layouts.
+#
+# Usage: binary_output.py <serial port> [baud rate]
+#
+# Frames are printed as the NMEA sentences the unit would have sent in NMEA mode, so this
+# can sit between the transponder and anything that expects NMEA.
+#
+
+import serial
+import struct
+import sys
+
+RECORD_AIS      = 1
+RECORD_GNSS     = 2
+RECORD_TEXT     = 3
+
+MAX_SENTENCE_BITS = 56 * 6
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i+1:i+code]
+        i += code
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc16(data):
+    crc = 0xffff
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0x8408 if crc & 1 else crc >> 1
+    return crc ^ 0xffff
+
+
+def decode_frame(frame):
+    """
+    Takes a frame without its zero delimiter. Returns a dict, or None if the frame is corrupt.
+    """
+    record = cobs_decode(frame)
+    if not record or len(record) < 3:
+        return None
+
+    body, fcs = record[:-2], struct.unpack('<H', record[-2:])[0]
+    if crc16(body) != fcs:
+        return None
+
+    rtype = body[0]
+    if rtype == RECORD_AIS and len(body) >= 6:
+        channel, slot, rssi, fill = struct.unpack('<BHBB', body[1:6])
+        return {'type': RECORD_AIS, 'channel': channel, 'slot': slot, 'rssi': rssi,
+                'bits': (len(body) - 6) * 8 - fill, 'payload': body[6:]}
+    if rtype == RECORD_GNSS and len(body) == 17:
+        utc, lat, lng, sog, cog = struct.unpack('<IiiHH', body[1:])
+        return {'type': RECORD_GNSS, 'utc': utc, 'lat': lat / 600000.0, 'lng': lng / 600000.0,
+                'speed': sog / 10.0, 'cog': cog / 10.0}
+    if rtype == RECORD_TEXT:
+        return {'type': RECORD_TEXT, 'text': body[1:].decode('ascii', 'replace')}
+
+    return None
+
+
+def armor(value):
+    return chr(value + (48 if value < 40 else 56))
+
+
+def nmea_checksum(s):
+    crc = 0
+    for c in s:
+        crc ^= ord(c)
+    return '%02X' % crc
+
+
+def designation(itu):
+    return {87: 'A', 88: 'B'}.get(itu, '?')
+
+
+def to_aivdm(record, sequence=0):
+    """
+    The !AIVDM sentence(s) the firmware would have sent for an AIS record
+    """
+    value = int.from_bytes(record['payload'], 'big') if record['payload'] else 0
+    num_bits = record['bits']
+    value >>= len(record['payload']) * 8 - num_bits
+
+    fill = (6 - num_bits % 6) % 6
+    value <<= fill
+    num_bits += fill
+
+    chars = ''.join(armor((value >> (num_bits - 6 * (i+1))) & 0x3f) for i in range(num_bits // 6))
+
+    per_sentence = MAX_SENTENCE_BITS // 6
+    parts = [chars[i:i+per_sentence] for i in range(0, len(chars), per_sentence)] or ['']
+    seq = str(sequence) if len(parts) > 1 else ''
+
+    sentences = []
+    for i, part in enumerate(parts):
+        f = fill if len(parts) > 1 and i == len(parts) - 1 else 0
+        body = 'AIVDM,%d,%d,%s,%s,%s,%d' % (len(parts), i+1, seq, designation(record['channel']), part, f)
+        sentences.append('!' + body + '*' + nmea_checksum(body) + '\r\n')
+
+    return sentences
+
+
+def frames(port):
+    """
+    Yields frames (without delimiters) as they arrive
+    """
+    buff = bytearray()
+    while True:
+        data = port.read(port.in_waiting or 1)
+        for b in data:
+            if b == 0:
+                if buff:
+                    yield bytes(buff)
+                buff = bytearray()
+            else:
+                buff.append(b)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print("Usage: {0} port [baud rate]".format(sys.argv[0]))
+        sys.exit(1)
+
+    baud = int(sys.argv[2]) if len(sys.argv) > 2 else 38400
+    port = serial.Serial(sys.argv[1], baud)
+
+    sequence = 0
+    for frame in frames(port):
+        record = decode_frame(frame)
+        if record is None:
+            sys.stderr.write("Bad frame\n")
+            continue
+
+        if record['type'] == RECORD_AIS:
+            # Like the firmware, the sequence ID only advances for multi-sentence messages
+            sentences = to_aivdm(record, (sequence + 1) % 10)
+            if len(sentences) > 1:
+                sequence = (sequence + 1) % 10
+            for s in sentences:
+                sys.stdout.write(s)
+        elif record['type'] == RECORD_GNSS:
+            sys.stdout.write("GNSS {utc} {lat:.6f} {lng:.6f} {speed:.1f}kn {cog:.1f}\n".format(**record))
+        else:
+            sys.stdout.write(record['text'])
+
+        sys.stdout.flush()
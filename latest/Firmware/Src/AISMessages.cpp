@@ -21,6 +21,7 @@
 #include <cmath>
 #include "AISMessages.hpp"
 #include "Utils.hpp"
+#include "CRC16.hpp"
 #include "_assert.h"
 #include <cstring>
 #include <sstream>
@@ -83,25 +84,6 @@ void AISMessage::addBits(uint8_t *bitVector, uint16_t &size, uint32_t value, uin
   size += numBits;
 }
 
-void AISMessage::putBits(uint8_t *bitVector, uint32_t value, uint8_t numBits)
-{
-  // This is used for HDLC framing
-  uint16_t pos = 0;
-  for ( uint8_t bit = 0; bit < numBits; ++bit, value >>= 1 )  {
-      bitVector[pos++] = value & 0x01;
-  }
-}
-
-void AISMessage::reverseEachByte(uint8_t *bitVector, uint16_t size)
-{
-  ASSERT(size % 8 == 0);
-  for ( uint16_t i = 0; i < size; i += 8 ) {
-      for ( uint8_t j = 0; j < 4; ++j ) {
-          swap(bitVector[i+j], bitVector[i+7-j]);
-      }
-  }
-}
-
 void AISMessage::addString(uint8_t *bitVector, uint16_t &size, const string &value, uint8_t maxChars)
 {
   ASSERT(value.length() <= maxChars);
@@ -125,7 +107,7 @@ void AISMessage::payloadToBytes(uint8_t *bitVector, uint16_t numBits, uint8_t *b
   for ( uint16_t i = 0; i < numBits; i += 8 ) {
       uint8_t byte = 0;
       for ( uint8_t b = 0; b < 8; ++b ) {
-          byte |= (bitVector[i+b] << b);
+          byte |= (bitVector[i+b] << (7-b));
       }
       byteArray[i/8] = byte;
   }
@@ -133,53 +115,45 @@ void AISMessage::payloadToBytes(uint8_t *bitVector, uint16_t numBits, uint8_t *b
 
 void AISMessage::finalize(uint8_t *payload, uint16_t &size, TXPacket &packet)
 {
-  // Nothing we send exceeds 256 bits, including preambles and such. 40 bytes is more than enough.
-  uint8_t bytes[40];
+  ASSERT(size % 8 == 0);
 
-  // CRC-CCITT calculation
-  payloadToBytes(payload, size, bytes);
-  uint16_t crc = Utils::crc16(bytes, size/8);
-  uint8_t crcL = crc & 0x00ff;
-  uint8_t crcH = (crc & 0xff00) >> 8;
-  addBits(payload, size, crcL, 8);
-  addBits(payload, size, crcH, 8);
+  // Nothing we send exceeds 256 bits, including preambles and such
+  uint8_t bytes[MAX_AIS_TX_PACKET_SIZE/8];
   payloadToBytes(payload, size, bytes);
+  packet.setPayload(bytes, size/8);
 
-  // Encoding for transmission
-  reverseEachByte(payload, size);
-  bitStuff(payload, size);
-  constructHDLCFrame(payload, size);
-  nrziEncode(payload, size, packet);
-  packet.pad();
+  // CRC-CCITT calculation
+  frame(packet, CRC16::compute(bytes, size/8));
+}
+
+// One bit on the air. NRZI: a 0 is a transition, a 1 is no transition.
+static inline void sendBit(TXPacket &packet, uint8_t &level, uint8_t bit)
+{
+  if ( bit == 0 )
+    level = !level;
+  packet.addBit(level);
 }
 
-void AISMessage::bitStuff(uint8_t *buff, uint16_t &size)
+// HDLC sends bytes LSB first, inserting a 0 after every five consecutive 1s
+static inline void sendStuffedByte(TXPacket &packet, uint8_t &level, uint8_t &numOnes, uint8_t byte)
 {
-  uint16_t numOnes = 0;
-  for ( uint16_t i = 0; i < size; ++i )
+  for ( uint8_t b = 0; b < 8; ++b, byte >>= 1 )
     {
-      switch(buff[i])
-      {
-      case 0:
-        numOnes = 0;
-        break;
-      case 1:
-        ++numOnes;
-        if ( numOnes == 5 )
-          {
-            // Insert a 0 right after this one
-            memmove(buff + i + 2, buff + i + 1, size-i-1);
-            buff[i+1] = 0;
-            ++size;
-          }
-        break;
-      default:
-        ASSERT(false);
-      }
+      uint8_t bit = byte & 1;
+      sendBit(packet, level, bit);
+      if ( !bit )
+        {
+          numOnes = 0;
+        }
+      else if ( ++numOnes == 5 )
+        {
+          sendBit(packet, level, 0);
+          numOnes = 0;
+        }
     }
 }
 
-void AISMessage::constructHDLCFrame(uint8_t *buff, uint16_t &size)
+void AISMessage::frame(TXPacket &packet, uint16_t fcs)
 {
   /*
    * As a class B "CS" transponder, we don't transmit a full ramp byte because
@@ -189,38 +163,32 @@ void AISMessage::constructHDLCFrame(uint8_t *buff, uint16_t &size)
    * reasonable receiver should care about ramp-down bits. It's only what goes
    * between the 0x7E markers that counts.
    */
-
-  // Make room for 35 bits at the front
-  memmove(buff+35, buff, size);
-  size += 35;
-  putBits(buff, 0xFF, 3);                             // 3 ramp bits. That's all we can afford.
-  putBits(buff+3, 0b010101010101010101010101, 24);    // 24 training bits (ramp will actually continue during the first 1-2)
-  putBits(buff+27, 0x7e, 8);                          // HDLC start flag
-
-  // Now append the end marker and ramp-down bits
-  addBits(buff, size, 0x7e, 8);                       // HDLC stop flag
-  addBits(buff, size, 0x00, 3);                       // Ramp down
-}
-
-void AISMessage::nrziEncode(uint8_t *buff, uint16_t &size, TXPacket &packet)
-{
-  uint8_t prevBit = 1;        // Arbitrarily starting with 1
-  packet.addBit(prevBit);
-
-  for ( uint16_t i = 0; i < size; ++i )
-    {
-      if ( buff[i] == 0 )
-        {
-          packet.addBit(!prevBit);
-          prevBit = !prevBit;
-        }
-      else
-        {
-          packet.addBit(prevBit);
-        }
-    }
+  packet.rewind();
+
+  uint8_t level = 1;          // Arbitrarily starting with 1
+  packet.addBit(level);
+
+  for ( uint8_t i = 0; i < 3; ++i )
+    sendBit(packet, level, 1);                        // 3 ramp bits. That's all we can afford.
+  for ( uint8_t i = 0; i < 24; ++i )
+    sendBit(packet, level, !(i & 1));                 // 24 training bits (ramp will actually continue during the first 1-2)
+  for ( uint8_t i = 0; i < 8; ++i )
+    sendBit(packet, level, (0x7e >> i) & 1);          // HDLC start flag
+
+  const uint8_t *payload = packet.payload();
+  uint8_t numOnes = 0;
+  for ( uint8_t i = 0; i < packet.payloadLength(); ++i )
+    sendStuffedByte(packet, level, numOnes, payload[i]);
+  sendStuffedByte(packet, level, numOnes, fcs & 0x00ff);
+  sendStuffedByte(packet, level, numOnes, (fcs & 0xff00) >> 8);
+
+  for ( uint8_t i = 0; i < 8; ++i )
+    sendBit(packet, level, (0x7e >> i) & 1);          // HDLC stop flag
+  for ( uint8_t i = 0; i < 3; ++i )
+    sendBit(packet, level, 0);                        // Ramp down
 
   // The TXPacket is now populated with the sequence of bits that need to be sent
+  packet.pad();
 }
 
 #if 0
@@ -291,6 +259,10 @@ AISMessage18::AISMessage18()
   mType = 18;
 }
 
+// Coordinates in 1/10000 minutes
+static const int32_t MAX_LATITUDE   = 90 * 600000;
+static const int32_t MAX_LONGITUDE  = 180 * 600000;
+
 void AISMessage18::encode(const StationData &station, TXPacket &packet)
 {
   AISMessage::encode(station, packet);
@@ -314,19 +286,20 @@ void AISMessage18::encode(const StationData &station, TXPacket &packet)
   value = 0;
   addBits(payload, size, value, 8);   // Spare bits
 
-  value = (uint32_t)(sog * 10);
+  // 1022 means 102.2 knots or more
+  value = sog > 1022 ? 1022 : sog;
   addBits(payload, size, value, 10);  // Speed (knots x 10)
 
   value = 1;
   addBits(payload, size, value, 1);   // Position accuracy is high
 
-  value = Utils::coordinateToUINT32(longitude);
+  value = (uint32_t)longitude;
   addBits(payload, size, value, 28);  // Longitude
 
-  value = Utils::coordinateToUINT32(latitude);
+  value = (uint32_t)latitude;
   addBits(payload, size, value, 27);  // Latitude
 
-  value = (uint32_t)(cog * 10);
+  value = cog;
   addBits(payload, size, value, 12);  // COG
 
   value = 511;
@@ -370,6 +343,79 @@ void AISMessage18::encode(const StationData &station, TXPacket &packet)
 #endif
 
   finalize(payload, size, packet);
+
+  // Velocity for dead-reckoning, worked out here so extrapolate() has no trigonometry to do
+  TXFix &fix = packet.fix();
+  if ( utc && sog < 1023 && cog < 3600 && abs(latitude) <= MAX_LATITUDE && abs(longitude) <= MAX_LONGITUDE )
+    {
+      // A knot is a minute of latitude per hour, so 0.1 knots is 1/3.6 of 1/10000 minute per second
+      float speed = sog / 3.6f;
+      float course = cog * (float)M_PI / 1800.0f;
+      float meridian = max(cosf(latitude * (float)M_PI / (180.0f * 600000.0f)), 0.01f);
+
+      fix.utc = utc;
+      fix.lat = latitude;
+      fix.lng = longitude;
+      fix.north = speed * cosf(course);
+      fix.east = speed * sinf(course) / meridian;
+    }
+}
+
+static uint32_t getField(const uint8_t *bytes, uint16_t pos, uint8_t numBits)
+{
+  uint32_t value = 0;
+  for ( uint16_t i = pos; i < pos + numBits; ++i )
+    value = (value << 1) | ((bytes[i/8] >> (7 - i%8)) & 1);
+
+  return value;
+}
+
+static void setField(uint8_t *bytes, uint16_t pos, uint8_t numBits, uint32_t value)
+{
+  for ( uint16_t i = pos + numBits; i > pos; value >>= 1 )
+    {
+      --i;
+      if ( value & 1 )
+        bytes[i/8] |= 1 << (7 - i%8);
+      else
+        bytes[i/8] &= ~(1 << (7 - i%8));
+    }
+}
+
+void AISMessage18::extrapolate(TXPacket &packet, time_t utc, uint32_t age)
+{
+  TXFix &fix = packet.fix();
+  if ( !fix.utc || age > MAX_DEAD_RECKONING_TIME * 1000 )
+    return;
+
+  float t = age / 1000.0f;
+  int32_t lat = fix.lat + lroundf(fix.north * t);
+  int32_t lng = fix.lng + lroundf(fix.east * t);
+
+  lat = max(min(lat, MAX_LATITUDE), -MAX_LATITUDE);
+  if ( lng > MAX_LONGITUDE )
+    lng -= 2 * MAX_LONGITUDE;
+  else if ( lng < -MAX_LONGITUDE )
+    lng += 2 * MAX_LONGITUDE;
+
+  // Bit positions of the fields in the payload, as laid out by encode()
+  uint8_t *payload = packet.payload();
+  uint32_t lngField = (uint32_t)lng & 0x0fffffff;
+  uint32_t latField = (uint32_t)lat & 0x07ffffff;
+  uint32_t second = utc % 60;
+  if ( getField(payload, 57, 28) == lngField && getField(payload, 85, 27) == latField && getField(payload, 133, 6) == second )
+    return;
+
+  setField(payload, 57, 28, lngField);    // Longitude
+  setField(payload, 85, 27, latField);    // Latitude
+  setField(payload, 133, 6, second);      // UTC second
+
+  // CRC16::compute() may use the CRC unit, which is only for thread context
+  uint16_t crc = CRC16::INITIAL_VALUE;
+  for ( uint8_t i = 0; i < packet.payloadLength(); ++i )
+    crc = CRC16::update(crc, payload[i]);
+
+  frame(packet, ~crc);
 }
 
 #if 0
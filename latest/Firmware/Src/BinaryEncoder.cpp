@@ -0,0 +1,137 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "BinaryEncoder.hpp"
+#include "CRC16.hpp"
+#include "AISChannels.h"
+#include <cstring>
+
+
+static inline uint8_t *put16(uint8_t *p, uint16_t v)
+{
+  *p++ = v & 0xff;
+  *p++ = v >> 8;
+  return p;
+}
+
+static inline uint8_t *put32(uint8_t *p, uint32_t v)
+{
+  p = put16(p, v & 0xffff);
+  return put16(p, v >> 16);
+}
+
+uint16_t BinaryEncoder::encode(RXPacket &packet, uint8_t *buffer, uint16_t size)
+{
+  uint8_t record[6 + MAX_AIS_RX_PACKET_SIZE/8 + 2];
+
+  packet.discardCRC();
+
+  uint16_t numBits = packet.size();
+  uint8_t fillBits = (8 - numBits % 8) % 8;
+  if ( fillBits )
+    packet.addFillBits(fillBits);
+
+  uint8_t *p = record;
+  *p++ = RECORD_AIS;
+  *p++ = AIS_CHANNELS[packet.channel()].itu;
+  p = put16(p, packet.slot());
+  *p++ = packet.rssi();
+  *p++ = fillBits;
+
+  numBits = packet.size();
+  for ( uint16_t pos = 0; pos < numBits; pos += 8 )
+    *p++ = packet.bits(pos, 8);
+
+  return frame(record, p - record, buffer, size);
+}
+
+uint16_t BinaryEncoder::encode(const GPSFix &fix, uint8_t *buffer, uint16_t size)
+{
+  uint8_t record[17 + 2];
+
+  uint8_t *p = record;
+  *p++ = RECORD_GNSS;
+  p = put32(p, fix.utc);
+  p = put32(p, fix.lat);
+  p = put32(p, fix.lng);
+  p = put16(p, fix.speed);
+  p = put16(p, fix.cog);
+
+  return frame(record, p - record, buffer, size);
+}
+
+uint16_t BinaryEncoder::encode(const char *text, uint8_t *buffer, uint16_t size)
+{
+  return encode(text, strlen(text), buffer, size);
+}
+
+uint16_t BinaryEncoder::encode(const char *text, uint16_t length, uint8_t *buffer, uint16_t size)
+{
+  uint8_t record[BINARY_FRAME_BUFFER_SIZE];
+
+  if ( length > sizeof record - 3 )
+    return 0;
+
+  record[0] = RECORD_TEXT;
+  memcpy(record + 1, text, length);
+
+  return frame(record, length + 1, buffer, size);
+}
+
+/*
+ * The record buffer must have 2 bytes to spare for the CRC.
+ */
+uint16_t BinaryEncoder::frame(uint8_t *record, uint16_t length, uint8_t *buffer, uint16_t size)
+{
+  uint16_t crc = CRC16::compute(record, length);
+  put16(record + length, crc);
+  length += 2;
+
+  // COBS adds a byte for every 254 and we need one more for the delimiter
+  if ( length + length/254 + 2 > size )
+    return 0;
+
+  uint16_t codePos = 0;
+  uint16_t out = 1;
+  uint8_t code = 1;
+
+  for ( uint16_t i = 0; i < length; ++i )
+    {
+      if ( record[i] == 0 )
+        {
+          buffer[codePos] = code;
+          codePos = out++;
+          code = 1;
+          continue;
+        }
+
+      buffer[out++] = record[i];
+      if ( ++code == 0xff )
+        {
+          buffer[codePos] = code;
+          codePos = out++;
+          code = 1;
+        }
+    }
+
+  buffer[codePos] = code;
+  buffer[out++] = 0;
+
+  return out;
+}
@@ -0,0 +1,85 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "CivilTime.hpp"
+
+/*
+ * These are Howard Hinnant's algorithms (http://howardhinnant.github.io/date_algorithms.html).
+ * The calendar is split into 400 year eras of 146097 days, with years starting on March 1st
+ * so that the leap day falls at the very end.
+ */
+
+#define SECONDS_PER_DAY   86400
+
+int32_t CivilTime::daysFromCivil(int32_t year, uint32_t month, uint32_t day)
+{
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+void CivilTime::civilFromDays(int32_t days, int32_t &year, uint32_t &month, uint32_t &day)
+{
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t doe = days - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = (int32_t)yoe + era * 400 + (month <= 2);
+}
+
+time_t CivilTime::toUTC(int32_t year, uint32_t month, uint32_t day, uint32_t hour, uint32_t minute, uint32_t second)
+{
+  return (time_t)daysFromCivil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+}
+
+void CivilTime::fromUTC(time_t utc, struct tm &result)
+{
+  int32_t days = utc / SECONDS_PER_DAY;
+  int32_t seconds = utc % SECONDS_PER_DAY;
+  if ( seconds < 0 )
+    {
+      seconds += SECONDS_PER_DAY;
+      --days;
+    }
+
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays(days, year, month, day);
+
+  result.tm_sec = seconds % 60;
+  result.tm_min = (seconds / 60) % 60;
+  result.tm_hour = seconds / 3600;
+  result.tm_mday = day;
+  result.tm_mon = month - 1;
+  result.tm_year = year - 1900;
+
+  // 1970-01-01 was a Thursday
+  result.tm_wday = days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+  result.tm_yday = days - daysFromCivil(year, 1, 1);
+  result.tm_isdst = 0;
+}
@@ -28,6 +28,8 @@
 #include "bsp.hpp"
 #include "GPS.hpp"
 #include "RadioManager.hpp"
+#include "DataTerminal.hpp"
+#include "GNSSFilter.hpp"
 #include <stdlib.h>
 
 CommandProcessor &CommandProcessor::instance()
@@ -51,7 +53,7 @@ void CommandProcessor::processEvent(const Event &e)
   switch(e.type)
   {
   case COMMAND_EVENT:
-    processCommand(e.command.buffer);
+    processCommand(e.command->buffer);
     break;
   default:
     break;
@@ -133,6 +135,56 @@ void CommandProcessor::processCommand(const char *buff)
     {
       fireTestPacket();
     }
+  else if ( s.find("gnss filter") == 0 )
+    {
+      /*
+       * gnss filter                  reports the table
+       * gnss filter clear            passes everything
+       * gnss filter <ID>,<ratio>     ID is talker + sentence (e.g. GPGSV or --GSV), ratio 0 blocks, N passes 1 in N
+       */
+      string params = s.substr(11);
+      Utils::trim(params);
+      if ( params.empty() )
+        {
+          GNSSFilter::instance().report();
+          return;
+        }
+
+      if ( params == "clear" )
+        {
+          GNSSFilter::instance().clear();
+        }
+      else
+        {
+          vector<string> tokens;
+          Utils::tokenize(params, ',', tokens);
+          if ( tokens.size() != 2 )
+            return;
+
+          int ratio = Utils::toInt(tokens[1]);
+          if ( ratio < 0 || ratio > 255 || !GNSSFilter::instance().set(tokens[0].c_str(), ratio) )
+            return;
+        }
+
+      GNSSFilter::instance().save();
+    }
+  else if ( s.find("baud confirm") == 0 )
+    {
+      DataTerminal::instance().confirmBaudRate();
+    }
+  else if ( s.find("baud ") == 0 )
+    {
+      DataTerminal::instance().requestBaudRate(Utils::toInt(s.substr(5)));
+    }
+  else if ( s.find("output binary") == 0 )
+    {
+      // Not persisted, so a reboot always brings back NMEA
+      DataTerminal::instance().setOutputMode(OUTPUT_BINARY);
+    }
+  else if ( s.find("output nmea") == 0 )
+    {
+      DataTerminal::instance().setOutputMode(OUTPUT_NMEA);
+    }
   else if (s.find("reboot") == 0 )
     {
       bsp_reboot();
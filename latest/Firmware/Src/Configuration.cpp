@@ -72,7 +72,7 @@ void Configuration::reportStationData()
   if ( !e )
     return;
 
-  sprintf(e->nmeaBuffer.sentence,
+  sprintf(e->nmeaBuffer->sentence,
       "$PAISTN,%lu,%s,%s,%d,%d,%d,%d,%d*",
       d.mmsi,
       d.name,
@@ -82,12 +82,13 @@ void Configuration::reportStationData()
       d.beam,
       d.portOffset,
       d.bowOffset);
-  Utils::completeNMEA(e->nmeaBuffer.sentence);
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
   EventQueue::instance().push(e);
 }
 
 void Configuration::resetToDefaults()
 {
+  bsp_erase_config_data();
   if ( bsp_erase_station_data() )
     bsp_reboot();
 }
@@ -108,5 +109,25 @@ bool Configuration::readStationData(StationData &data)
   return bsp_read_station_data(data) && data.magic == STATION_DATA_MAGIC;
 }
 
+bool Configuration::writeConfigData(const ConfigData &data)
+{
+  return bsp_save_config_data(data);
+}
+
+bool Configuration::readConfigData(ConfigData &data)
+{
+  return bsp_read_config_data(data) && data.magic == CONFIG_DATA_MAGIC;
+}
+
+bool Configuration::writeGNSSFix(const GNSSFixData &data)
+{
+  return bsp_save_gnss_fix(data);
+}
+
+bool Configuration::readGNSSFix(GNSSFixData &data)
+{
+  return bsp_read_gnss_fix(data) && data.magic == GNSS_FIX_MAGIC;
+}
+
 
 
@@ -22,11 +22,21 @@
 #include "Events.hpp"
 #include "Utils.hpp"
 #include "bsp.hpp"
+#include "Stats.hpp"
+#include "Configuration.hpp"
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t BAUD_RATES[] = { 38400, 115200, 230400, 460800 };
+
+// How long to wait for output to drain at the old rate before switching
+#define BAUD_DRAIN_TIMEOUT    1000
 
 static char __rxbuff[80];
 static uint8_t __rxpos = 0;
 
 void termInputCB(char c);
+uint16_t termOutputCB(const char **data);
 
 DataTerminal &DataTerminal::instance()
 {
@@ -37,13 +47,33 @@ DataTerminal &DataTerminal::instance()
 void DataTerminal::init()
 {
   bsp_set_terminal_input_callback(termInputCB);
+  bsp_set_terminal_output_callback(termOutputCB);
+
+  ConfigData config;
+  if ( Configuration::instance().readConfigData(config) && config.terminalBaudRate != mBaudRate )
+    {
+      for ( uint32_t rate : BAUD_RATES )
+        {
+          if ( rate == config.terminalBaudRate )
+            {
+              mBaudRate = rate;
+              bsp_set_terminal_baud_rate(rate);
+            }
+        }
+    }
+
+  // Anything written before this point is still waiting
+  bsp_kick_terminal_output();
 }
 
 DataTerminal::DataTerminal()
-: mCmdBuffPos(0)
+: mTXHead(0), mTXTail(0), mTXInFlight(0), mMarkNext(false), mMarkPosition(-1), mMarkSent(false), mMarkCycles(0),
+  mOutputMode(OUTPUT_NMEA), mBaudState(BAUD_IDLE), mBaudRate(TERMINAL_BAUD_RATE), mPendingBaudRate(0),
+  mPreviousBaudRate(0), mBaudDeadline(0), mSeconds(0), mCmdBuffPos(0)
 {
+  memset(mShed, 0, sizeof mShed);
   mCmdTokens.reserve(5);
-  EventQueue::instance().addObserver(this, DEBUG_EVENT|PROPR_NMEA_SENTENCE);
+  EventQueue::instance().addObserver(this, DEBUG_EVENT|PROPR_NMEA_SENTENCE|CLOCK_EVENT|GPS_FIX_EVENT);
 }
 
 void DataTerminal::processEvent(const Event &e)
@@ -51,16 +81,31 @@ void DataTerminal::processEvent(const Event &e)
   switch (e.type) {
   case DEBUG_EVENT:
 #ifdef MULTIPLEXED_OUTPUT
-    write("DEBUG", e.debugMessage.buffer);
+    write("DEBUG", e.debugMessage->buffer, PRIORITY_PROPRIETARY);
 #endif
     break;
   case PROPR_NMEA_SENTENCE:
 #ifdef MULTIPLEXED_OUTPUT
-    write("NMEA", e.nmeaBuffer.sentence);
+    write("NMEA", e.nmeaBuffer->sentence, PRIORITY_PROPRIETARY);
 #else
-    write(e.nmeaBuffer.sentence);
+    write(e.nmeaBuffer->sentence, PRIORITY_PROPRIETARY);
 #endif
     break;
+  case CLOCK_EVENT:
+    if ( ++mSeconds % TERMINAL_SHED_REPORT_INTERVAL == 0 )
+      reportShedding();
+    break;
+  case GPS_FIX_EVENT:
+    {
+      // In NMEA mode, the GPS sentences themselves are passed through instead
+      if ( mOutputMode != OUTPUT_BINARY )
+        break;
+
+      uint16_t size = BinaryEncoder::encode(e.gpsFix, mFrame, sizeof mFrame);
+      if ( size )
+        writeFrame(mFrame, size, PRIORITY_GNSS);
+    }
+    break;
   default:
     break;
   }
@@ -68,34 +113,312 @@ void DataTerminal::processEvent(const Event &e)
 
 #ifdef MULTIPLEXED_OUTPUT
 
-void DataTerminal::write(const char *cls, const char* s)
+void DataTerminal::write(const char *cls, const char* s, OutputPriority priority)
 {
-  bsp_write_char('[');
-  bsp_write_string(cls);
-  bsp_write_char(']');
-  bsp_write_string(s);
+  write(cls, s, strlen(s), priority);
+}
+
+void DataTerminal::write(const char *cls, const char* s, uint16_t length, OutputPriority priority)
+{
+  if ( mOutputMode == OUTPUT_BINARY )
+    {
+      writeText(s, length, priority);
+      return;
+    }
+
+  const char *parts[] = { "[", cls, "]", s };
+  const uint16_t lengths[] = { 1, (uint16_t)strlen(cls), 1, length };
+  queue(parts, lengths, 4, priority);
 }
 
 #else
 
-void DataTerminal::write(const char* s)
+void DataTerminal::write(const char* s, OutputPriority priority)
+{
+  write(s, strlen(s), priority);
+}
+
+void DataTerminal::write(const char* s, uint16_t length, OutputPriority priority)
 {
-  bsp_write_string(s);
+  if ( mOutputMode == OUTPUT_BINARY )
+    {
+      writeText(s, length, priority);
+      return;
+    }
+
+  queue(&s, &length, 1, priority);
 }
 #endif
 
+void DataTerminal::writeText(const char *s, uint16_t length, OutputPriority priority)
+{
+  uint16_t size = BinaryEncoder::encode(s, length, mFrame, sizeof mFrame);
+  if ( size )
+    writeFrame(mFrame, size, priority);
+}
+
+void DataTerminal::writeFrame(const uint8_t *frame, uint16_t size, OutputPriority priority)
+{
+  const char *data = (const char*)frame;
+  queue(&data, &size, 1, priority);
+}
 
+void DataTerminal::writeMarked(const char *line, OutputPriority priority)
+{
+  mMarkPosition = -1;
+  mMarkSent = false;
+
+  mMarkNext = true;
+#ifdef MULTIPLEXED_OUTPUT
+  write("NMEA", line, priority);
+#else
+  write(line, priority);
+#endif
+  mMarkNext = false;
+}
+
+bool DataTerminal::markTime(uint32_t &cycles) const
+{
+  if ( !mMarkSent )
+    return false;
+
+  cycles = mMarkCycles;
+  return true;
+}
+
+void DataTerminal::setOutputMode(OutputMode mode)
+{
+  mOutputMode = mode;
+}
+
+OutputMode DataTerminal::outputMode() const
+{
+  return mOutputMode;
+}
+
+bool DataTerminal::requestBaudRate(uint32_t rate)
+{
+  bool supported = false;
+  for ( uint32_t r : BAUD_RATES )
+    supported |= r == rate;
+
+  if ( !supported || mBaudState != BAUD_IDLE )
+    {
+      reportBaudRate(rate, "REJECTED");
+      return false;
+    }
+
+  reportBaudRate(rate, "PENDING");
+  mPendingBaudRate = rate;
+  mBaudDeadline = bsp_get_uptime_ms() + BAUD_DRAIN_TIMEOUT;
+  mBaudState = BAUD_DRAINING;
+  return true;
+}
+
+void DataTerminal::confirmBaudRate()
+{
+  if ( mBaudState != BAUD_CONFIRMING )
+    return;
+
+  mBaudState = BAUD_IDLE;
+
+  ConfigData config;
+  if ( !Configuration::instance().readConfigData(config) )
+    {
+      memset(&config, 0, sizeof config);
+      config.magic = CONFIG_DATA_MAGIC;
+    }
+
+  config.terminalBaudRate = mBaudRate;
+  Configuration::instance().writeConfigData(config);
+  reportBaudRate(mBaudRate, "CONFIRMED");
+}
+
+void DataTerminal::poll()
+{
+  if ( mBaudState == BAUD_IDLE )
+    return;
+
+  // Wrap-safe, as long as deadlines are less than 24 days away
+  bool expired = (int32_t)(bsp_get_uptime_ms() - mBaudDeadline) >= 0;
+
+  if ( mBaudState == BAUD_DRAINING )
+    {
+      // The announcement has to go out at the old rate. Under heavy load the buffer may never empty, so there's a limit.
+      if ( !isOutputIdle() && !expired )
+        return;
+
+      mPreviousBaudRate = mBaudRate;
+      mBaudRate = mPendingBaudRate;
+      bsp_set_terminal_baud_rate(mBaudRate);
+      mBaudDeadline = bsp_get_uptime_ms() + TERMINAL_BAUD_CONFIRM_TIMEOUT;
+      mBaudState = BAUD_CONFIRMING;
+    }
+  else if ( expired )
+    {
+      // Nobody heard us at the new rate
+      mBaudRate = mPreviousBaudRate;
+      bsp_set_terminal_baud_rate(mBaudRate);
+      mBaudState = BAUD_IDLE;
+      reportBaudRate(mBaudRate, "REVERTED");
+    }
+}
+
+bool DataTerminal::isOutputIdle() const
+{
+  return mTXHead == mTXTail && mTXInFlight == 0;
+}
+
+void DataTerminal::reportBaudRate(uint32_t rate, const char *status)
+{
+  char buff[48];
+  sprintf(buff, "$PAIBAU,%lu,%s*", (unsigned long)rate, status);
+  Utils::completeNMEA(buff);
+#ifdef MULTIPLEXED_OUTPUT
+  write("NMEA", buff, PRIORITY_AIS);
+#else
+  write(buff, PRIORITY_AIS);
+#endif
+}
+
+bool DataTerminal::admit(OutputPriority priority, uint16_t queued)
+{
+  // Lower priorities never get the last quarter of the buffer, whatever the line rate
+  if ( priority != PRIORITY_AIS && queued >= TERMINAL_TX_BUFFER_SIZE * 3 / 4 )
+    return false;
+
+  // How long it will take for what's already queued to go out
+  uint32_t backlog = queued * 1000 / (mBaudRate / 10);
+
+  switch (priority)
+    {
+    case PRIORITY_GNSS:
+      if ( backlog >= TERMINAL_SHED_GNSS_MS )
+        return false;
+      if ( backlog >= TERMINAL_DECIMATE_GNSS_MS )
+        return mSeconds % TERMINAL_GNSS_DECIMATION == 0;
+      return true;
+    case PRIORITY_PROPRIETARY:
+      return backlog < TERMINAL_SHED_PROPR_MS;
+    default:
+      return true;
+    }
+}
+
+void DataTerminal::queue(const char **parts, const uint16_t *lengths, uint8_t count, OutputPriority priority)
+{
+  uint16_t total = 0;
+  for ( uint8_t i = 0; i < count; ++i )
+    total += lengths[i];
+
+  // The tail may only move forward while we're here, so this is conservative
+  uint16_t used = (mTXHead + TERMINAL_TX_BUFFER_SIZE - mTXTail) % TERMINAL_TX_BUFFER_SIZE;
+  if ( !admit(priority, used) )
+    {
+      ++mShed[priority];
+      return;
+    }
+
+  if ( used + total >= TERMINAL_TX_BUFFER_SIZE )
+    {
+      // Better to lose a whole line than to garble it
+      ++mShed[priority];
+      ++Stats::instance().terminalTXOverflows;
+      return;
+    }
+
+  uint16_t head = mTXHead;
+
+  // Before the head moves, so the output interrupt can't miss it
+  if ( mMarkNext )
+    mMarkPosition = head;
+
+  for ( uint8_t i = 0; i < count; ++i )
+    {
+      for ( uint16_t j = 0; j < lengths[i]; ++j )
+        {
+          mTXBuffer[head] = parts[i][j];
+          head = (head + 1) % TERMINAL_TX_BUFFER_SIZE;
+        }
+    }
+
+  mTXHead = head;
+
+  used += total;
+  if ( used > Stats::instance().terminalTXHighWater )
+    Stats::instance().terminalTXHighWater = used;
+
+  bsp_kick_terminal_output();
+}
+
+uint16_t DataTerminal::nextOutputChunk(const char **data)
+{
+  // Whatever was handed out last time has been sent by now
+  mTXTail = (mTXTail + mTXInFlight) % TERMINAL_TX_BUFFER_SIZE;
+
+  uint16_t head = mTXHead;
+  if ( head == mTXTail )
+    {
+      mTXInFlight = 0;
+      return 0;
+    }
+
+  // Only up to the end of the buffer, the rest will be the next chunk
+  mTXInFlight = head > mTXTail ? head - mTXTail : TERMINAL_TX_BUFFER_SIZE - mTXTail;
+  *data = &mTXBuffer[mTXTail];
+
+  int16_t mark = mMarkPosition;
+  if ( mark >= 0 )
+    {
+      uint16_t offset = (mark + TERMINAL_TX_BUFFER_SIZE - mTXTail) % TERMINAL_TX_BUFFER_SIZE;
+      if ( offset < mTXInFlight )
+        {
+          // Everything ahead of it in this chunk goes out first, at 10 bits per character
+          mMarkCycles = bsp_get_cycle_count() + offset * 10 * (bsp_get_system_clock() / mBaudRate);
+          mMarkSent = true;
+          mMarkPosition = -1;
+        }
+    }
+  return mTXInFlight;
+}
+
+
+
+void DataTerminal::reportShedding()
+{
+  if ( mShed[PRIORITY_AIS] == 0 && mShed[PRIORITY_GNSS] == 0 && mShed[PRIORITY_PROPRIETARY] == 0 )
+    return;
+
+  // Sentences dropped in each class since the last report
+  char buff[48];
+  sprintf(buff, "$PAISHD,%d,%d,%d,%d*", TERMINAL_SHED_REPORT_INTERVAL,
+      mShed[PRIORITY_AIS], mShed[PRIORITY_GNSS], mShed[PRIORITY_PROPRIETARY]);
+  Utils::completeNMEA(buff);
+  memset(mShed, 0, sizeof mShed);
+
+  // This is the one proprietary sentence that must not be shed itself
+#ifdef MULTIPLEXED_OUTPUT
+  write("NMEA", buff, PRIORITY_AIS);
+#else
+  write(buff, PRIORITY_AIS);
+#endif
+}
 
 void DataTerminal::_write(const char *s)
 {
 #ifdef MULTIPLEXED_OUTPUT
-  write("", s);
+  write("", s, PRIORITY_AIS);
 #else
-  write(s);
+  write(s, PRIORITY_AIS);
 #endif
 }
 
 
+uint16_t termOutputCB(const char **data)
+{
+  return DataTerminal::instance().nextOutputChunk(data);
+}
+
 void termInputCB(char c)
 {
   if ( c == '\r' )
@@ -112,8 +435,11 @@ void termInputCB(char c)
     {
       __rxbuff[__rxpos++] = 0;
       Event *e = EventPool::instance().newEvent(COMMAND_EVENT);
-      strlcpy(e->command.buffer, __rxbuff, sizeof e->command.buffer);
-      EventQueue::instance().push(e);
+      if ( e )
+        {
+          strlcpy(e->command->buffer, __rxbuff, sizeof e->command->buffer);
+          EventQueue::instance().push(e);
+        }
     }
 }
 
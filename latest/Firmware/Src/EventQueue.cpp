@@ -28,6 +28,8 @@
 #include "queue.h"
 #include "task.h"
 #include "bsp.hpp"
+#include "_assert.h"
+#include <cstring>
 
 
 EventQueue &EventQueue::instance()
@@ -37,8 +39,10 @@ EventQueue &EventQueue::instance()
 }
 
 EventQueue::EventQueue()
-  : mISRQueue(25), mTaskQueue(10)
 {
+  memset(mConsumers, 0, sizeof mConsumers);
+  memset(mSubscribers, 0, sizeof mSubscribers);
+  memset(mLaneStats, 0, sizeof mLaneStats);
 }
 
 void EventQueue::init()
@@ -47,6 +51,7 @@ void EventQueue::init()
 
 bool EventQueue::push(Event *e)
 {
+  e->queued = bsp_get_uptime_ms();
   if ( Utils::inISR() )
     {
       if ( !mISRQueue.push(e) )
@@ -69,46 +74,217 @@ bool EventQueue::push(Event *e)
 
 void EventQueue::addObserver(EventConsumer *c, uint32_t eventMask)
 {
-  mConsumers[c] = eventMask;
+  removeObserver(c);
+
+  uint8_t slot = 0;
+  while ( slot < MAX_CONSUMERS && mConsumers[slot] )
+    ++slot;
+
+  ASSERT(slot < MAX_CONSUMERS);
+  if ( slot == MAX_CONSUMERS )
+    return;
+
+  mConsumers[slot] = c;
+  for ( uint8_t type = 0; type < 32; ++type )
+    {
+      if ( eventMask & (1u << type) )
+        mSubscribers[type] |= 1 << slot;
+    }
 }
 
 void EventQueue::removeObserver(EventConsumer *c)
 {
-  map<EventConsumer*, uint32_t>::iterator i = mConsumers.find(c);
-  if ( i == mConsumers.end() )
+  for ( uint8_t slot = 0; slot < MAX_CONSUMERS; ++slot )
+    {
+      if ( mConsumers[slot] != c )
+        continue;
+
+      mConsumers[slot] = nullptr;
+      for ( uint8_t type = 0; type < 32; ++type )
+        mSubscribers[type] &= ~(1 << slot);
+    }
+}
+
+void EventQueue::deliver(const Event &e)
+{
+  // Every event type is a single bit
+  if ( e.type == UNKNOWN_EVENT )
     return;
 
-  mConsumers.erase(i);
+  uint32_t subscribers = mSubscribers[__builtin_ctz(e.type)];
+  while ( subscribers )
+    {
+      uint8_t slot = __builtin_ctz(subscribers);
+      subscribers &= subscribers - 1;
+      mConsumers[slot]->processEvent(e);
+    }
 }
 
-void EventQueue::dispatch()
+EventLane EventQueue::laneOf(EventType type)
+{
+  switch(type)
+    {
+    case CLOCK_EVENT:
+    case GPS_FIX_EVENT:
+    case INTERROGATION_EVENT:
+      return LANE_TIMING;
+    case AIS_PACKET_EVENT:
+    case GPS_NMEA_SENTENCE:
+    case RSSI_SAMPLE_EVENT:
+      return LANE_RX;
+    default:
+      return LANE_IO;
+    }
+}
+
+const char *EventQueue::laneName(EventLane lane)
+{
+  switch(lane)
+    {
+    case LANE_TIMING:
+      return "TIMING";
+    case LANE_RX:
+      return "RX";
+    default:
+      return "IO";
+    }
+}
+
+uint32_t EventQueue::laneBudget(EventLane lane)
+{
+  switch(lane)
+    {
+    case LANE_TIMING:
+      return EVENT_LANE_BUDGET_TIMING;
+    case LANE_RX:
+      return EVENT_LANE_BUDGET_RX;
+    default:
+      return EVENT_LANE_BUDGET_IO;
+    }
+}
+
+EventLaneStats EventQueue::takeLaneStats(EventLane lane)
 {
+  EventLaneStats result = mLaneStats[lane];
+  memset(&mLaneStats[lane], 0, sizeof result);
+  return result;
+}
+
+bool EventQueue::sortIntoLane(Event *e)
+{
+  switch(laneOf(e->type))
+    {
+    case LANE_TIMING:
+      return mTimingLane.push(e);
+    case LANE_RX:
+      return mRXLane.push(e);
+    default:
+      return mIOLane.push(e);
+    }
+}
+
+void EventQueue::sortIntoLanes()
+{
+  // An event that didn't fit its lane is retried first, and holds back its queue until it does
+  if ( mStalledISREvent && sortIntoLane(mStalledISREvent) )
+    mStalledISREvent = nullptr;
+
   Event *e = nullptr;
+  while ( !mStalledISREvent && mISRQueue.pop(e) )
+    {
+      if ( !sortIntoLane(e) )
+        mStalledISREvent = e;
+    }
+
+  if ( mStalledTaskEvent && sortIntoLane(mStalledTaskEvent) )
+    mStalledTaskEvent = nullptr;
 
-  while (mISRQueue.pop(e))
+  while ( !mStalledTaskEvent && mTaskQueue.pop(e) )
     {
-      for ( map<EventConsumer*, uint32_t>::iterator c = mConsumers.begin(); c != mConsumers.end(); ++c )
+      if ( !sortIntoLane(e) )
+        mStalledTaskEvent = e;
+    }
+}
+
+/*
+ * Among the lanes whose oldest event has exceeded the lane's budget, returns the one that has waited the longest
+ * in proportion to its budget, so a lower lane can't be starved by a busy higher one. Failing that, the highest
+ * priority lane that isn't empty. Returns -1 if all lanes are empty.
+ */
+int EventQueue::nextLane()
+{
+  Event *heads[EVENT_LANES] = { nullptr, nullptr, nullptr };
+  mTimingLane.peek(heads[LANE_TIMING]);
+  mRXLane.peek(heads[LANE_RX]);
+  mIOLane.peek(heads[LANE_IO]);
+
+  uint16_t now = bsp_get_uptime_ms();
+  int overdue = -1;
+  uint32_t overdueWait = 0, overdueBudget = 1;
+  for ( int lane = 0; lane < EVENT_LANES; ++lane )
+    {
+      if ( !heads[lane] )
+        continue;
+
+      uint32_t wait = (uint16_t)(now - heads[lane]->queued);
+      uint32_t budget = laneBudget((EventLane)lane);
+
+      // wait/budget > overdueWait/overdueBudget without dividing. Ties go to the higher priority lane.
+      if ( wait > budget && wait * overdueBudget > overdueWait * budget )
         {
-          if ( c->second & e->type )
-            {
-              c->first->processEvent(*e);
-            }
+          overdue = lane;
+          overdueWait = wait;
+          overdueBudget = budget;
         }
+    }
 
-      EventPool::instance().deleteEvent(e);
+  if ( overdue >= 0 )
+    return overdue;
+
+  for ( int lane = 0; lane < EVENT_LANES; ++lane )
+    {
+      if ( heads[lane] )
+        return lane;
     }
 
-  while (mTaskQueue.pop(e))
+  return -1;
+}
+
+void EventQueue::dispatch()
+{
+  // Lanes are picked again after every event, so a clock tick gets ahead of what remains of an RX burst
+  while ( true )
     {
-      for ( map<EventConsumer*, uint32_t>::iterator c = mConsumers.begin(); c != mConsumers.end(); ++c )
+      sortIntoLanes();
+
+      int lane = nextLane();
+      if ( lane < 0 )
+        break;
+
+      Event *e = nullptr;
+      switch(lane)
         {
-          if ( c->second & e->type )
-            {
-              c->first->processEvent(*e);
-            }
+        case LANE_TIMING:
+          mTimingLane.pop(e);
+          break;
+        case LANE_RX:
+          mRXLane.pop(e);
+          break;
+        default:
+          mIOLane.pop(e);
+          break;
         }
 
+      // Stamps are 16 bits wide, so waits beyond 65 seconds alias. Nothing should wait that long.
+      uint32_t latency = (uint16_t)((uint16_t)bsp_get_uptime_ms() - e->queued);
+      EventLaneStats &stats = mLaneStats[lane];
+      ++stats.events;
+      if ( latency > stats.maxLatency )
+        stats.maxLatency = latency;
+      if ( latency > laneBudget((EventLane)lane) )
+        ++stats.overBudget;
+
+      deliver(*e);
       EventPool::instance().deleteEvent(e);
     }
 }
-
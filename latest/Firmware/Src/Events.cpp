@@ -20,6 +20,8 @@
 
 #include "Events.hpp"
 #include "printf_serial.h"
+#include "Utils.hpp"
+#include "GNSSInput.hpp"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -29,7 +31,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 Event::Event()
-  : type(UNKNOWN_EVENT), flags(0), rxPacket(nullptr)
+  : type(UNKNOWN_EVENT), flags(0), queued(0), rxPacket(nullptr), text(nullptr)
 {
 }
 
@@ -43,6 +45,17 @@ void Event::reset()
 
   rxPacket = nullptr;
 
+  if ( text )
+    EventPool::instance().releaseText(text);
+
+  text = nullptr;
+
+#if GNSS_RX_DMA
+  // GNSS sentences hold on to the part of the DMA buffer they're in
+  if ( type == GPS_NMEA_SENTENCE )
+    GNSSInput::instance().release(gnssSlice);
+#endif
+
   type = UNKNOWN_EVENT;
 }
 
@@ -59,8 +72,16 @@ EventPool &EventPool::instance()
 }
 
 
+#if defined(__arm__)
+static_assert(sizeof(ObjectPool<Event, ISR_EVENT_POOL_SIZE>) + sizeof(ObjectPool<Event, THREAD_EVENT_POOL_SIZE>)
+    <= EVENT_POOL_RAM_BUDGET,
+    "The event pools exceed EVENT_POOL_RAM_BUDGET");
+#endif
+static_assert(sizeof(ObjectPool<TextBuffer, TEXT_POOL_SIZE>) <= TEXT_POOL_RAM_BUDGET,
+    "The text pool exceeds TEXT_POOL_RAM_BUDGET");
+
 EventPool::EventPool()
-  : mISRPool(25), mThreadPool(10), mRXPool(20)
+  : mISRPool("EVISR"), mThreadPool("EVTHR"), mTextPool("TEXT"), mRXPool("RXPKT")
 {
 
 }
@@ -101,9 +122,49 @@ Event *EventPool::newEvent(EventType type)
     return result;
 
   ASSERT_VALID_PTR(result);
+  if ( carriesText(type) )
+    {
+      result->text = mTextPool.get();
+      if ( !result->text )
+        {
+          deleteEvent(result);
+          return nullptr;
+        }
+
+      switch (type)
+      {
+      case DEBUG_EVENT:
+        result->debugMessage = &result->text->debugMessage;
+        break;
+      case COMMAND_EVENT:
+        result->command = &result->text->debugMessage;
+        break;
+      default:
+        result->nmeaBuffer = &result->text->nmeaBuffer;
+        break;
+      }
+    }
+
   return result;
 }
 
+bool EventPool::carriesText(EventType type)
+{
+  switch (type)
+  {
+  case PROPR_NMEA_SENTENCE:
+  case DEBUG_EVENT:
+  case COMMAND_EVENT:
+    return true;
+#if !GNSS_RX_DMA
+  case GPS_NMEA_SENTENCE:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
 void EventPool::deleteEvent(Event *event)
 {
   ASSERT_VALID_PTR(event);
@@ -137,3 +198,9 @@ void EventPool::releaseRXPacket(RXPacket *packet)
   mRXPool.put(packet);
 }
 
+void EventPool::releaseText(TextBuffer *text)
+{
+  ASSERT_VALID_PTR(text);
+  mTextPool.put(text);
+}
+
@@ -0,0 +1,230 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "GNSSConfigurator.hpp"
+#include "Utils.hpp"
+#include "config.h"
+#include <cstring>
+#include <stdio.h>
+
+
+#if GNSS_FIX_INTERVAL < 1000 && GNSS_BAUD_RATE <= GNSS_DEFAULT_BAUD_RATE
+#error "A fix interval under 1 second needs a faster GNSS UART"
+#endif
+
+// The rest of the PMTK314 fields are reserved, or sentences we never want
+#define PMTK314_TRAILER     ",0,0,0,0,0,0,0,0,0,0,0,0,0*"
+
+// Acknowledgement flags
+#define PMTK_ACK_FAILED     2
+#define PMTK_ACK_SUCCESS    3
+
+// Anything dispatched sooner than this after a baud rate change was received at the old rate
+#define BAUD_SETTLE_TIME    100
+
+
+GNSSConfigurator::GNSSConfigurator(GNSSConfiguratorDelegate *delegate)
+: mDelegate(delegate), mState(STATE_IDLE), mStep(0), mCompleted(0), mAttempts(0),
+  mBaudRate(GNSS_DEFAULT_BAUD_RATE), mPreviousBaudRate(GNSS_DEFAULT_BAUD_RATE), mSwitchTime(0), mDeadline(0)
+{
+}
+
+void GNSSConfigurator::start(uint32_t now)
+{
+  mStep = 0;
+  mCompleted = 0;
+  mAttempts = 0;
+
+  // Nothing goes out until we know the receiver is up and what rate it's at
+  setBaudRate(GNSS_DEFAULT_BAUD_RATE);
+  mState = STATE_PROBING;
+  mDeadline = now + GNSS_PROBE_TIMEOUT;
+}
+
+void GNSSConfigurator::stop()
+{
+  mState = STATE_IDLE;
+}
+
+bool GNSSConfigurator::busy() const
+{
+  return mState != STATE_IDLE;
+}
+
+uint32_t GNSSConfigurator::baudRate() const
+{
+  return mBaudRate;
+}
+
+uint8_t GNSSConfigurator::completedSteps() const
+{
+  return mCompleted;
+}
+
+void GNSSConfigurator::poll(uint32_t now)
+{
+  // Wrap-safe, as long as deadlines are less than 24 days away
+  if ( mState == STATE_IDLE || (int32_t)(now - mDeadline) < 0 )
+    return;
+
+  switch (mState)
+    {
+    case STATE_PROBING:
+      probeFailed(now);
+      break;
+    case STATE_VERIFYING_BAUD:
+      // The receiver either didn't switch or we can't hear it at the new rate, so go back to where it was
+      setBaudRate(mPreviousBaudRate);
+      if ( mAttempts < GNSS_CONFIG_RETRIES )
+        sendCommand(now);
+      else
+        finishStep(false, now);
+      break;
+    case STATE_AWAITING_ACK:
+      if ( mAttempts < GNSS_CONFIG_RETRIES )
+        sendCommand(now);
+      else
+        finishStep(false, now);
+      break;
+    default:
+      break;
+    }
+}
+
+void GNSSConfigurator::onSentence(const NMEASentence &sentence, uint32_t now)
+{
+  switch (mState)
+    {
+    case STATE_PROBING:
+      // The receiver may have kept the rate we want from before, as long as it had backup power
+      if ( mBaudRate == GNSS_BAUD_RATE )
+        mCompleted |= STEP_BAUD_RATE;
+      nextStep(now);
+      break;
+    case STATE_VERIFYING_BAUD:
+      // There's no acknowledgement for a baud rate change, but anything intelligible will do
+      if ( now - mSwitchTime >= BAUD_SETTLE_TIME )
+        finishStep(true, now);
+      break;
+    case STATE_AWAITING_ACK:
+      {
+        // $PMTK001,<command>,<flag>
+        if ( sentence.fieldLength(0) != 7 || strncmp(sentence.field(0), "PMTK001", 7) != 0 || sentence.numFields() < 3 )
+          return;
+
+        int32_t command = sentence.digits(1, 0, 3);
+        if ( (mStep == STEP_SENTENCES && command != 314) || (mStep == STEP_FIX_INTERVAL && command != 220) )
+          return;
+
+        int32_t flag = sentence.digits(2, 0, 1);
+        if ( flag == PMTK_ACK_SUCCESS )
+          finishStep(true, now);
+        else if ( flag == PMTK_ACK_FAILED && mAttempts < GNSS_CONFIG_RETRIES )
+          sendCommand(now);
+        else
+          // Invalid or unsupported, no point in trying again
+          finishStep(false, now);
+        break;
+      }
+    default:
+      break;
+    }
+}
+
+void GNSSConfigurator::probeFailed(uint32_t now)
+{
+  if ( ++mAttempts >= GNSS_CONFIG_RETRIES )
+    {
+      // Leave it for whoever powers the receiver on next time
+      setBaudRate(GNSS_DEFAULT_BAUD_RATE);
+      mState = STATE_IDLE;
+      return;
+    }
+
+  // Try the other rate it could be at
+  setBaudRate(mBaudRate == GNSS_DEFAULT_BAUD_RATE ? GNSS_BAUD_RATE : GNSS_DEFAULT_BAUD_RATE);
+  mDeadline = now + GNSS_PROBE_TIMEOUT;
+}
+
+void GNSSConfigurator::nextStep(uint32_t now)
+{
+  mStep = mStep ? mStep << 1 : STEP_BAUD_RATE;
+  if ( mStep == STEP_BAUD_RATE && mBaudRate == GNSS_BAUD_RATE )
+    mStep <<= 1;
+
+  if ( mStep > STEP_FIX_INTERVAL )
+    {
+      mState = STATE_IDLE;
+      return;
+    }
+
+  mAttempts = 0;
+  sendCommand(now);
+}
+
+void GNSSConfigurator::sendCommand(uint32_t now)
+{
+  char buff[80];
+
+  ++mAttempts;
+  switch (mStep)
+    {
+    case STEP_BAUD_RATE:
+      sprintf(buff, "$PMTK251,%lu*", (unsigned long)GNSS_BAUD_RATE);
+      break;
+    case STEP_SENTENCES:
+      strcpy(buff, "$PMTK314," GNSS_SENTENCES PMTK314_TRAILER);
+      break;
+    case STEP_FIX_INTERVAL:
+      // Whatever it was left at, a faster rate than 1 Hz is only safe if the baud rate change went through
+      sprintf(buff, "$PMTK220,%u*", mBaudRate == GNSS_BAUD_RATE ? GNSS_FIX_INTERVAL : 1000);
+      break;
+    }
+
+  Utils::completeNMEA(buff);
+  mDelegate->sendGNSSCommand(buff);
+
+  if ( mStep == STEP_BAUD_RATE )
+    {
+      mPreviousBaudRate = mBaudRate;
+      setBaudRate(GNSS_BAUD_RATE);
+      mSwitchTime = now;
+      mState = STATE_VERIFYING_BAUD;
+      mDeadline = now + GNSS_PROBE_TIMEOUT;
+    }
+  else
+    {
+      mState = STATE_AWAITING_ACK;
+      mDeadline = now + GNSS_ACK_TIMEOUT;
+    }
+}
+
+void GNSSConfigurator::finishStep(bool success, uint32_t now)
+{
+  if ( success )
+    mCompleted |= mStep;
+
+  nextStep(now);
+}
+
+void GNSSConfigurator::setBaudRate(uint32_t rate)
+{
+  mBaudRate = rate;
+  mDelegate->setGNSSBaudRate(rate);
+}
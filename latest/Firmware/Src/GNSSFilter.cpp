@@ -0,0 +1,177 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "GNSSFilter.hpp"
+#include "Configuration.hpp"
+#include "EventQueue.hpp"
+#include "Utils.hpp"
+#include "config.h"
+#include <cstring>
+#include <ctype.h>
+#include <stdio.h>
+
+
+GNSSFilter &GNSSFilter::instance()
+{
+  static GNSSFilter __instance;
+  return __instance;
+}
+
+GNSSFilter::GNSSFilter()
+: mActive(mTables[0])
+{
+  memset(mTables, 0, sizeof mTables);
+  memset(mCounts, 0, sizeof mCounts);
+}
+
+void GNSSFilter::init()
+{
+  ConfigData config;
+  if ( !Configuration::instance().readConfigData(config) )
+    return;
+
+  GNSSFilterEntry *table = spare();
+  memcpy(table, config.gnssFilter, sizeof config.gnssFilter);
+  publish(table);
+}
+
+bool GNSSFilter::set(const char *id, uint8_t ratio)
+{
+  if ( strlen(id) != sizeof(GNSSFilterEntry::id) )
+    return false;
+
+  for ( const char *c = id; *c; ++c )
+    {
+      if ( !isalnum(*c) && *c != '-' )
+        return false;
+    }
+
+  GNSSFilterEntry *table = spare();
+  memcpy(table, mActive, sizeof mTables[0]);
+
+  uint8_t i = 0;
+  while ( i < GNSS_FILTER_SIZE && table[i].id[0] && memcmp(table[i].id, id, sizeof table[i].id) )
+    ++i;
+
+  if ( i == GNSS_FILTER_SIZE )
+    return false;
+
+  memcpy(table[i].id, id, sizeof table[i].id);
+  table[i].ratio = ratio;
+  publish(table);
+
+  return true;
+}
+
+void GNSSFilter::clear()
+{
+  GNSSFilterEntry *table = spare();
+  memset(table, 0, sizeof mTables[0]);
+  publish(table);
+}
+
+void GNSSFilter::save()
+{
+  ConfigData config;
+  if ( !Configuration::instance().readConfigData(config) )
+    {
+      memset(&config, 0, sizeof config);
+      config.magic = CONFIG_DATA_MAGIC;
+      config.terminalBaudRate = TERMINAL_BAUD_RATE;
+    }
+
+  memcpy(config.gnssFilter, mActive, sizeof config.gnssFilter);
+  Configuration::instance().writeConfigData(config);
+  report();
+}
+
+void GNSSFilter::report()
+{
+  Event *e = EventPool::instance().newEvent(PROPR_NMEA_SENTENCE);
+  if ( !e )
+    return;
+
+  const GNSSFilterEntry *table = mActive;
+  char *p = e->nmeaBuffer->sentence;
+  p += sprintf(p, "$PAIGFL");
+  for ( uint8_t i = 0; i < GNSS_FILTER_SIZE && table[i].id[0]; ++i )
+    p += sprintf(p, ",%.5s,%d", table[i].id, table[i].ratio);
+  strcpy(p, "*");
+
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
+  EventQueue::instance().push(e);
+}
+
+int8_t GNSSFilter::match(const GNSSFilterEntry *table, const char *sentence, uint8_t length) const
+{
+  // The '$' and a whole ID
+  if ( length < sizeof table[0].id + 1 || sentence[0] != '$' )
+    return -1;
+
+  for ( uint8_t i = 0; i < GNSS_FILTER_SIZE && table[i].id[0]; ++i )
+    {
+      uint8_t j = 0;
+      for ( ; j < sizeof table[i].id; ++j )
+        {
+          if ( table[i].id[j] != '-' && table[i].id[j] != sentence[j + 1] )
+            break;
+        }
+
+      if ( j == sizeof table[i].id )
+        return i;
+    }
+
+  return -1;
+}
+
+bool GNSSFilter::isBlocked(const char *sentence, uint8_t length) const
+{
+  const GNSSFilterEntry *table = mActive;
+  int8_t i = match(table, sentence, length);
+  return i >= 0 && table[i].ratio == 0;
+}
+
+bool GNSSFilter::pass(const char *sentence, uint8_t length)
+{
+  const GNSSFilterEntry *table = mActive;
+  int8_t i = match(table, sentence, length);
+  if ( i < 0 )
+    return true;
+
+  if ( table[i].ratio == 0 )
+    return false;
+
+  // The first of every N passes
+  bool result = mCounts[i] == 0;
+  if ( ++mCounts[i] >= table[i].ratio )
+    mCounts[i] = 0;
+
+  return result;
+}
+
+GNSSFilterEntry *GNSSFilter::spare()
+{
+  return mActive == mTables[0] ? mTables[1] : mTables[0];
+}
+
+void GNSSFilter::publish(GNSSFilterEntry *table)
+{
+  mActive = table;
+  memset(mCounts, 0, sizeof mCounts);
+}
@@ -0,0 +1,135 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include "GNSSInput.hpp"
+#include "bsp.hpp"
+#include "stm32l4xx.h"
+#include <cstring>
+
+#if GNSS_RX_DMA
+
+#define SEGMENT_SIZE    (GNSS_RX_BUFFER_SIZE / GNSS_RX_SEGMENTS)
+
+static_assert((GNSS_RX_BUFFER_SIZE & (GNSS_RX_BUFFER_SIZE - 1)) == 0, "GNSS_RX_BUFFER_SIZE must be a power of 2");
+static_assert(SEGMENT_SIZE >= GNSS_MAX_LINE_LENGTH, "GNSS input segments are too small");
+
+void gnssRXCB(uint32_t position);
+
+
+GNSSInput &GNSSInput::instance()
+{
+  static GNSSInput __instance;
+  return __instance;
+}
+
+GNSSInput::GNSSInput()
+: mScanned(0), mLineStart(0), mPaused(false), mCallback(nullptr)
+{
+  memset((void*)mReferences, 0, sizeof mReferences);
+}
+
+void GNSSInput::init(gnss_line_callback cb)
+{
+  mCallback = cb;
+  bsp_start_gnss_rx(mBuffer, GNSS_RX_BUFFER_SIZE, gnssRXCB);
+}
+
+void GNSSInput::onReceive(uint32_t position)
+{
+  for ( ; mScanned != position; ++mScanned )
+    {
+      if ( mBuffer[mScanned % GNSS_RX_BUFFER_SIZE] != '\n' )
+        continue;
+
+      uint32_t length = mScanned + 1 - mLineStart;
+      uint16_t offset = mLineStart % GNSS_RX_BUFFER_SIZE;
+      mLineStart = mScanned + 1;
+
+      if ( length > GNSS_MAX_LINE_LENGTH )
+        continue;
+
+      if ( offset + length > GNSS_RX_BUFFER_SIZE )
+        {
+          // Nothing can still be using the last copy, as the DMA went through the first segment since
+          memcpy(mBuffer + GNSS_RX_BUFFER_SIZE, mBuffer, offset + length - GNSS_RX_BUFFER_SIZE);
+        }
+
+      GNSSSlice slice = { mBuffer + offset, (uint8_t)length };
+      reference(slice, 1);
+      if ( !mCallback || !mCallback(slice) )
+        reference(slice, -1);
+    }
+
+  /*
+   * Between calls, the DMA advances half the buffer at most, so this is the last chance to
+   * stop it before it gets to anything still referenced. Lines that just ended are behind it.
+   */
+  if ( !mPaused && !isClearAhead(position) )
+    {
+      mPaused = true;
+      bsp_set_gnss_rx_paused(true);
+    }
+}
+
+void GNSSInput::release(const GNSSSlice &slice)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  reference(slice, -1);
+  if ( mPaused && isClearAhead(bsp_get_gnss_rx_position()) )
+    {
+      mPaused = false;
+      bsp_set_gnss_rx_paused(false);
+    }
+
+  __set_PRIMASK(primask);
+}
+
+void GNSSInput::reference(const GNSSSlice &slice, int8_t delta)
+{
+  // The copy past the end stands in for the beginning of the buffer
+  uint16_t offset = slice.data - mBuffer;
+  uint8_t first = offset / SEGMENT_SIZE;
+  uint8_t last = ((offset + slice.length - 1) % GNSS_RX_BUFFER_SIZE) / SEGMENT_SIZE;
+
+  mReferences[first] += delta;
+  if ( last != first )
+    mReferences[last] += delta;
+}
+
+bool GNSSInput::isClearAhead(uint32_t position) const
+{
+  // The segment being written to may also hold recent lines, so it doesn't count
+  uint8_t current = (position % GNSS_RX_BUFFER_SIZE) / SEGMENT_SIZE;
+  for ( uint8_t i = 1; i <= GNSS_RX_SEGMENTS / 2; ++i )
+    {
+      if ( mReferences[(current + i) % GNSS_RX_SEGMENTS] )
+        return false;
+    }
+
+  return true;
+}
+
+void gnssRXCB(uint32_t position)
+{
+  GNSSInput::instance().onReceive(position);
+}
+
+#endif
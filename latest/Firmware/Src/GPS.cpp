@@ -23,13 +23,23 @@
 #include "config.h"
 #include "NMEASentence.hpp"
 #include "Utils.hpp"
+#include "printf_serial.h"
 #include "EventQueue.hpp"
 #include "bsp.hpp"
+#include "GNSSFilter.hpp"
+#include "GNSSInput.hpp"
+#include "CivilTime.hpp"
+#include "Configuration.hpp"
+#include "WarmState.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 
 
+#if GNSS_RX_DMA
+bool gnssLineCB(const GNSSSlice &slice);
+#else
 void gnssInputCB(char c);
+#endif
 void gnss1PPSCB();
 void gnssSOTDMACB();
 
@@ -41,11 +51,16 @@ GPS::instance()
 }
 
 GPS::GPS()
-: mBuffPos(0), mUTC(0), mLat(0), mLng(0), mStarted(false), mSlotNumber(0), mDelegate(NULL), mCOG(511), mSpeed(0)
+: mUTC(0), mSecond(0), mLat(0), mLng(0), mStarted(false), mSlotNumber(0), mDelegate(NULL), mCOG(3600), mSpeed(0),
+  mConfigurator(this), mSlotClock(bsp_get_system_clock()), mClockState(SLOT_CLOCK_STOPPED), mClockReportTime(0),
+  mEnableTime(0), mFixUTC(0), mFixSaveTime(0), mFixSaved(false), mAidingPending(false), mAided(false),
+  mPPSUptime(0), mPPSCycles(0), mResumeUTC(0), mResumeOffset(0), mResumed(false)
 {
+#if !GNSS_RX_DMA
+  mBuffPos = 0;
+#endif
   memset(&mTime, 0, sizeof(mTime));
-  mPeriod = (bsp_get_system_clock() / 37.5) - 1;
-  EventQueue::instance().addObserver(this, GPS_NMEA_SENTENCE);
+  EventQueue::instance().addObserver(this, GPS_NMEA_SENTENCE | CLOCK_EVENT);
 }
 
 GPS::~GPS()
@@ -60,6 +75,7 @@ time_t GPS::UTC()
 
 struct tm &GPS::time()
 {
+  CivilTime::fromUTC(mUTC, mTime);
   return mTime;
 }
 
@@ -68,12 +84,12 @@ uint32_t GPS::aisSlot()
   return mSlotNumber;
 }
 
-double GPS::lat()
+int32_t GPS::lat()
 {
   return mLat;
 }
 
-double GPS::lng()
+int32_t GPS::lng()
 {
   return mLng;
 }
@@ -85,22 +101,75 @@ void GPS::setDelegate(GPSDelegate *delegate)
 
 void GPS::init()
 {
+  GNSSFilter::instance().init();
+#if GNSS_RX_DMA
+  GNSSInput::instance().init(gnssLineCB);
+#else
   bsp_set_gnss_input_callback(gnssInputCB);
+#endif
   bsp_set_gnss_1pps_callback(gnss1PPSCB);
   bsp_set_gnss_sotdma_timer_callback(gnssSOTDMACB);
+
+  const WarmStateData *state = WarmState::instance().restored();
+  if ( state )
+    {
+      mSlotClock.setFrequency(state->slotClockFrequency);
+
+      // We can only tell how much time went by if we caused the reset, and not long after a PPS
+      uint32_t rebootUptime = bsp_get_reboot_uptime();
+      if ( state->utc && rebootUptime >= state->ppsUptime && rebootUptime - state->ppsUptime < 2000 )
+        {
+          mResumeUTC = state->utc;
+          mResumeOffset = rebootUptime - state->ppsUptime;
+        }
+    }
 }
 
 void GPS::enable()
 {
   bsp_gnss_on();
+  mEnableTime = bsp_get_uptime_ms();
+  mFixUTC = 0;
+  mFixSaved = false;
+  mAided = false;
+#if GNSS_AIDING
+  mAidingPending = bsp_gnss_can_transmit();
+#endif
+#if GNSS_CONFIGURE
+  if ( bsp_gnss_can_transmit() )
+    mConfigurator.start(bsp_get_uptime_ms());
+#endif
 }
 
 void GPS::disable()
 {
+  mConfigurator.stop();
+  mAidingPending = false;
+  mFixUTC = 0;
   bsp_gnss_off();
   bsp_signal_gps_status(false);
 }
 
+#if GNSS_RX_DMA
+bool GPS::onLine(const GNSSSlice &slice)
+{
+  // This code is called in interrupt mode, do as little as possible!
+
+  // Nothing we need ourselves, and it's not going out either, so don't bother dispatching it
+  if ( !isRMC(slice.data, slice.length) && !isPMTKAck(slice.data, slice.length)
+       && GNSSFilter::instance().isBlocked(slice.data, slice.length) )
+    return false;
+
+  Event *e = EventPool::instance().newEvent(GPS_NMEA_SENTENCE);
+  if ( !e )
+    return false;
+
+  // From here on the event holds the reference, and releases it even if it can't be queued
+  e->gnssSlice = slice;
+  EventQueue::instance().push(e);
+  return true;
+}
+#else
 void GPS::onRX(char c)
 {
   // This code is called in interrupt mode, do as little as possible!
@@ -115,57 +184,83 @@ void GPS::onRX(char c)
   else if (c == '\n')
     {
       mBuff[mBuffPos] = 0;
+
+      // Nothing we need ourselves, and it's not going out either, so don't bother dispatching it
+      if ( !isRMC(mBuff, mBuffPos) && !isPMTKAck(mBuff, mBuffPos) && GNSSFilter::instance().isBlocked(mBuff, mBuffPos) )
+        {
+          mBuffPos = 0;
+          mBuff[mBuffPos] = 0;
+          return;
+        }
+
       Event *e = EventPool::instance().newEvent(GPS_NMEA_SENTENCE);
       if ( e )
         {
-          strlcpy(e->nmeaBuffer.sentence, mBuff, sizeof e->nmeaBuffer.sentence);
+          strlcpy(e->nmeaBuffer->sentence, mBuff, sizeof e->nmeaBuffer->sentence);
           EventQueue::instance ().push(e);
         }
       mBuffPos = 0;
       mBuff[mBuffPos] = 0;
     }
 }
+#endif
 
 void GPS::onPPS()
 {
+  mPPSCycles = bsp_get_cycle_count();
+  mPPSUptime = bsp_get_uptime_ms();
+
   // If we don't have time yet, we can't use this
-  if ( mUTC == 0 )
+  if ( mUTC == 0 && !resume() )
     return;
 
   ++mUTC;     // PPS := advance clock by one second!
-  localtime_r (&mUTC, &mTime); // Now we know exactly what UTC second it is, with only microseconds of latency
+
+  // Now we know exactly what UTC second it is, with only microseconds of latency
+  if ( ++mSecond == 60 )
+    mSecond = 0;
+
+  int16_t slot = -1;
+  uint32_t slotOffset = 0;
+
   if (!mStarted)
     {
       // To keep things simple, we only start the AIS slot timer if we're on an even second (it has a 37.5 Hz frequency)
-      mSlotNumber = (mTime.tm_sec % 60) * 2250; // We know what AIS slot number we're in
-      if (!(mTime.tm_sec & 0x00000001))
+      mSlotNumber = mSecond * 75 / 2; // We know what AIS slot number we're in
+      if (!(mSecond & 0x00000001))
         startTimer ();
     }
   else
     {
-      // The timer is on, now let's re-calibrate ...
-      if (mTime.tm_sec & 1)
-        {
-          // On odd seconds, we expect the timer value to be half its period. Just correct it.
-          uint32_t nominalTimerValue = mPeriod / 2 - 1;
-          //TIM2->CNT = nominalTimerValue;
-          bsp_set_sotdma_timer_value(nominalTimerValue);
-        }
-      else
+      // The timer is on. The slot clock slews out small phase errors by trimming slot lengths.
+      uint32_t period = mSlotClock.slotLength();
+      uint32_t currentTimerValue = bsp_get_sotdma_timer_value();
+
+      /*
+       * Which slot this is follows from the second, not from mSlotNumber, whose update may still be pending.
+       * Even seconds start a slot, but a slightly late timer has yet to finish the previous one.
+       */
+      slot = mSecond * 75 / 2;
+      if ( !(mSecond & 1) && currentTimerValue >= period / 2 )
+        slot = (slot + 2249) % 2250;
+      slotOffset = (uint64_t)currentTimerValue * 1000000 / bsp_get_system_clock();
+
+      if ( !mSlotClock.onPPS(currentTimerValue, !(mSecond & 1)) )
         {
-          // On even seconds, things are a bit more tricky ...
-          //uint32_t currentTimerValue = TIM2->CNT;
-          uint32_t currentTimerValue = bsp_get_sotdma_timer_value();
-          if (currentTimerValue >= mPeriod / 2 - 1)
+          // Too far off to slew, so step the counter
+          if (mSecond & 1)
+            {
+              // On odd seconds, we expect the timer value to be half its period. Just correct it.
+              bsp_set_sotdma_timer_value(period / 2);
+            }
+          else if (currentTimerValue >= period / 2)
             {
               // The timer is a little behind, so kick it forward
-              //TIM2->CNT = mPeriod - 1;
-              bsp_set_sotdma_timer_value(mPeriod - 1);
+              bsp_set_sotdma_timer_value(period - 1);
             }
           else
             {
               // The timer is a little ahead, so pull it back
-              //TIM2->CNT = 0;
               bsp_set_sotdma_timer_value(0);
             }
         }
@@ -175,51 +270,156 @@ void GPS::onPPS()
   if ( e )
     {
       e->clock.utc = mUTC;
+      e->clock.uptime = mPPSUptime;
+      e->clock.cycles = mPPSCycles;
+      e->clock.slot = slot;
+      e->clock.slotOffset = slotOffset;
       EventQueue::instance ().push(e);
     }
 }
 
 
+bool GPS::resume()
+{
+  if ( !mResumeUTC )
+    return false;
+
+  /*
+   * The uptime restarted with the reset, which only took a few milliseconds. The MCU clock may be 1% off,
+   * so this only works for the first few seconds.
+   */
+  uint32_t elapsed = mResumeOffset + mPPSUptime;
+  uint32_t seconds = (elapsed + 500) / 1000;
+  int32_t error = elapsed - seconds * 1000;
+  uint32_t utc = mResumeUTC;
+  mResumeUTC = 0;
+
+  if ( elapsed > 10000 || error > 250 || error < -250 )
+    return false;
+
+  // This PPS advances it by one second
+  mUTC = utc + seconds - 1;
+  mSecond = mUTC % 60;
+  mResumed = true;
+  DBG("Resumed UTC after warm reset\r\n");
+  return true;
+}
+
 void GPS::processEvent(const Event &event)
 {
-  processLine(event.nmeaBuffer.sentence);
+  if ( event.type == CLOCK_EVENT )
+    {
+      WarmStateData &state = WarmState::instance().data();
+      state.utc = event.clock.utc;
+      state.ppsUptime = event.clock.uptime;
+      state.slotClockFrequency = mSlotClock.frequency();
+      WarmState::instance().commit();
+      return;
+    }
+
+#if GNSS_RX_DMA
+  processLine(event.gnssSlice.data, event.gnssSlice.length);
+#else
+  processLine(event.nmeaBuffer->sentence, strlen(event.nmeaBuffer->sentence));
+#endif
   ASSERT(event.rxPacket == nullptr);
 }
 
-void GPS::processLine(const char* buff)
+void GPS::processLine(const char* buff, uint8_t length)
 {
-  if ( buff[0] == '$' && buff[1] != '$' )
+  if ( length > 1 && buff[0] == '$' && buff[1] != '$' )
     {
-      unsigned reportedHash;
-      char *starPos = strstr(buff, "*");
-      if ( starPos && sscanf(starPos + 1, "%x", &reportedHash) == 1 )
-        {
-          unsigned actualHash = 0;
-          for ( const char* c = buff + 1; c < starPos; ++c )
-            actualHash ^= *c;
+      NMEASentence sentence(buff, length);
+      if ( !sentence.isValid() )
+        return;
 
-          if ( reportedHash == actualHash )
-            {
-              parseSentence(buff);
-            }
+      if ( mConfigurator.busy() )
+        mConfigurator.onSentence(sentence, bsp_get_uptime_ms());
 
-        }
+      // Replies to our own commands are of no interest to anyone else
+      if ( !isPMTKAck(buff, length) )
+        parseSentence(sentence);
     }
 }
 
-void GPS::parseSentence(const char *buff)
+void GPS::poll()
 {
-  NMEASentence sentence (buff);
+  if ( mConfigurator.busy() )
+    mConfigurator.poll(bsp_get_uptime_ms());
+
+#if GNSS_AIDING
+  // The EEPROM is slow to write, so this happens here rather than with every fix. It's only any use for aiding.
+  if ( mFixUTC && bsp_gnss_can_transmit()
+       && (!mFixSaved || bsp_get_uptime_ms() - mFixSaveTime >= GNSS_FIX_SAVE_INTERVAL * 1000) )
+    saveFix();
+#endif
+
+  SlotClockState state = mSlotClock.state();
+  if ( state == mClockState && bsp_get_uptime_ms() - mClockReportTime < SOTDMA_REPORT_INTERVAL * 1000 )
+    return;
+
+  // A stopped clock has nothing to say, unless it just stopped
+  if ( state != SLOT_CLOCK_STOPPED || mClockState != SLOT_CLOCK_STOPPED )
+    reportSlotClock();
+
+  mClockState = state;
+  mClockReportTime = bsp_get_uptime_ms();
+}
+
+/*
+ * $PAISYN,<state>,<frequency error in ppb>,<phase error at last PPS in ns>,<seconds in holdover>
+ * where state is S(topped), A(cquiring), L(ocked), H(oldover) or X (expired)
+ */
+void GPS::reportSlotClock()
+{
+  Event *e = EventPool::instance().newEvent(PROPR_NMEA_SENTENCE);
+  if ( !e )
+    return;
+
+  static const char states[] = "SALHX";
+  sprintf(e->nmeaBuffer->sentence, "$PAISYN,%c,%ld,%ld,%lu*", states[mSlotClock.state()], (long)mSlotClock.frequencyError(),
+          (long)mSlotClock.phaseError(), (unsigned long)mSlotClock.holdoverTime());
+
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
+  EventQueue::instance().push(e);
+}
+
+void GPS::sendGNSSCommand(const char *command)
+{
+  bsp_write_gnss_string(command);
+}
+
+void GPS::setGNSSBaudRate(uint32_t rate)
+{
+  bsp_set_gnss_baud_rate(rate);
+}
+
+bool GPS::isRMC(const char *buff, uint8_t length)
+{
+  return length >= 6 && memcmp(buff + 3, "RMC", 3) == 0;
+}
+
+bool GPS::isPMTKAck(const char *buff, uint8_t length)
+{
+  return length >= 9 && memcmp(buff, "$PMTK001,", 9) == 0;
+}
+
+void GPS::parseSentence(const NMEASentence &sentence)
+{
+  const char *buff = sentence.raw();
+
+  // Binary output carries the fix itself instead
+  if ( DataTerminal::instance().outputMode() == OUTPUT_NMEA && GNSSFilter::instance().pass(buff, sentence.length()) )
+    {
 #ifdef MULTIPLEXED_OUTPUT
-  DataTerminal::instance ().write ("NMEA", buff);
+      DataTerminal::instance ().write ("NMEA", buff, sentence.length(), PRIORITY_GNSS);
 #else
-  DataTerminal::instance().write(buff);
+      DataTerminal::instance().write(buff, sentence.length(), PRIORITY_GNSS);
 #endif
+    }
 
-  if (sentence.code ().find ("RMC") == 2)
+  if ( sentence.is("RMC") )
     {
-      const vector<string> &fields = sentence.fields ();
-
       /*
        * Sometimes the GPS indicates errors with sentences like
        * $GPRMC,1420$0*74\r\n
@@ -227,37 +427,64 @@ void GPS::parseSentence(const char *buff)
        *
        * TODO: Should we consider the GPS non-functioning at this point and thus prevent transmission until it recovers?
        */
-      if (fields.size () < 10)
+      if (sentence.numFields () < 10)
         return;
 
+      // This is the time that corresponds to the previous PPS
+      int32_t hour = sentence.digits(1, 0, 2);
+      int32_t min = sentence.digits(1, 2, 2);
+      int32_t sec = sentence.digits(1, 4, 2);
+      int32_t mday = sentence.digits(9, 0, 2);
+      int32_t mon = sentence.digits(9, 2, 2);
+      int32_t year = sentence.digits(9, 4, 2);
+
       // GPS updates arrive even with no time or fix information, so ignore them if that's the case
-      if (fields[1].length () < 6 || fields[9].length () < 6)
+      if ( hour < 0 || min < 0 || sec < 0 || mday < 0 || mon < 0 || year < 0 )
         {
           // TODO: A loss of fix while the SOTDMA timer is active, MUST stop the timer
           bsp_signal_gps_status(false);
           return;
         }
 
+      /*
+       * At more than 1 Hz, the last fix of a second may only arrive after the next PPS, which would
+       * set the clock back. Fixes on the second are always early enough, so only those set the time.
+       */
+      uint8_t timeLength = sentence.fieldLength(1);
+      if ( timeLength <= 7 || sentence.digits(1, 7, timeLength - 7) == 0 )
+        {
+          time_t utc = CivilTime::toUTC(2000 + year, mon, mday, hour, min, sec);
 
-      // This is the time that corresponds to the previous PPS
-      const string &timestr = fields[1].substr (0, 6);
-      const string &datestr = fields[9].substr (0, 6);
-      mTime.tm_hour = Utils::toInt (timestr.substr (0, 2));
-      mTime.tm_min = Utils::toInt (timestr.substr (2, 2));
-      mTime.tm_sec = Utils::toInt (timestr.substr (4, 2));
-      mTime.tm_mday = Utils::toInt (datestr.substr (0, 2));
-      mTime.tm_mon = Utils::toInt (datestr.substr (2, 2)) - 1; // Month is 0-based
-      mTime.tm_year = 100 + Utils::toInt (datestr.substr (4, 2)); // Year is 1900-based
-      mUTC = mktime (&mTime);
+          /*
+           * If we got the time wrong after a warm reset, slot numbers are wrong too. This is only checked once,
+           * as mUTC is otherwise set here and advanced by PPS, so a missing PPS or a late RMC would look the same.
+           */
+          if ( mResumed )
+            {
+              mResumed = false;
+              if ( mStarted && utc != mUTC )
+                stopTimer();
+            }
+
+          mUTC = utc;
+
+          // The PPS interrupt advances this along with mUTC, so it never has to divide
+          mSecond = mUTC % 60;
+        }
 
       // Do we have a fix?
-      if (mUTC && sentence.fields()[3].length() > 0 && sentence.fields()[5].length() > 0)
+      if (mUTC && sentence.fieldLength(3) > 0 && sentence.fieldLength(5) > 0)
         {
           bsp_signal_gps_status(true);
-          mLat = Utils::latitudeFromNMEA (sentence.fields()[3], sentence.fields()[4]);
-          mLng = Utils::longitudeFromNMEA (sentence.fields()[5], sentence.fields()[6]);
-          mSpeed = atof(sentence.fields()[7].c_str());
-          mCOG = atof(sentence.fields()[8].c_str());
+          if ( !mFixUTC )
+            reportTTFF();
+
+          mFixUTC = mUTC;
+          mAidingPending = false;
+          mLat = Utils::latitudeFromNMEA (sentence.field(3), *sentence.field(4));
+          mLng = Utils::longitudeFromNMEA (sentence.field(5), *sentence.field(6));
+          mSpeed = Utils::tenthsFromNMEA(sentence.field(7));
+          mCOG = Utils::tenthsFromNMEA(sentence.field(8));
           Event *e = EventPool::instance().newEvent(GPS_FIX_EVENT);
           if ( e )
             {
@@ -270,12 +497,81 @@ void GPS::parseSentence(const char *buff)
               EventQueue::instance().push (e);
             }
         }
+      else if ( mUTC && mAidingPending )
+        {
+          // The receiver knows what time it is, but not where it is
+          aidReceiver();
+        }
     }
 }
 
+void GPS::aidReceiver()
+{
+  // Our own commands must not interleave with the configurator's
+  if ( mConfigurator.busy() )
+    return;
+
+  mAidingPending = false;
+
+  GNSSFixData fix;
+  if ( !Configuration::instance().readGNSSFix(fix) )
+    return;
+
+  // Too old to be worth anything (or from the future, which means the receiver's time is wrong)
+  time_t age = mUTC - (time_t)fix.utc;
+  if ( age < 0 || age > GNSS_AIDING_MAX_AGE )
+    return;
+
+  struct tm &t = time();
+  uint32_t lat = fix.lat < 0 ? -fix.lat : fix.lat;
+  uint32_t lng = fix.lng < 0 ? -fix.lng : fix.lng;
+
+  // PMTK741 wants degrees, which are 600000 of our units. Altitude is sea level, of course.
+  char buff[80];
+  sprintf(buff, "$PMTK741,%s%lu.%06lu,%s%lu.%06lu,0,%d,%02d,%02d,%02d,%02d,%02d*",
+          fix.lat < 0 ? "-" : "", (unsigned long)(lat / 600000), (unsigned long)(lat % 600000 * 10 / 6),
+          fix.lng < 0 ? "-" : "", (unsigned long)(lng / 600000), (unsigned long)(lng % 600000 * 10 / 6),
+          t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+  Utils::completeNMEA(buff);
+  sendGNSSCommand(buff);
+  mAided = true;
+}
+
+void GPS::saveFix()
+{
+  GNSSFixData fix;
+  fix.magic = GNSS_FIX_MAGIC;
+  fix.utc = mFixUTC;
+  fix.lat = mLat;
+  fix.lng = mLng;
+  Configuration::instance().writeGNSSFix(fix);
+
+  mFixSaved = true;
+  mFixSaveTime = bsp_get_uptime_ms();
+}
+
+/*
+ * $PAITTF,<seconds from receiver power-up to first fix>,<A(ided) or U(naided)>
+ */
+void GPS::reportTTFF()
+{
+  Event *e = EventPool::instance().newEvent(PROPR_NMEA_SENTENCE);
+  if ( !e )
+    return;
+
+  uint32_t ttff = (bsp_get_uptime_ms() - mEnableTime) / 100;
+  sprintf(e->nmeaBuffer->sentence, "$PAITTF,%lu.%lu,%c*", (unsigned long)(ttff / 10), (unsigned long)(ttff % 10),
+          mAided ? 'A' : 'U');
+
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
+  EventQueue::instance().push(e);
+}
+
 
 void GPS::startTimer()
 {
+  mSlotClock.start();
+  bsp_set_sotdma_timer_period(mSlotClock.slotLength());
   bsp_start_sotdma_timer();
   mStarted = true;
   DBG("Started SOTDMA timer\r\n");
@@ -293,6 +589,14 @@ void GPS::onTimerIRQ()
 {
   if ( mStarted )
     {
+      bsp_set_sotdma_timer_period(mSlotClock.onSlot());
+      if ( mSlotClock.state() == SLOT_CLOCK_EXPIRED )
+        {
+          // Without PPS for too long, we don't know where slot boundaries are any more
+          stopTimer();
+          return;
+        }
+
       ++mSlotNumber;
       if ( mSlotNumber == 2250 )
         mSlotNumber = 0;
@@ -303,10 +607,17 @@ void GPS::onTimerIRQ()
     }
 }
 
+#if GNSS_RX_DMA
+bool gnssLineCB(const GNSSSlice &slice)
+{
+  return GPS::instance().onLine(slice);
+}
+#else
 void gnssInputCB(char c)
 {
   GPS::instance().onRX(c);
 }
+#endif
 
 void gnss1PPSCB()
 {
@@ -0,0 +1,271 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "HDLCDecoder.hpp"
+#include "config.h"
+
+
+/*
+ * NRZI decoding of 8 levels (bit 7 is the earliest) assuming the previous level was 0.
+ * A previous level of 1 only flips bit 7 of the result.
+ */
+static const uint8_t NRZI_DECODE_TABLE[] = {
+    0xff, 0xfe, 0xfc, 0xfd, 0xf9, 0xf8, 0xfa, 0xfb, 0xf3, 0xf2, 0xf0, 0xf1, 0xf5, 0xf4, 0xf6, 0xf7,
+    0xe7, 0xe6, 0xe4, 0xe5, 0xe1, 0xe0, 0xe2, 0xe3, 0xeb, 0xea, 0xe8, 0xe9, 0xed, 0xec, 0xee, 0xef,
+    0xcf, 0xce, 0xcc, 0xcd, 0xc9, 0xc8, 0xca, 0xcb, 0xc3, 0xc2, 0xc0, 0xc1, 0xc5, 0xc4, 0xc6, 0xc7,
+    0xd7, 0xd6, 0xd4, 0xd5, 0xd1, 0xd0, 0xd2, 0xd3, 0xdb, 0xda, 0xd8, 0xd9, 0xdd, 0xdc, 0xde, 0xdf,
+    0x9f, 0x9e, 0x9c, 0x9d, 0x99, 0x98, 0x9a, 0x9b, 0x93, 0x92, 0x90, 0x91, 0x95, 0x94, 0x96, 0x97,
+    0x87, 0x86, 0x84, 0x85, 0x81, 0x80, 0x82, 0x83, 0x8b, 0x8a, 0x88, 0x89, 0x8d, 0x8c, 0x8e, 0x8f,
+    0xaf, 0xae, 0xac, 0xad, 0xa9, 0xa8, 0xaa, 0xab, 0xa3, 0xa2, 0xa0, 0xa1, 0xa5, 0xa4, 0xa6, 0xa7,
+    0xb7, 0xb6, 0xb4, 0xb5, 0xb1, 0xb0, 0xb2, 0xb3, 0xbb, 0xba, 0xb8, 0xb9, 0xbd, 0xbc, 0xbe, 0xbf,
+    0x3f, 0x3e, 0x3c, 0x3d, 0x39, 0x38, 0x3a, 0x3b, 0x33, 0x32, 0x30, 0x31, 0x35, 0x34, 0x36, 0x37,
+    0x27, 0x26, 0x24, 0x25, 0x21, 0x20, 0x22, 0x23, 0x2b, 0x2a, 0x28, 0x29, 0x2d, 0x2c, 0x2e, 0x2f,
+    0x0f, 0x0e, 0x0c, 0x0d, 0x09, 0x08, 0x0a, 0x0b, 0x03, 0x02, 0x00, 0x01, 0x05, 0x04, 0x06, 0x07,
+    0x17, 0x16, 0x14, 0x15, 0x11, 0x10, 0x12, 0x13, 0x1b, 0x1a, 0x18, 0x19, 0x1d, 0x1c, 0x1e, 0x1f,
+    0x5f, 0x5e, 0x5c, 0x5d, 0x59, 0x58, 0x5a, 0x5b, 0x53, 0x52, 0x50, 0x51, 0x55, 0x54, 0x56, 0x57,
+    0x47, 0x46, 0x44, 0x45, 0x41, 0x40, 0x42, 0x43, 0x4b, 0x4a, 0x48, 0x49, 0x4d, 0x4c, 0x4e, 0x4f,
+    0x6f, 0x6e, 0x6c, 0x6d, 0x69, 0x68, 0x6a, 0x6b, 0x63, 0x62, 0x60, 0x61, 0x65, 0x64, 0x66, 0x67,
+    0x77, 0x76, 0x74, 0x75, 0x71, 0x70, 0x72, 0x73, 0x7b, 0x7a, 0x78, 0x79, 0x7d, 0x7c, 0x7e, 0x7f
+};
+
+/*
+ * De-stuffing and flag detection for 1 to 4 decoded bits, indexed by the number of consecutive 1s
+ * seen so far, the number of bits and their value (right-aligned). Each entry packs:
+ *
+ * Bits  0-3  : De-stuffed data bits (right-aligned)
+ * Bits  4-6  : Number of data bits
+ * Bits  7-10 : Consecutive 1s after these bits
+ * Bits 11-12 : Event (0 = none, 1 = end flag, 2 = abort)
+ * Bits 13-14 : Position of the bit that triggered the event
+ */
+static const uint16_t DESTUFF_TABLE[8][4][16] = {
+  {
+    // 0 consecutive 1s so far
+    { 0x0010, 0x0091, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0022, 0x0123, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0034, 0x00b5, 0x0036, 0x01b7, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0040, 0x00c1, 0x0042, 0x0143, 0x0044, 0x00c5, 0x0046, 0x01c7, 0x0048, 0x00c9, 0x004a, 0x014b, 0x004c, 0x00cd, 0x004e, 0x024f }
+  },
+  {
+    // 1 consecutive 1s so far
+    { 0x0010, 0x0111, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0022, 0x01a3, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0034, 0x00b5, 0x0036, 0x0237, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0040, 0x00c1, 0x0042, 0x0143, 0x0044, 0x00c5, 0x0046, 0x01c7, 0x0048, 0x00c9, 0x004a, 0x014b, 0x004c, 0x00cd, 0x004e, 0x02cf }
+  },
+  {
+    // 2 consecutive 1s so far
+    { 0x0010, 0x0191, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0022, 0x0223, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0034, 0x00b5, 0x0036, 0x02b7, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0040, 0x00c1, 0x0042, 0x0143, 0x0044, 0x00c5, 0x0046, 0x01c7, 0x0048, 0x00c9, 0x004a, 0x014b, 0x004c, 0x00cd, 0x0037, 0x034f }
+  },
+  {
+    // 3 consecutive 1s so far
+    { 0x0010, 0x0211, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0022, 0x02a3, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0034, 0x00b5, 0x0023, 0x0337, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0040, 0x00c1, 0x0042, 0x0143, 0x0044, 0x00c5, 0x0046, 0x01c7, 0x0048, 0x00c9, 0x004a, 0x014b, 0x0036, 0x00b7, 0x6b37, 0x03cf }
+  },
+  {
+    // 4 consecutive 1s so far
+    { 0x0010, 0x0291, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0011, 0x0323, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0022, 0x00a3, 0x4b23, 0x03b7, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0040, 0x00c1, 0x0042, 0x0143, 0x0044, 0x00c5, 0x0046, 0x01c7, 0x0034, 0x00b5, 0x0036, 0x0137, 0x4b23, 0x4b23, 0x73b7, 0x73b7 }
+  },
+  {
+    // 5 consecutive 1s so far
+    { 0x0000, 0x0311, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0010, 0x0091, 0x2b11, 0x03a3, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0020, 0x00a1, 0x0022, 0x0123, 0x2b11, 0x2b11, 0x53a3, 0x53a3, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0030, 0x00b1, 0x0032, 0x0133, 0x0034, 0x00b5, 0x0036, 0x01b7, 0x2b11, 0x2b11, 0x2b11, 0x2b11, 0x53a3, 0x53a3, 0x53a3, 0x53a3 }
+  },
+  {
+    // 6 consecutive 1s so far
+    { 0x0b00, 0x0391, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0b00, 0x0b00, 0x3391, 0x3391, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x3391, 0x3391, 0x3391, 0x3391, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x0b00, 0x3391, 0x3391, 0x3391, 0x3391, 0x3391, 0x3391, 0x3391, 0x3391 }
+  },
+  {
+    // 7 consecutive 1s so far
+    { 0x1380, 0x1380, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x1380, 0x1380, 0x1380, 0x1380, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000 },
+    { 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380, 0x1380 }
+  }
+};
+
+#define DESTUFF_DATA(e)       ((e) & 0x0f)
+#define DESTUFF_COUNT(e)      (((e) >> 4) & 0x07)
+#define DESTUFF_ONES(e)       (((e) >> 7) & 0x0f)
+#define DESTUFF_EVENT(e)      (((e) >> 11) & 0x03)
+#define DESTUFF_POSITION(e)   (((e) >> 13) & 0x03)
+
+#define DESTUFF_EVENT_FLAG    1
+
+
+HDLCDecoder::HDLCDecoder()
+{
+  reset();
+}
+
+void HDLCDecoder::reset()
+{
+  mLastLevel = 0xff;
+  mInFrame = false;
+  mBitWindow = 0;
+  mOneBitCount = 0;
+  mRXByte = 0;
+  mBitCount = 0;
+}
+
+bool HDLCDecoder::inFrame() const
+{
+  return mInFrame;
+}
+
+HDLCDecoder::Result HDLCDecoder::decode(uint8_t &levels, uint8_t &count, RXPacket &packet)
+{
+  if ( count == 0 )
+    return NO_EVENT;
+
+  if ( mLastLevel == 0xff )
+    {
+      // The first level after a reset only serves as the NRZI reference
+      mLastLevel = levels >> 7;
+      levels <<= 1;
+      if ( --count == 0 )
+        return NO_EVENT;
+    }
+
+  uint8_t bits = NRZI_DECODE_TABLE[levels] ^ (mLastLevel << 7);
+  uint8_t used = 0;
+  Result result = NO_EVENT;
+
+  if ( !mInFrame )
+    {
+      used = scanPreamble(bits, count);
+      if ( mInFrame )
+        result = FRAME_STARTED;
+    }
+  else
+    {
+      used = decodeFrame(bits, count, packet, result);
+    }
+
+  mLastLevel = (levels >> (8 - used)) & 0x01;
+  levels <<= used;
+  count -= used;
+  return result;
+}
+
+uint8_t HDLCDecoder::levelsBeforeEvent(uint16_t packetSize) const
+{
+  /*
+   * Outside a frame, the start flag could complete with the next level at the earliest. It leaves
+   * no 1s behind, so the 7 levels after it can't be an end flag or an abort yet.
+   */
+  if ( !mInFrame )
+    return 8;
+
+  // The end flag needs six 1s and a 0, an abort follows seven 1s
+  uint8_t levels = mOneBitCount < 7 ? 7 - mOneBitCount : 1;
+
+  // An oversized packet is aborted at the level after the one that fills it up (sizes are in bits)
+  if ( packetSize >= MAX_AIS_RX_PACKET_SIZE )
+    return 1;
+
+  uint16_t sizeLevels = MAX_AIS_RX_PACKET_SIZE - packetSize - mBitCount + 1;
+  if ( sizeLevels < levels )
+    levels = sizeLevels;
+
+  return levels;
+}
+
+uint8_t HDLCDecoder::scanPreamble(uint8_t bits, uint8_t count)
+{
+  for ( uint8_t i = 0; i < count; ++i, bits <<= 1 )
+    {
+      mBitWindow <<= 1;
+      mBitWindow |= bits >> 7;
+
+      /*
+       * By checking for the last few preamble bits plus the HDLC start flag,
+       * we gain enough confidence that this is not random noise.
+       */
+      if ( mBitWindow == 0b1010101001111110 || mBitWindow == 0b0101010101111110 )
+        {
+          mInFrame = true;
+          return i + 1;
+        }
+    }
+
+  return count;
+}
+
+uint8_t HDLCDecoder::decodeFrame(uint8_t bits, uint8_t count, RXPacket &packet, Result &result)
+{
+  uint8_t used = 0;
+  while ( used < count )
+    {
+      if ( packet.size() >= MAX_AIS_RX_PACKET_SIZE )
+        {
+          result = FRAME_ABORTED;
+          return used + 1;
+        }
+
+      uint8_t n = count - used;
+      if ( n > 4 )
+        n = 4;
+
+      // The size limit must be evaluated after every bit when the last byte is being filled
+      if ( packet.size() >= MAX_AIS_RX_PACKET_SIZE - 8 )
+        n = 1;
+
+      uint16_t entry = DESTUFF_TABLE[mOneBitCount][n - 1][bits >> (8 - n)];
+      bits <<= n;
+
+      uint8_t numBits = DESTUFF_COUNT(entry);
+      mRXByte = (mRXByte << numBits) | DESTUFF_DATA(entry);
+      mBitCount += numBits;
+      if ( mBitCount >= 8 )
+        {
+          // Commit to the packet!
+          mBitCount -= 8;
+          packet.addByte(mRXByte >> mBitCount);
+        }
+
+      mOneBitCount = DESTUFF_ONES(entry);
+
+      if ( DESTUFF_EVENT(entry) )
+        {
+          mInFrame = false;
+          result = DESTUFF_EVENT(entry) == DESTUFF_EVENT_FLAG ? FRAME_COMPLETE : FRAME_ABORTED;
+          return used + DESTUFF_POSITION(entry) + 1;
+        }
+
+      used += n;
+    }
+
+  return used;
+}
+
@@ -19,15 +19,9 @@
 
 
 #include "NMEAEncoder.hpp"
-#include "Utils.hpp"
-#include <cstdio>
 #include <cstring>
-#include <algorithm>
-//#include <diag/Trace.h>
 #include "AISChannels.h"
 
-using namespace std;
-
 
 NMEAEncoder::NMEAEncoder()
 : mSequence(0)
@@ -38,10 +32,21 @@ NMEAEncoder::~NMEAEncoder()
 {
 }
 
-void NMEAEncoder::encode(RXPacket &packet, vector<string> &sentences)
+// 6-bit ASCII armoring
+static inline char armor(uint8_t value)
+{
+  return value + (value < 40 ? 48 : 56);
+}
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+uint16_t NMEAEncoder::encode(RXPacket &packet, char *buffer, uint16_t size)
 {
-  static uint16_t MAX_SENTENCE_BYTES = 56;
-  static uint16_t MAX_SENTENCE_BITS = MAX_SENTENCE_BYTES * 6;
+  static const uint16_t MAX_SENTENCE_BYTES = 56;
+  static const uint16_t MAX_SENTENCE_BITS = MAX_SENTENCE_BYTES * 6;
+
+  // "!AIVDM,n,i,s,c," plus ",f*hh\r\n"
+  static const uint16_t SENTENCE_OVERHEAD = 15 + 7;
 
   packet.discardCRC();
 
@@ -74,53 +79,67 @@ void NMEAEncoder::encode(RXPacket &packet, vector<string> &sentences)
 
 
   // Now we know how many sentences we need
-  char sentence[85];
+  uint16_t length = 0;
   uint16_t pos = 0;
 
   for ( uint16_t i = 1; i <= numSentences; ++i )
     {
-      uint8_t k = 0;
+      uint16_t end = pos + MAX_SENTENCE_BITS;
+      if ( end > numBits )
+        end = numBits;
+
+      // Leave room for the terminating NUL too
+      if ( length + SENTENCE_OVERHEAD + (end - pos) / 6 >= size )
+        break;
+
+      char *sentence = buffer + length;
+      char *p = sentence;
+
+      memcpy(p, "!AIVDM,", 7);
+      p += 7;
+      *p++ = '0' + numSentences;
+      *p++ = ',';
+      *p++ = '0' + i;
+      *p++ = ',';
       if ( numSentences > 1 )
-        sprintf(sentence, "!AIVDM,%d,%d,%d,%c,", numSentences, i, mSequence, AIS_CHANNELS[packet.channel()].designation);
-      else
-        sprintf(sentence, "!AIVDM,%d,%d,,%c,", numSentences, i, AIS_CHANNELS[packet.channel()].designation);
-
-      k = strlen(sentence);
-      uint16_t sentenceBits = 0;
+        *p++ = '0' + mSequence;
+      *p++ = ',';
+      *p++ = AIS_CHANNELS[packet.channel()].designation;
+      *p++ = ',';
 
-      for ( ; pos < numBits && sentenceBits < MAX_SENTENCE_BITS; pos += 6, sentenceBits += 6 )
+      // 4 characters for every 24 bits extracted from the packet
+      for ( ; pos + 24 <= end; pos += 24 )
         {
-          uint8_t nmeaByte = (uint8_t)packet.bits(pos, 6);
-          nmeaByte += (nmeaByte < 40) ? 48 : 56;
-          sentence[k++] = nmeaByte;
+          uint32_t word = packet.bits(pos, 24);
+          *p++ = armor(word >> 18);
+          *p++ = armor((word >> 12) & 0x3f);
+          *p++ = armor((word >> 6) & 0x3f);
+          *p++ = armor(word & 0x3f);
         }
 
-      sentence[k++] = ',';
-      if ( numSentences > 1 )
-        {
-          if ( i == numSentences )
-            sentence[k++] = '0' + fillBits;
-          else
-            sentence[k++] = '0';
-        }
+      for ( ; pos < end; pos += 6 )
+        *p++ = armor(packet.bits(pos, 6));
+
+      *p++ = ',';
+      if ( numSentences > 1 && i == numSentences )
+        *p++ = '0' + fillBits;
       else
-        {
-          sentence[k++] = '0';
-        }
+        *p++ = '0';
 
-      sentence[k++] = '*';
-      sprintf(sentence+k, "%.2X", nmeaCRC(sentence));
-      sentences.push_back(string(sentence));
-    }
+      uint8_t crc = 0;
+      for ( char *c = sentence + 1; c < p; ++c )
+        crc ^= *c;
 
-}
+      *p++ = '*';
+      *p++ = HEX_DIGITS[crc >> 4];
+      *p++ = HEX_DIGITS[crc & 0x0f];
+      *p++ = '\r';
+      *p++ = '\n';
 
-uint8_t NMEAEncoder::nmeaCRC(const char* buff)
-{
-  uint8_t p = 1;
-  uint8_t crc = buff[p++];
-  while ( buff[p] != '*' )
-    crc ^= buff[p++];
-  return crc;
+      length = p - buffer;
+    }
+
+  buffer[length] = 0;
+  return length;
 }
 
@@ -18,44 +18,123 @@
 */
 
 #include "NMEASentence.hpp"
-#include "Utils.hpp"
+#include <string.h>
 
-NMEASentence::NMEASentence(const string &raw)
-: mRaw(raw)
+static inline int8_t hexValue(char c)
 {
-  parse();
+  if ( c >= '0' && c <= '9' )
+    return c - '0';
+  if ( c >= 'A' && c <= 'F' )
+    return c - 'A' + 10;
+  if ( c >= 'a' && c <= 'f' )
+    return c - 'a' + 10;
+  return -1;
 }
 
-const string &NMEASentence::code() const
+NMEASentence::NMEASentence(const char *raw)
+: mRaw(raw), mLength(strnlen(raw, 0xff)), mNumFields(0), mValid(false)
 {
-  return mCode;
+  mValid = parse();
 }
 
-const string &NMEASentence::raw() const
+NMEASentence::NMEASentence(const char *raw, uint8_t length)
+: mRaw(raw), mLength(length), mNumFields(0), mValid(false)
+{
+  mValid = parse();
+}
+
+bool NMEASentence::isValid() const
+{
+  return mValid;
+}
+
+uint8_t NMEASentence::numFields() const
+{
+  return mNumFields;
+}
+
+const char *NMEASentence::field(uint8_t index) const
+{
+  // Missing fields read as empty ones
+  if ( index >= mNumFields )
+    return "";
+
+  return mRaw + mStarts[index];
+}
+
+uint8_t NMEASentence::fieldLength(uint8_t index) const
+{
+  if ( index >= mNumFields )
+    return 0;
+
+  // Every field start is preceded by a delimiter, and there is one past the last field too
+  return mStarts[index + 1] - mStarts[index] - 1;
+}
+
+bool NMEASentence::is(const char *sentenceID) const
+{
+  return mValid && fieldLength(0) == 5 && strncmp(mRaw + 3, sentenceID, 3) == 0;
+}
+
+int32_t NMEASentence::digits(uint8_t index, uint8_t offset, uint8_t count) const
+{
+  if ( offset + count > fieldLength(index) )
+    return -1;
+
+  const char *p = field(index) + offset;
+  int32_t result = 0;
+  for ( uint8_t i = 0; i < count; ++i )
+    {
+      if ( p[i] < '0' || p[i] > '9' )
+        return -1;
+      result = result * 10 + p[i] - '0';
+    }
+
+  return result;
+}
+
+const char *NMEASentence::raw() const
 {
   return mRaw;
 }
 
-const vector<string> &NMEASentence::fields() const
+uint8_t NMEASentence::length() const
 {
-  return mFields;
+  return mLength;
 }
 
 bool NMEASentence::parse()
 {
-  if ( mRaw.empty() )
+  if ( mLength < 4 || (mRaw[0] != '$' && mRaw[0] != '!') )
     return false;
 
-  if ( mRaw[0] != '$' && mRaw[0] != '!' )
-    return false;
+  uint8_t checksum = 0;
+  uint8_t i = 1;
+  uint8_t end = 0;
+  mStarts[mNumFields++] = i;
+
+  for ( ; i < mLength && mRaw[i] != '*'; ++i )
+    {
+      checksum ^= mRaw[i];
+      if ( mRaw[i] != ',' )
+        continue;
+
+      if ( mNumFields < NMEA_MAX_FIELDS )
+        mStarts[mNumFields++] = i + 1;
+      else if ( !end )
+        end = i + 1;  // Fields beyond this are ignored
+    }
 
-  Utils::tokenize(mRaw, ',', mFields);
-  mFields[0] = mFields[0].substr(1); // Remove the $ or ! from the first field
-  string &lastField = *mFields.rbegin();
+  // Sentinel, so the last field's length works like the others
+  mStarts[mNumFields] = end ? end : i + 1;
 
-  size_t p = lastField.find("*");
-  lastField = lastField.substr(0, p);
-  mCode = mFields[0];
+  if ( i + 2 >= mLength )
+    return false;
+
+  int8_t high = hexValue(mRaw[i + 1]);
+  int8_t low = high < 0 ? -1 : hexValue(mRaw[i + 2]);
+  if ( low < 0 )
+    return false;
 
-  return true;
+  return checksum == ((high << 4) | low);
 }
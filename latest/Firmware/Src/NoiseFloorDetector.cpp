@@ -21,6 +21,8 @@
 #include "NoiseFloorDetector.hpp"
 #include "EventQueue.hpp"
 #include "AISChannels.h"
+#include "WarmState.hpp"
+#include "Utils.hpp"
 #include <stdio.h>
 
 #define WINDOW_SIZE 10
@@ -39,6 +41,13 @@ NoiseFloorDetector::NoiseFloorDetector()
   mChannelACurrent = 0xff;
   mChannelBCurrent = 0xff;
 
+  const WarmStateData *state = WarmState::instance().restored();
+  if ( state )
+    {
+      mChannelACurrent = state->noiseFloorA;
+      mChannelBCurrent = state->noiseFloorB;
+    }
+
   mAFloor = 0xff;
   mBFloor = 0xff;
   EventQueue::instance().addObserver(this, CLOCK_EVENT);
@@ -97,16 +106,16 @@ void NoiseFloorDetector::dump()
   if ( !e )
     return;
 
-  sprintf(e->nmeaBuffer.sentence, "$PAINF,A,0x%.2x*", mChannelACurrent);
-  Utils::completeNMEA(e->nmeaBuffer.sentence);
+  sprintf(e->nmeaBuffer->sentence, "$PAINF,A,0x%.2x*", mChannelACurrent);
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
   EventQueue::instance().push(e);
 
   e = EventPool::instance().newEvent(PROPR_NMEA_SENTENCE);
   if ( !e )
     return;
 
-  sprintf(e->nmeaBuffer.sentence, "$PAINF,B,0x%.2x*", mChannelBCurrent);
-  Utils::completeNMEA(e->nmeaBuffer.sentence);
+  sprintf(e->nmeaBuffer->sentence, "$PAINF,B,0x%.2x*", mChannelBCurrent);
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
   EventQueue::instance().push(e);
 }
 
@@ -125,6 +134,11 @@ void NoiseFloorDetector::recalculate()
 
   mAFloor = 0xff;
   mBFloor = 0xff;
+
+  WarmStateData &state = WarmState::instance().data();
+  state.noiseFloorA = mChannelACurrent;
+  state.noiseFloorB = mChannelBCurrent;
+  WarmState::instance().commit();
 }
 
 
@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#include "ObjectPool.hpp"
+
+
+static PoolStats *__pools = nullptr;
+
+PoolStats::PoolStats(const char *name, uint32_t size, uint32_t bytes)
+  : mName(name), mSize(size), mBytes(bytes), mUtilization(0), mMaxUtilization(0), mFailures(0)
+{
+  // Pools are constructed in thread context, before any ISR could use one
+  mNext = __pools;
+  __pools = this;
+}
+
+const char *PoolStats::name() const
+{
+  return mName;
+}
+
+uint32_t PoolStats::size() const
+{
+  return mSize;
+}
+
+uint32_t PoolStats::bytes() const
+{
+  return mBytes;
+}
+
+uint32_t PoolStats::utilization() const
+{
+  return mUtilization.load(std::memory_order_relaxed);
+}
+
+uint32_t PoolStats::maxUtilization() const
+{
+  return mMaxUtilization.load(std::memory_order_relaxed);
+}
+
+uint32_t PoolStats::failures() const
+{
+  return mFailures.load(std::memory_order_relaxed);
+}
+
+PoolStats *PoolStats::first()
+{
+  return __pools;
+}
+
+PoolStats *PoolStats::next() const
+{
+  return mNext;
+}
+
+void PoolStats::allocated()
+{
+  uint32_t used = mUtilization.fetch_add(1, std::memory_order_relaxed) + 1;
+  uint32_t peak = mMaxUtilization.load(std::memory_order_relaxed);
+  while ( used > peak && !mMaxUtilization.compare_exchange_weak(peak, used, std::memory_order_relaxed) )
+    ;
+}
+
+void PoolStats::released()
+{
+  mUtilization.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PoolStats::failed()
+{
+  mFailures.fetch_add(1, std::memory_order_relaxed);
+}
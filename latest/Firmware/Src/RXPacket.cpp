@@ -21,6 +21,7 @@
 #include <cassert>
 #include <cstring>
 #include "RXPacket.hpp"
+#include "CRC16.hpp"
 
 //#define memcpy my_on_steroids_memcpy
 
@@ -81,7 +82,7 @@ RXPacket &RXPacket::operator =(const RXPacket &copy)
 
 void RXPacket::reset()
 {
-  mState = {{0}, 0, 0xffff, 0, 0, 0, 0xffffffff, CH_18, 0};
+  mState = {{0}, 0, CRC16::INITIAL_VALUE, 0, 0, 0, 0xffffffff, CH_18, 0};
 #if 0
   mType = 0;
   mRI = 0;
@@ -116,29 +117,30 @@ uint8_t RXPacket::rssi() const
 }
 
 
-void RXPacket::addBit(uint8_t bit)
+/**
+ * Appends up to 8 bits (right-aligned, MSB first) at the end of the payload.
+ * They straddle two words at most.
+ */
+void RXPacket::addBits(uint8_t bits, uint8_t count)
 {
-  //ASSERT(mSize < MAX_AIS_RX_PACKET_SIZE);
+  //ASSERT(mSize + count <= MAX_AIS_RX_PACKET_SIZE);
 
-  uint16_t index = mState.mSize / 8;
-  uint8_t offset = mState.mSize % 8;
+  uint16_t index = mState.mSize / 32;
+  uint8_t offset = mState.mSize % 32;
+  uint32_t value = (uint32_t)bits << (32 - count);
+  uint32_t mask = 0xffffffff << (32 - count);
 
-  if ( bit )
-    mState.mPacket[index] |= ( 1 << offset );
-  else
-    mState.mPacket[index] &= ~( 1 << offset );
+  mState.mPacket[index] = (mState.mPacket[index] & ~(mask >> offset)) | (value >> offset);
+  if ( offset + count > 32 )
+    mState.mPacket[index+1] = (mState.mPacket[index+1] & ~(mask << (32 - offset))) | (value << (32 - offset));
 
-  ++mState.mSize;
+  mState.mSize += count;
 }
 
 uint8_t RXPacket::bit(uint16_t pos) const
 {
-  if ( pos < mState.mSize ) {
-      uint16_t index = pos / 8;
-      uint8_t offset = pos % 8;
-
-      return (mState.mPacket[index] & (1 << offset)) != 0;
-  }
+  if ( pos < mState.mSize )
+    return (mState.mPacket[pos / 32] >> (31 - pos % 32)) & 0x01;
   else
     return 0;
 }
@@ -146,47 +148,33 @@ uint8_t RXPacket::bit(uint16_t pos) const
 uint32_t RXPacket::bits(uint16_t pos, uint8_t count) const
 {
   ASSERT(count <= 32);
-  uint32_t result = 0;
 
-  for ( uint16_t i = pos; i < pos+count; ++i ) {
-      result <<= 1;
-      result |= bit(i);
-  }
+  // Anything past the end of the payload reads as 0, and so does the storage beyond mSize
+  if ( count == 0 || pos >= mState.mSize )
+    return 0;
 
-  return result;
-}
+  uint16_t index = pos / 32;
+  uint8_t offset = pos % 32;
 
-void RXPacket::addBitCRC(uint8_t data)
-{
-  if ( (data ^ mState.mCRC) & 0x0001 )
-    mState.mCRC = (mState.mCRC >> 1) ^ 0x8408;
-  else
-    mState.mCRC >>= 1;
+  uint32_t result = mState.mPacket[index] << offset;
+  if ( offset + count > 32 )
+    result |= mState.mPacket[index+1] >> (32 - offset);
+
+  return result >> (32 - count);
 }
 
 void RXPacket::addByte(uint8_t byte)
 {
   // The payload is LSB (inverted MSB bytes). This brings it back into MSB format
+  uint8_t msb = byte;
+  msb = (msb & 0xf0) >> 4 | (msb & 0x0f) << 4;
+  msb = (msb & 0xcc) >> 2 | (msb & 0x33) << 2;
+  msb = (msb & 0xaa) >> 1 | (msb & 0x55) << 1;
 
-  addBit(byte & 0x01);
-  addBit(byte & 0x02);
-  addBit(byte & 0x04);
-  addBit(byte & 0x08);
-  addBit(byte & 0x10);
-  addBit(byte & 0x20);
-  addBit(byte & 0x40);
-  addBit(byte & 0x80);
+  addBits(msb, 8);
 
   // Now we can update our CRC in MSB order which is how it was calculated during encoding by the sender ...
-  addBitCRC((byte & 0x80) >> 7);
-  addBitCRC((byte & 0x40) >> 6);
-  addBitCRC((byte & 0x20) >> 5);
-  addBitCRC((byte & 0x10) >> 4);
-  addBitCRC((byte & 0x08) >> 3);
-  addBitCRC((byte & 0x04) >> 2);
-  addBitCRC((byte & 0x02) >> 1);
-  addBitCRC(byte & 0x01);
-
+  mState.mCRC = CRC16::update(mState.mCRC, msb);
 }
 
 
@@ -213,22 +201,28 @@ uint16_t RXPacket::crc() const
 
 void RXPacket::discardCRC()
 {
-  if ( mState.mCRC == 0xffff )
+  if ( mState.mCRC == CRC16::INITIAL_VALUE )
     return;
   mState.mSize -= 16;
-  mState.mCRC = 0xffff;
+  mState.mCRC = CRC16::INITIAL_VALUE;
 
   // Explicitly set those bits to zero, no matter how they align
-  for ( uint8_t i = 0; i < 16; ++i )
-    addBit(0);
+  addBits(0, 8);
+  addBits(0, 8);
 
   mState.mSize -= 16;
 }
 
 void RXPacket::addFillBits(uint8_t numBits)
 {
-  for ( uint8_t i = 0; i < numBits; ++i )
-    addBit(0);
+  while ( numBits > 8 )
+    {
+      addBits(0, 8);
+      numBits -= 8;
+    }
+
+  if ( numBits )
+    addBits(0, numBits);
 }
 
 
@@ -237,7 +231,7 @@ bool RXPacket::checkCRC() const
 {
   //uint16_t rcrc = ((mCRC & 0xff00) >> 8) | ((mCRC & 0x00ff) << 8);
   //trace_printf("%.4x %.4x %.4x\n", mCRC, ~(mCRC), ~(rcrc));
-  return mState.mCRC == 0xf0b8;
+  return mState.mCRC == CRC16::GOOD_RESIDUE;
 
 }
 
@@ -246,11 +240,7 @@ uint8_t RXPacket::messageType() const
   if ( mState.mType )
     return mState.mType;
 
-  for ( int i = 0; i < 6; ++i ) {
-      mState.mType <<= 1;
-      mState.mType |= bit(i);
-  }
-
+  mState.mType = bits(0, 6);
   return mState.mType;
 }
 
@@ -259,7 +249,7 @@ uint8_t RXPacket::repeatIndicator() const
   if ( mState.mRI )
     return mState.mRI;
 
-  mState.mRI = bit(6) << 1 | bit(7);
+  mState.mRI = bits(6, 2);
   return mState.mRI;
 }
 
@@ -268,11 +258,7 @@ uint32_t RXPacket::mmsi() const
   if ( mState.mMMSI )
     return mState.mMMSI;
 
-  for ( int i = 8; i < 38; ++i ) {
-      mState.mMMSI <<= 1;
-      mState.mMMSI |= bit(i);
-  }
-
+  mState.mMMSI = bits(8, 30);
   return mState.mMMSI;
 }
 
@@ -19,6 +19,7 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include "_assert.h"
 #include "config.h"
 #include "RadioManager.hpp"
@@ -32,13 +33,8 @@
 #include "bsp.hpp"
 
 
-#if MULTIPLEXED_OUTPUT
-char __buff[120];
-#endif
-
 RXPacketProcessor::RXPacketProcessor ()
 {
-  mSentences.reserve(4); // We're not going to need more than 2 sentences for the longest AIS message we report ...
   Configuration::instance().readStationData(mStationData);
   EventQueue::instance().addObserver(this, AIS_PACKET_EVENT);
 }
@@ -104,18 +100,29 @@ void RXPacketProcessor::processEvent(const Event &e)
         } // If message 15
 
 
-      mSentences.clear();
-
       ASSERT_VALID_PTR(e.rxPacket);
-      mEncoder.encode(*(e.rxPacket), mSentences);
-      for (vector<string>::iterator i = mSentences.begin(); i != mSentences.end(); ++i)
+      if ( DataTerminal::instance().outputMode() == OUTPUT_BINARY )
         {
+          uint16_t size = BinaryEncoder::encode(*(e.rxPacket), mFrameBuffer, sizeof mFrameBuffer);
+          if ( size )
+            DataTerminal::instance().writeFrame(mFrameBuffer, size, PRIORITY_AIS);
+        }
+      else
+        {
+          mEncoder.encode(*(e.rxPacket), mNMEABuffer, sizeof mNMEABuffer);
 #ifdef MULTIPLEXED_OUTPUT
-          sprintf(__buff, "%s\r\n", i->c_str());
-          DataTerminal::instance().write("NMEA", __buff);
+          // Every sentence gets its own class prefix
+          for ( char *line = mNMEABuffer; *line; )
+            {
+              char *next = strstr(line, "\r\n") + 2;
+              char c = *next;
+              *next = 0;
+              DataTerminal::instance().write("NMEA", line, PRIORITY_AIS);
+              *next = c;
+              line = next;
+            }
 #else
-          DataTerminal::instance().write(i->c_str());
-          DataTerminal::instance().write("\r\n");
+          DataTerminal::instance().write(mNMEABuffer, PRIORITY_AIS);
 #endif
         }
 
@@ -25,6 +25,10 @@
 
 void rxClockCB();
 void trxClockCB();
+#if RX_IC_CAPTURE
+void rxCaptureCB(const uint16_t *samples, uint32_t count, uint32_t position);
+void rxRSSICB();
+#endif
 
 
 RadioManager &RadioManager::instance()
@@ -34,12 +38,10 @@ RadioManager &RadioManager::instance()
 }
 
 RadioManager::RadioManager()
-  : mTXQueue(4)
 {
   mTransceiverIC = NULL;
   mReceiverIC = NULL;
   mInitializing = true;
-  //mTXQueue = new CircularQueue<TXPacket*>(4);
   mUTC = 0;
   EventQueue::instance().addObserver(this, CLOCK_EVENT);
 }
@@ -95,7 +97,21 @@ void RadioManager::start()
 void RadioManager::configureInterrupts()
 {
   bsp_set_trx_clk_callback(trxClockCB);
+#if RX_IC_CAPTURE
+  if ( mReceiverIC )
+    mReceiverIC->enableCapture();
+  bsp_set_rx_capture_callback(rxCaptureCB);
+#if ENABLE_TX
+  // Bit n of a slot ends n+1 bit periods after it started, see Receiver::processLevel()
+#if FULL_RSSI_SAMPLING
+  bsp_set_rx_rssi_callback(rxRSSICB, CCA_SLOT_BIT + 1);
+#else
+  bsp_set_rx_rssi_callback(rxRSSICB, CCA_SLOT_BIT);
+#endif
+#endif
+#else
   bsp_set_rx_clk_callback(rxClockCB);
+#endif
 }
 
 void RadioManager::processEvent(const Event &e)
@@ -149,6 +165,26 @@ void RadioManager::onBitClock(uint8_t ic)
     mReceiverIC->onBitClock();
 }
 
+#if RX_IC_CAPTURE
+void RadioManager::onCapturedSamples(const uint16_t *samples, uint32_t count, uint32_t position)
+{
+  if ( mInitializing )
+    return;
+
+  if ( mReceiverIC )
+    mReceiverIC->processCapturedSamples(samples, count, position);
+}
+
+void RadioManager::onRXRSSITime()
+{
+  if ( mInitializing )
+    return;
+
+  if ( mReceiverIC )
+    mReceiverIC->latchRSSI();
+}
+#endif
+
 void RadioManager::timeSlotStarted(uint32_t slotNumber)
 {
   if ( mInitializing )
@@ -191,5 +227,17 @@ void trxClockCB()
   RadioManager::instance().onBitClock(1);
 }
 
+#if RX_IC_CAPTURE
+void rxCaptureCB(const uint16_t *samples, uint32_t count, uint32_t position)
+{
+  RadioManager::instance().onCapturedSamples(samples, count, position);
+}
+
+void rxRSSICB()
+{
+  RadioManager::instance().onRXRSSITime();
+}
+#endif
+
 
 
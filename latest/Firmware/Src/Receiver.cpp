@@ -26,6 +26,8 @@
 #include "bsp.hpp"
 #include "Stats.hpp"
 
+static_assert(MAX_RX_DECODE_LEVELS >= 1 && MAX_RX_DECODE_LEVELS <= 8, "HDLCDecoder takes 1 to 8 levels at a time");
+
 
 Receiver::Receiver(GPIO_TypeDef *sdnPort, uint32_t sdnPin, GPIO_TypeDef *csPort, uint32_t csPin,
     GPIO_TypeDef *dataPort, uint32_t dataPin,
@@ -33,14 +35,11 @@ Receiver::Receiver(GPIO_TypeDef *sdnPort, uint32_t sdnPin, GPIO_TypeDef *csPort,
 : RFIC(sdnPort, sdnPin, csPort, csPin, dataPort, dataPin, clockPort, clockPin, chipId)
 {
   mSlotBitNumber = -1;
-  mOneBitCount = 0;
   mChannel = CH_88;
-  mBitCount = 0;
-  mBitState = BIT_STATE_PREAMBLE_SYNC;
-  mLastNRZIBit=0x00;
   mNextChannel = mChannel;
-  mRXByte = 0;
-  mBitWindow = 0;
+  mLevels = 0;
+  mLevelCount = 0;
+  sizeBatch(0);
   mRXPacket = EventPool::instance().newRXPacket();
   ASSERT_VALID_PTR(mRXPacket);
 }
@@ -96,18 +95,27 @@ void Receiver::startListening(VHFChannel channel, bool reconfigGPIOs)
    * This never takes more than 65us now :D
    */
   //bsp_signal_high();
+#if RX_IC_CAPTURE
+  if ( mCapturing )
+    {
+      // This runs in the capture interrupt, which the bit clock of the other IC and latchRSSI() can preempt to use the SPI bus
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      sendCmdNoWait(START_RX, &options, sizeof options);
+      __set_PRIMASK(primask);
+      return;
+    }
+#endif
   sendCmdNoWait(START_RX, &options, sizeof options);//, NULL, 0);
   //bsp_signal_low();
 }
 
 void Receiver::resetBitScanner()
 {
-  mBitWindow = 0;
-  mBitCount = 0;
-  mOneBitCount = 0;
-  mLastNRZIBit = 0xff;
-  mRXByte = 0;
-  mBitState = BIT_STATE_PREAMBLE_SYNC;
+  mDecoder.reset();
+  mLevels = 0;
+  mLevelCount = 0;
+  sizeBatch(0);
   if ( mRXPacket )
     mRXPacket->reset();
 }
@@ -116,10 +124,73 @@ void Receiver::resetBitScanner()
  * TODO: Under a worst case scenario, this interrupt service method
  * can take up to 320us to complete (that's 4 clock bits!!!)
  *
- * Re-architecting will be necessary to resolve this.
+ * Re-architecting will be necessary to resolve this. RX_IC_CAPTURE takes the RX IC out of
+ * this path altogether, see processCapturedSamples().
  */
 
 void Receiver::onBitClock()
+{
+  processLevel(HAL_GPIO_ReadPin(mDataPort, mDataPin));
+}
+
+#if RX_IC_CAPTURE
+void Receiver::enableCapture()
+{
+  // Delivered samples pick up from here
+  mCapturePosition = bsp_get_rx_capture_position();
+  mCapturing = true;
+}
+
+/**
+ * This is called from the capture interrupt, which is lower priority than the bit clock of the other IC
+ * and the SOTDMA timer. The object pools and the ISR event queue are safe to use from any interrupt, and the
+ * only use of the SPI bus here is guarded in startListening().
+ */
+void Receiver::processCapturedSamples(const uint16_t *samples, uint32_t count, uint32_t position)
+{
+  if ( position != mCapturePosition )
+    {
+      // Samples were overwritten before they could be delivered. Whatever was being decoded is lost.
+      ++Stats::instance().rxCaptureOverruns;
+      mSlotBitNumber += position - mCapturePosition;
+      resetBitScanner();
+    }
+  mCapturePosition = position + count;
+
+  for ( uint32_t i = 0; i < count; ++i )
+    {
+      if ( mSlotPending && (int32_t)(position + i - mPendingSlotPosition) >= 0 )
+        {
+          mSlotPending = false;
+          decodeLevels();
+          startSlot(mPendingSlot);
+        }
+
+      processLevel((samples[i] & mDataPin) ? 1 : 0);
+    }
+}
+
+/**
+ * This is called from the SOTDMA timer interrupt in the bit period that processLevel() samples the RSSI in.
+ * The RSSI must be read in real time, so it's kept here until the batch decoder gets to that bit.
+ */
+void Receiver::latchRSSI()
+{
+  uint32_t slot = mPendingSlot;
+  if ( !mCapturing || slot == 0xffffffff || gRadioState == RADIO_TRANSMITTING )
+    return;
+
+#if !FULL_RSSI_SAMPLING
+  if ( slot % 17 != (uint32_t)mChipID )
+    return;
+#endif
+
+  mLatchedRSSI = reportRSSI();
+  mLatchedRSSISlot = slot;
+}
+#endif
+
+void Receiver::processLevel(uint8_t level)
 {
   //bsp_signal_high();
   ++mSlotBitNumber;
@@ -142,12 +213,16 @@ void Receiver::onBitClock()
     }
 
 
-  uint8_t bit = HAL_GPIO_ReadPin(mDataPort, mDataPin);
-  Receiver::Action action = processNRZIBit(bit);
-  if ( action == RESTART_RX )
-    {
-      startReceiving(mChannel, false);
-    }
+  /**
+   * Levels are only collected here and handed to the decoder in small batches. A batch ends with the first
+   * level that could complete or abort a frame, so the receiver is still restarted in the bit period
+   * that calls for it. It also ends early if something else in this bit period depends on the decoder
+   * being up to date.
+   */
+  mLevels |= level << (7 - mLevelCount);
+  ++mLevelCount;
+
+  bool sampleRSSI = false;
 #if ENABLE_TX
   /**
    * This trick ensures that we only sample RSSI every N time slots and never in the
@@ -156,20 +231,29 @@ void Receiver::onBitClock()
    * collection to have a high duty cycle anyway, it just serves to establish the noise floor.
    */
 #if FULL_RSSI_SAMPLING
-  else if ( mTimeSlot != 0xffffffff && mSlotBitNumber != 0xffff && mSlotBitNumber == CCA_SLOT_BIT )
-    {
-      mRXPacket->setRSSI(reportRSSI());
-    }
+  sampleRSSI = mTimeSlot != 0xffffffff && mSlotBitNumber != 0xffff && mSlotBitNumber == CCA_SLOT_BIT;
 #else
-  else if ( mTimeSlot != 0xffffffff && mSlotBitNumber != 0xffff &&
+  sampleRSSI = mTimeSlot != 0xffffffff && mSlotBitNumber != 0xffff &&
       mTimeSlot % 17 == mChipID &&
-      mSlotBitNumber == CCA_SLOT_BIT - 1 )
-    {
-      mRXPacket->setRSSI(reportRSSI());
-    }
+      mSlotBitNumber == CCA_SLOT_BIT - 1;
+#endif
 #endif
+
+#if RX_IC_CAPTURE
+  // Only if latchRSSI() got to read it
+  if ( mCapturing )
+    sampleRSSI = sampleRSSI && mLatchedRSSISlot == mTimeSlot;
 #endif
 
+  Receiver::Action action = NO_ACTION;
+  if ( mLevelCount >= mBatchSize || sampleRSSI )
+    action = decodeLevels();
+
+  if ( sampleRSSI && action != RESTART_RX && mRXPacket )
+    {
+      mRXPacket->setRSSI(slotRSSI());
+    }
+
   //bsp_signal_low();
 }
 
@@ -183,9 +267,28 @@ void Receiver::timeSlotStarted(uint32_t slot)
   // This should never be called while transmitting. Transmissions start after the slot boundary and end before the end of it.
   ASSERT(gRadioState == RADIO_RECEIVING);
 
+#if RX_IC_CAPTURE
+  if ( mCapturing )
+    {
+      // The slot starts when the batch decoder reaches this point in the captured bit stream
+      mPendingSlotPosition = bsp_get_rx_capture_position();
+      mPendingSlot = slot;
+      mSlotPending = true;
+      bsp_flush_rx_capture();
+      return;
+    }
+#endif
+
+  // Catch up with the levels collected during the previous slot
+  decodeLevels();
+  startSlot(slot);
+}
+
+void Receiver::startSlot(uint32_t slot)
+{
   mSlotBitNumber = -1;
   mTimeSlot = slot;
-  if ( mBitState == BIT_STATE_IN_PACKET )
+  if ( mDecoder.inFrame() )
     return;
 
   if ( mRXPacket )
@@ -198,105 +301,65 @@ void Receiver::timeSlotStarted(uint32_t slot)
 }
 
 /**
- * This method must complete in a few microseconds, worst case!
+ * Feeds the collected levels to the decoder and acts on whatever it finds. The result is
+ * RESTART_RX if the receiver was restarted, which can only be caused by the last level.
  */
-Receiver::Action Receiver::processNRZIBit(uint8_t bit)
+Receiver::Action Receiver::decodeLevels()
 {
-  if ( mLastNRZIBit == 0xff )
-    {
-      mLastNRZIBit = bit;
-      return NO_ACTION;
-    }
-
-  uint8_t decodedBit = !(mLastNRZIBit ^ bit);
-
-  switch (mBitState) {
-  case BIT_STATE_PREAMBLE_SYNC:
+  Action action = NO_ACTION;
+  while ( mLevelCount && mRXPacket )
     {
-      mLastNRZIBit = bit;
-      mBitWindow <<= 1;
-      mBitWindow |= decodedBit;
-
-      /*
-       * By checking for the last few preamble bits plus the HDLC start flag,
-       * we gain enough confidence that this is not random noise.
-       */
-      if ( mBitWindow == 0b1010101001111110 || mBitWindow == 0b0101010101111110 )
+      action = NO_ACTION;
+      switch (mDecoder.decode(mLevels, mLevelCount, *mRXPacket)) {
+      case HDLCDecoder::FRAME_STARTED:
+        mRXPacket->setChannel(mChannel);
+        break;
+      case HDLCDecoder::FRAME_COMPLETE:
+        /**
+         * This is the longest operation undertaken here. Now that we use object pools and pointers,
+         * it completes in about 14us
+         */
+        pushPacket();
+        action = RESTART_RX;
+        break;
+      case HDLCDecoder::FRAME_ABORTED:
+        action = RESTART_RX;
+        break;
+      default:
+        break;
+      }
+
+      if ( action == RESTART_RX )
         {
-          mBitState = BIT_STATE_IN_PACKET;
-          mRXPacket->setChannel(mChannel);
+          // This also resets the decoder and the batch. Batches are sized so that nothing follows the event.
+          ASSERT(mLevelCount == 0);
+          startReceiving(mChannel, false);
         }
-
-      break;
     }
-  case BIT_STATE_IN_PACKET:
-    {
-      if ( mOneBitCount >= 7 || mRXPacket->size() >= MAX_AIS_RX_PACKET_SIZE )
-        {
-          // Start over
-          return RESTART_RX;
-        }
-
-      mLastNRZIBit = bit;
-      mBitWindow <<= 1;
-      mBitWindow |= decodedBit;
 
-      if ( (mBitWindow & 0x00ff) == 0x7E )
-        {
-          // We have a complete packet
-          mBitState = BIT_STATE_PREAMBLE_SYNC;
-          /**
-           * This is the longest operation undertaken here. Now that we use object pools and pointers,
-           * it completes in about 14us
-           */
-          pushPacket();
-          return RESTART_RX;
-        }
-      else
-        {
-          addBit(decodedBit);
-        }
-
-      break;
-    }
-  }
-
-  return NO_ACTION;
-}
-
-
-bool Receiver::addBit(uint8_t bit)
-{
-  bool result = true;
-  if ( bit )
+  if ( mRXPacket )
     {
-      ++mOneBitCount;
+      sizeBatch(mRXPacket->size());
     }
   else
     {
-      // Don't put stuffed bits into the packet
-      if ( mOneBitCount == 5 )
-        result = false;
-
-      mOneBitCount = 0;
+      // Nowhere to put them
+      mLevels = 0;
+      mLevelCount = 0;
     }
 
-  if ( result )
-    {
-      mRXByte <<= 1;
-      mRXByte |= bit;
-      ++mBitCount;
-    }
-
-  if ( mBitCount == 8 )
-    {
-      // Commit to the packet!
-      mRXPacket->addByte(mRXByte);
-      mBitCount = 0;
-      mRXByte = 0;
-    }
+  return action;
+}
 
-  return result;
+/**
+ * A batch ends at the first level that could complete or abort a frame, and never holds more than
+ * MAX_RX_DECODE_LEVELS. Flushes decode fewer, so no bit period decodes more than that.
+ */
+void Receiver::sizeBatch(uint16_t packetSize)
+{
+  mBatchSize = mDecoder.levelsBeforeEvent(packetSize);
+  if ( mBatchSize > MAX_RX_DECODE_LEVELS )
+    mBatchSize = MAX_RX_DECODE_LEVELS;
 }
 
 void Receiver::pushPacket()
@@ -348,6 +411,16 @@ uint8_t Receiver::reportRSSI()
   return rssi;
 }
 
+// The RSSI for the bit period being processed
+uint8_t Receiver::slotRSSI()
+{
+#if RX_IC_CAPTURE
+  if ( mCapturing )
+    return mLatchedRSSI;
+#endif
+  return reportRSSI();
+}
+
 void Receiver::configureGPIOsForRX()
 {
   GPIO_PIN_CFG_PARAMS gpiocfg;
@@ -0,0 +1,206 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#include "SlotClock.hpp"
+#include "config.h"
+
+// Slots per two seconds
+#define SLOTS_PER_2S              75
+// Past this, the next PPS is overdue (37.5 slots per second)
+#define PPS_OVERDUE_SLOTS         40
+// Consecutive PPS pulses without a step before we call it locked
+#define LOCK_COUNT                4
+
+
+SlotClock::SlotClock(uint32_t clock)
+: mClock(clock), mState(SLOT_CLOCK_STOPPED), mFraction(0), mFrequency(0), mWander(0), mCorrection(0), mResidual(0),
+  mPhaseError(0), mSlotsSincePPS(0), mGoodPPS(0)
+{
+  mNominalPeriod = (uint64_t)clock * 512 / SLOTS_PER_2S;
+  mPeriod = mNominalPeriod;
+  mCurrentSlot = mNextSlot = mNominalPeriod >> 8;
+}
+
+void SlotClock::start()
+{
+  // The frequency estimate is the one thing worth keeping from last time
+  mState = SLOT_CLOCK_ACQUIRING;
+  mCorrection = 0;
+  mResidual = 0;
+  mPhaseError = 0;
+  mSlotsSincePPS = 0;
+  mGoodPPS = 0;
+  mFraction = 0;
+  updatePeriod();
+  mCurrentSlot = mNextSlot = mPeriod >> 8;
+}
+
+SlotClockState SlotClock::state() const
+{
+  return mState;
+}
+
+uint32_t SlotClock::slotLength() const
+{
+  return mCurrentSlot;
+}
+
+bool SlotClock::onPPS(uint32_t counter, bool evenSecond)
+{
+  if ( mState == SLOT_CLOCK_STOPPED || mState == SLOT_CLOCK_EXPIRED )
+    return true;
+
+  int32_t error;
+  if ( evenSecond )
+    error = counter < mCurrentSlot / 2 ? (int32_t)counter : (int32_t)counter - (int32_t)mCurrentSlot;
+  else
+    error = (int32_t)counter - (int32_t)(mCurrentSlot / 2);
+
+  int32_t seconds = (mSlotsSincePPS * 2 + SLOTS_PER_2S / 2) / SLOTS_PER_2S;
+  if ( seconds < 1 )
+    seconds = 1;
+
+  /*
+   * Whatever we did not expect at this PPS is down to our frequency estimate. Acquisition takes all of it,
+   * once locked we only take a quarter so that PPS jitter doesn't end up in the slot length.
+   */
+  int32_t drift = (int32_t)(((int64_t)(error - mResidual) << 8) / seconds);
+  mFrequency += mState == SLOT_CLOCK_LOCKED ? drift / 4 : drift;
+
+  int32_t limit = (int32_t)((uint64_t)mClock * 256 / 50);
+  if ( mFrequency > limit )
+    mFrequency = limit;
+  else if ( mFrequency < -limit )
+    mFrequency = -limit;
+
+  if ( mState == SLOT_CLOCK_LOCKED )
+    mWander += ((drift < 0 ? -drift : drift) - mWander) / 8;
+
+  mPhaseError = error;
+  mSlotsSincePPS = 0;
+
+  int32_t threshold = (int32_t)((uint64_t)mClock * SOTDMA_STEP_THRESHOLD / 1000000);
+  if ( error > threshold || error < -threshold )
+    {
+      // The caller steps the counter, so there is nothing left to slew
+      mState = SLOT_CLOCK_ACQUIRING;
+      mGoodPPS = 0;
+      mCorrection = 0;
+      mResidual = 0;
+      updatePeriod();
+      return false;
+    }
+
+  // Slew out half the phase error over the next second
+  mCorrection = error / 2;
+  mResidual = error - mCorrection;
+  updatePeriod();
+
+  // Coming out of holdover, mGoodPPS is already past LOCK_COUNT
+  if ( mState != SLOT_CLOCK_LOCKED && ++mGoodPPS >= LOCK_COUNT )
+    mState = SLOT_CLOCK_LOCKED;
+
+  return true;
+}
+
+uint32_t SlotClock::onSlot()
+{
+  ++mSlotsSincePPS;
+
+  // The correction was for one second only
+  if ( mSlotsSincePPS == SLOTS_PER_2S / 2 && mCorrection )
+    {
+      mCorrection = 0;
+      updatePeriod();
+    }
+
+  if ( mSlotsSincePPS > PPS_OVERDUE_SLOTS )
+    {
+      if ( mState == SLOT_CLOCK_LOCKED )
+        {
+          mState = SLOT_CLOCK_HOLDOVER;
+        }
+      else if ( mState == SLOT_CLOCK_ACQUIRING )
+        {
+          // We have no frequency estimate worth holding over with
+          mState = SLOT_CLOCK_EXPIRED;
+        }
+      else if ( mState == SLOT_CLOCK_HOLDOVER )
+        {
+          /*
+           * mWander is how far off our frequency estimate has typically been at each PPS. Once locked, the
+           * estimate is a quarter of the way there, but it lags a steady drift, so the frequency may have
+           * moved by a third of that every second since. This runs in every slot, but holdoverTime() rounds
+           * down to whole seconds, so the error is predicted for the end of the second we're in. Once the
+           * phase error could be outside the budget, we can't pretend to know where slot boundaries are any more.
+           */
+          int64_t seconds = holdoverTime();
+          int64_t ahead = seconds + 1;
+          int64_t error = (mResidual < 0 ? -mResidual : mResidual)
+              + (((int64_t)mWander * (ahead + ahead * ahead / 6)) >> 8);
+          int64_t budget = (uint64_t)mClock * SOTDMA_HOLDOVER_BUDGET / 1000000;
+          if ( seconds > SOTDMA_HOLDOVER || error > budget )
+            mState = SLOT_CLOCK_EXPIRED;
+        }
+    }
+
+  mFraction += mPeriod;
+  mCurrentSlot = mNextSlot;
+  mNextSlot = mFraction >> 8;
+  mFraction &= 0xff;
+
+  return mNextSlot;
+}
+
+int32_t SlotClock::frequencyError() const
+{
+  return (int32_t)((int64_t)mFrequency * 1000000000 / ((int64_t)mClock << 8));
+}
+
+int32_t SlotClock::frequency() const
+{
+  return mFrequency;
+}
+
+void SlotClock::setFrequency(int32_t frequency)
+{
+  mFrequency = frequency;
+  updatePeriod();
+}
+
+int32_t SlotClock::phaseError() const
+{
+  return (int32_t)((int64_t)mPhaseError * 1000000000 / mClock);
+}
+
+uint32_t SlotClock::holdoverTime() const
+{
+  if ( mState != SLOT_CLOCK_HOLDOVER && mState != SLOT_CLOCK_EXPIRED )
+    return 0;
+
+  return mSlotsSincePPS * 2 / SLOTS_PER_2S;
+}
+
+void SlotClock::updatePeriod()
+{
+  // The frequency error and correction are per second, slots are 2/75 of that
+  int64_t trim = ((int64_t)mFrequency + ((int64_t)mCorrection << 8)) * 2 / SLOTS_PER_2S;
+  mPeriod = (uint32_t)((int64_t)mNominalPeriod + trim);
+}
@@ -8,7 +8,9 @@
 
 #include "Stats.hpp"
 #include "Utils.hpp"
+#include "printf_serial.h"
 #include "EventQueue.hpp"
+#include "ObjectPool.hpp"
 #include <stdio.h>
 
 static int count = 0;
@@ -34,15 +36,44 @@ void Stats::processEvent(const Event &e)
   ++count;
   if ( count % 60 == 0 )
     {
-      char buff[32];
-      sprintf(buff, "$PAISTC,%d,%d,%d*", eventQueuePopFailures, eventQueuePushFailures, rxPacketPoolPopFailures);
+      char buff[96];
+      sprintf(buff, "$PAISTC,%d,%d,%d,%d,%d,%d,%d,%d*", eventQueuePopFailures, eventQueuePushFailures, rxPacketPoolPopFailures,
+          terminalTXOverflows, terminalTXHighWater, txFixAge, txFixAgeMax, rxCaptureOverruns);
       Utils::completeNMEA(buff);
 
       printf_serial(buff);
+
+      // Size, objects in use, peak use, failed allocations and RAM of every object pool
+      for ( PoolStats *p = PoolStats::first(); p; p = p->next() )
+        {
+          sprintf(buff, "$PAIPOL,%s,%u,%u,%u,%u,%u*", p->name(), (unsigned)p->size(), (unsigned)p->utilization(),
+              (unsigned)p->maxUtilization(), (unsigned)p->failures(), (unsigned)p->bytes());
+          Utils::completeNMEA(buff);
+          printf_serial(buff);
+        }
+
+      // Events dispatched, worst wait (ms), budget (ms) and events over budget for every event queue lane
+      for ( int lane = 0; lane < EVENT_LANES; ++lane )
+        {
+          EventLaneStats ls = EventQueue::instance().takeLaneStats((EventLane)lane);
+          sprintf(buff, "$PAILAT,%s,%u,%u,%u,%u*", EventQueue::laneName((EventLane)lane), (unsigned)ls.events,
+              (unsigned)ls.maxLatency, (unsigned)EventQueue::laneBudget((EventLane)lane), (unsigned)ls.overBudget);
+          Utils::completeNMEA(buff);
+          printf_serial(buff);
+        }
+
       count = 1;
+      txFixAgeMax = 0;
     }
 }
 
+void Stats::recordTXFixAge(uint32_t age)
+{
+  txFixAge = age;
+  if ( txFixAge > txFixAgeMax )
+    txFixAgeMax = txFixAge;
+}
+
 
 
 
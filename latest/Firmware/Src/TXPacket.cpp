@@ -55,6 +55,15 @@ void TXPacket::reset()
   mPosition  = 0;
   mChannel   = CH_87;
   mTimestamp = 0;
+  mPayloadLength = 0;
+  memset(mPacket, 0, sizeof mPacket);
+  memset(&mFix, 0, sizeof mFix);
+}
+
+void TXPacket::rewind()
+{
+  mSize      = 0;
+  mPosition  = 0;
   memset(mPacket, 0, sizeof mPacket);
 }
 
@@ -88,6 +97,28 @@ const char *TXPacket::messageType()
   return mMessageType;
 }
 
+void TXPacket::setPayload(const uint8_t *bytes, uint8_t length)
+{
+  ASSERT(length <= sizeof mPayload);
+  memcpy(mPayload, bytes, length);
+  mPayloadLength = length;
+}
+
+uint8_t *TXPacket::payload()
+{
+  return mPayload;
+}
+
+uint8_t TXPacket::payloadLength()
+{
+  return mPayloadLength;
+}
+
+TXFix &TXPacket::fix()
+{
+  return mFix;
+}
+
 VHFChannel TXPacket::channel()
 {
   return mChannel;
@@ -156,14 +187,18 @@ TXPacketPool &TXPacketPool::instance()
   return __instance;
 }
 
+TXPacketPool::TXPacketPool()
+  : mPool("TXPKT")
+{
+}
+
 void TXPacketPool::init()
 {
-  mPool = new ObjectPool<TXPacket>(4);
 }
 
 TXPacket *TXPacketPool::newTXPacket(VHFChannel channel)
 {
-  TXPacket *p = mPool->get();
+  TXPacket *p = mPool.get();
   if ( !p )
     return p;
 
@@ -175,7 +210,7 @@ TXPacket *TXPacketPool::newTXPacket(VHFChannel channel)
 void TXPacketPool::deleteTXPacket(TXPacket* p)
 {
   ASSERT(p);
-  mPool->put(p);
+  mPool.put(p);
 }
 
 
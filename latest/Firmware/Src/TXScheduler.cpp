@@ -27,10 +27,12 @@
 #include <string>
 #include <sstream>
 #include <stdlib.h>
+#include <cstring>
 #include "RadioManager.hpp"
 #include "ChannelManager.hpp"
 #include "printf_serial.h"
 #include "bsp.hpp"
+#include "WarmState.hpp"
 
 using namespace std;
 
@@ -46,9 +48,25 @@ TXScheduler::TXScheduler ()
   mPositionReportChannel = CH_87;
   mStaticDataChannel = CH_87;
   mUTC = 0;
-  mAvgSpeed = 0.0;
+  mAvgSpeed = 0;
   mLast18Time = 0;
   mLast24Time = 0;
+  mResumed = false;
+  memset(&mLastGPSFix, 0, sizeof mLastGPSFix);
+
+  // After a warm reset, carry on where we left off instead of waiting to transmit
+  const WarmStateData *state = WarmState::instance().restored();
+  if ( state && state->last18Time )
+    {
+      mPositionReportChannel = (VHFChannel)state->positionReportChannel;
+      mStaticDataChannel = (VHFChannel)state->staticDataChannel;
+      mLast18Time = state->last18Time;
+      mLast24Time = state->last24Time;
+      mAvgSpeed = state->avgSpeed;
+      mLastGPSFix = state->lastFix;
+      mResumed = true;
+    }
+
   if ( Configuration::instance().readStationData(mStationData) )
     {
       DBG("Successfully loaded Station Data \r\n");
@@ -92,9 +110,8 @@ void TXScheduler::processEvent(const Event &e)
         return;
 
 
-      // Using a moving average of SOG to determine transmission rate
-      static float alpha = 0.2;
-      mAvgSpeed = mAvgSpeed * (1.0 - alpha) + mLastGPSFix.speed * alpha;
+      // Using a moving average of SOG (alpha = 0.2) to determine transmission rate
+      mAvgSpeed = (mAvgSpeed * 4 + mLastGPSFix.speed * 16) / 5;
 
       if ( mUTC - mLast18Time > positionReportTimeInterval() )
         {
@@ -112,6 +129,7 @@ void TXScheduler::processEvent(const Event &e)
           mLast24Time = mUTC;
         }
 
+      saveState();
       break;
     }
   case CLOCK_EVENT:
@@ -119,9 +137,18 @@ void TXScheduler::processEvent(const Event &e)
       // This is reliable and independent of GPS update frequency which could change to something other than 1Hz
       if ( mUTC == 0 )
         {
-          // Don't start transmitting right away
-          mLast18Time = e.clock.utc - MAX_MSG_18_TX_INTERVAL/2;
-          mLast24Time = e.clock.utc - MSG_24_TX_INTERVAL/2;
+          // What we carried over is only good if the clock agrees with it
+          if ( mResumed && e.clock.utc >= mLast18Time && e.clock.utc >= mLast24Time
+               && e.clock.utc - mLast18Time <= MAX_MSG_18_TX_INTERVAL && e.clock.utc - mLast24Time <= MSG_24_TX_INTERVAL )
+            {
+              DBG("Resumed TX schedule after warm reset\r\n");
+            }
+          else
+            {
+              // Don't start transmitting right away
+              mLast18Time = e.clock.utc - MAX_MSG_18_TX_INTERVAL/2;
+              mLast24Time = e.clock.utc - MSG_24_TX_INTERVAL/2;
+            }
         }
 
       mUTC = e.clock.utc;
@@ -197,10 +224,22 @@ void TXScheduler::queueMessage24(VHFChannel channel)
 
 }
 
+void TXScheduler::saveState()
+{
+  WarmStateData &state = WarmState::instance().data();
+  state.positionReportChannel = mPositionReportChannel;
+  state.staticDataChannel = mStaticDataChannel;
+  state.last18Time = mLast18Time;
+  state.last24Time = mLast24Time;
+  state.avgSpeed = mAvgSpeed;
+  state.lastFix = mLastGPSFix;
+  WarmState::instance().commit();
+}
+
 time_t TXScheduler::positionReportTimeInterval()
 {
   // As a class B "CS" transponder, we transmit at a rate based on our speed (2 knots is the threshold)
-  if ( mAvgSpeed < 2.0 )
+  if ( mAvgSpeed < 20 * 16 )
     return MAX_MSG_18_TX_INTERVAL;
 
   return MIN_MSG_18_TX_INTERVAL;
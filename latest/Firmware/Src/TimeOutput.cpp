@@ -0,0 +1,75 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#include "TimeOutput.hpp"
+#include "EventQueue.hpp"
+#include "DataTerminal.hpp"
+#include "CivilTime.hpp"
+#include "Utils.hpp"
+#include "bsp.hpp"
+#include <stdio.h>
+
+
+TimeOutput &TimeOutput::instance()
+{
+  static TimeOutput __instance;
+  return __instance;
+}
+
+TimeOutput::TimeOutput()
+: mPPSCycles(0)
+{
+}
+
+void TimeOutput::init()
+{
+  EventQueue::instance().addObserver(this, CLOCK_EVENT);
+}
+
+void TimeOutput::processEvent(const Event &e)
+{
+  // Only one line can be timed at once, so the last one's latency has to be collected first
+  char latency[12] = "";
+  uint32_t cycles;
+  if ( mPPSCycles && DataTerminal::instance().markTime(cycles) )
+    sprintf(latency, "%lu", (unsigned long)((cycles - mPPSCycles) / (bsp_get_system_clock() / 1000000)));
+
+  struct tm t;
+  CivilTime::fromUTC(e.clock.utc, t);
+
+  char buff[48];
+  sprintf(buff, "$GPZDA,%02d%02d%02d.00,%02d,%02d,%04d,00,00*", t.tm_hour, t.tm_min, t.tm_sec, t.tm_mday,
+          t.tm_mon + 1, t.tm_year + 1900);
+  Utils::completeNMEA(buff);
+  DataTerminal::instance().writeMarked(buff, PRIORITY_GNSS);
+  mPPSCycles = e.clock.cycles;
+
+  if ( e.clock.slot >= 0 )
+    sprintf(buff, "$PAITIM,%02d%02d%02d,%d,%u,%s*", t.tm_hour, t.tm_min, t.tm_sec, e.clock.slot, e.clock.slotOffset,
+            latency);
+  else
+    sprintf(buff, "$PAITIM,%02d%02d%02d,,,%s*", t.tm_hour, t.tm_min, t.tm_sec, latency);
+  Utils::completeNMEA(buff);
+#ifdef MULTIPLEXED_OUTPUT
+  DataTerminal::instance().write("NMEA", buff, PRIORITY_PROPRIETARY);
+#else
+  DataTerminal::instance().write(buff, PRIORITY_PROPRIETARY);
+#endif
+}
@@ -19,12 +19,15 @@
 
 
 #include "Transceiver.hpp"
+#include "AISMessages.hpp"
 #include "NoiseFloorDetector.hpp"
+#include "Stats.hpp"
 #include "EventQueue.hpp"
 #include "Events.hpp"
 #include "EZRadioPRO.h"
 #include "AISChannels.h"
 #include "bsp.hpp"
+#include "Utils.hpp"
 #include <stdio.h>
 
 Transceiver::Transceiver(GPIO_TypeDef *sdnPort, uint32_t sdnPin, GPIO_TypeDef *csPort,
@@ -238,6 +241,8 @@ void Transceiver::onBitClock()
           mLastTXTime = mUTC;
           startReceiving(mChannel, true);
           gRadioState = RADIO_RECEIVING;
+          if ( mTXPacket->fix().utc )
+            Stats::instance().recordTXFixAge(mTXPacket->fix().age);
           reportTXEvent();
           TXPacketPool::instance().deleteTXPacket(mTXPacket);
           mTXPacket = NULL;
@@ -273,6 +278,38 @@ void Transceiver::timeSlotStarted(uint32_t slot)
   // Switch channel if we have a transmission scheduled and we're not on the right channel
   if ( gRadioState == RADIO_RECEIVING && mTXPacket && mTXPacket->channel() != mChannel )
     startReceiving(mTXPacket->channel(), false);
+
+  // Bring a position report up to the time of this slot if it may go out in it
+  if ( gRadioState == RADIO_RECEIVING && mTXPacket && mTXPacket->fix().utc && mUTC && mUTC - mLastTXTime >= MIN_TX_INTERVAL )
+    updatePosition(slot);
+}
+
+void Transceiver::updatePosition(uint32_t slot)
+{
+  // There are 2250 slots in a minute, so a slot starts 80/3 ms after the previous one
+  uint32_t ms = slot * 80 / 3;
+  int32_t second = ms / 1000;
+
+  /*
+   * mUTC only follows the PPS once the CLOCK_EVENT has been processed, so it can lag the slot timer.
+   * Around the top of the minute, that puts the slot in the next (or previous) minute.
+   */
+  int32_t utcSecond = mUTC % 60;
+  time_t minute = mUTC - utcSecond;
+  if ( second < utcSecond - 30 )
+    minute += 60;
+  else if ( second > utcSecond + 30 )
+    minute -= 60;
+
+  time_t utc = minute + second;
+  TXFix &fix = mTXPacket->fix();
+  if ( utc < fix.utc )
+    return;
+
+  fix.age = (utc - fix.utc) * 1000 + ms % 1000;
+#if TX_DEAD_RECKONING
+  AISMessage18::extrapolate(*mTXPacket, utc, fix.age);
+#endif
 }
 
 void Transceiver::startTransmitting()
@@ -337,8 +374,8 @@ void Transceiver::reportTXEvent()
   if ( !e )
     return;
 
-  snprintf(e->nmeaBuffer.sentence, sizeof e->nmeaBuffer.sentence, "$PAITX,%c,%s*", AIS_CHANNELS[mTXPacket->channel()].designation, mTXPacket->messageType());
-  Utils::completeNMEA(e->nmeaBuffer.sentence);
+  snprintf(e->nmeaBuffer->sentence, sizeof e->nmeaBuffer->sentence, "$PAITX,%c,%s*", AIS_CHANNELS[mTXPacket->channel()].designation, mTXPacket->messageType());
+  Utils::completeNMEA(e->nmeaBuffer->sentence);
   EventQueue::instance().push(e);
   bsp_signal_tx_event();
 }
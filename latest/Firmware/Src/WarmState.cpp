@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+ */
+
+
+#include "WarmState.hpp"
+#include "CRC16.hpp"
+#include "bsp.hpp"
+#include <cstring>
+
+// Changes with the layout, so a firmware update doesn't pick up something it can't read
+#define WARM_STATE_MAGIC    (0x3A4D0000 | sizeof(WarmStateData))
+
+typedef struct
+{
+  uint32_t        magic;
+  WarmStateData   data;
+  uint16_t        crc;
+} WarmStateRecord;
+
+static WarmStateRecord __record __attribute__((section(".noinit")));
+
+
+WarmState &WarmState::instance()
+{
+  static WarmState __instance;
+  return __instance;
+}
+
+WarmState::WarmState()
+: mValid(false)
+{
+}
+
+void WarmState::init()
+{
+  // Power-on RAM may well pass the CRC by accident, so only resets we caused ourselves count
+  mValid = bsp_get_reset_cause() != RESET_COLD && __record.magic == WARM_STATE_MAGIC && __record.crc == crc();
+  if ( mValid )
+    {
+      mRestored = __record.data;
+    }
+  else
+    {
+      memset(&__record.data, 0, sizeof __record.data);
+      __record.data.noiseFloorA = 0xff;
+      __record.data.noiseFloorB = 0xff;
+    }
+
+  __record.magic = WARM_STATE_MAGIC;
+  commit();
+}
+
+const WarmStateData *WarmState::restored() const
+{
+  return mValid ? &mRestored : nullptr;
+}
+
+WarmStateData &WarmState::data()
+{
+  return __record.data;
+}
+
+void WarmState::commit()
+{
+  __record.crc = crc();
+}
+
+uint16_t WarmState::crc() const
+{
+  return CRC16::compute((const uint8_t*)&__record.data, sizeof __record.data);
+}
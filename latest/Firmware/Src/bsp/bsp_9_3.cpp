@@ -33,18 +33,49 @@ IWDG_HandleTypeDef hiwdg;
 UART_HandleTypeDef huart2;
 UART_HandleTypeDef huart1;
 TIM_HandleTypeDef htim2;
+DMA_HandleTypeDef hdma_usart1_tx;
 
 void SystemClock_Config();
 
 char_input_cb gnssInputCallback = nullptr;
 char_input_cb terminalInputCallback = nullptr;
+tx_pull_callback terminalOutputCallback = nullptr;
+static volatile bool terminalOutputBusy = false;
 irq_callback ppsCallback = nullptr;
 irq_callback sotdmaCallback = nullptr;
 irq_callback trxClockCallback = nullptr;
 irq_callback rxClockCallback = nullptr;
 
+#if GNSS_RX_DMA
+DMA_HandleTypeDef hdma_usart2_rx;
+gnss_rx_callback gnssRXCallback = nullptr;
+static uint16_t gnssRXSize = 0;
+static volatile uint32_t gnssRXDelivered = 0;
+#endif
+
+#if RX_IC_CAPTURE
+DMA_HandleTypeDef hdma_tim2_ch2;
+capture_callback rxCaptureCallback = nullptr;
+
+// Must be a power of 2. The half transfer interrupt fires every 32 bits (3.3ms).
+#define RX_CAPTURE_BUFFER_SIZE    64
+
+static uint16_t rxCaptureBuffer[RX_CAPTURE_BUFFER_SIZE];
+static volatile uint32_t rxCaptureDelivered = 0;
+static uint32_t rxCaptureDeliveryCycles = 0;
+irq_callback rxRSSICallback = nullptr;
+#endif
+
 #define EEPROM_ADDRESS  0x50 << 1
 
+// Station data starts at the bottom of the EEPROM, other configuration values live in the upper half
+#define CONFIG_DATA_OFFSET  0x80
+static_assert(sizeof(StationData) <= CONFIG_DATA_OFFSET, "Station data overlaps configuration");
+// The last GNSS fix goes in the top quarter
+#define GNSS_FIX_OFFSET     0xC0
+static_assert(CONFIG_DATA_OFFSET + sizeof(ConfigData) <= GNSS_FIX_OFFSET, "Configuration overlaps GNSS fix");
+static_assert(GNSS_FIX_OFFSET + sizeof(GNSSFixData) <= 0x100, "GNSS fix doesn't fit in the EEPROM");
+
 typedef struct
 {
   GPIO_TypeDef *port;
@@ -60,6 +91,9 @@ static const GPIO __gpios[] = {
     {RX_EVT_PORT, {RX_EVT_PIN, GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
     {GNSS_1PPS_PORT, {GNSS_1PPS_PIN, GPIO_MODE_IT_FALLING, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
     {GNSS_NMEA_RX_PORT, {GNSS_NMEA_RX_PIN, GPIO_MODE_AF_PP, GPIO_PULLUP, GPIO_SPEED_LOW, GPIO_AF7_USART2}, GPIO_PIN_RESET},
+#ifdef GNSS_NMEA_TX_PIN
+    {GNSS_NMEA_TX_PORT, {GNSS_NMEA_TX_PIN, GPIO_MODE_AF_PP, GPIO_PULLUP, GPIO_SPEED_LOW, GPIO_AF7_USART2}, GPIO_PIN_RESET},
+#endif
     {CS1_PORT, {CS1_PIN, GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_HIGH, 0}, GPIO_PIN_SET},
     {SCK_PORT, {SCK_PIN, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_HIGH, GPIO_AF5_SPI1}, GPIO_PIN_SET},
     {MISO_PORT, {MISO_PIN, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_HIGH, GPIO_AF5_SPI1}, GPIO_PIN_SET},
@@ -71,7 +105,11 @@ static const GPIO __gpios[] = {
     {UART_RX_PORT, {UART_RX_PIN, GPIO_MODE_AF_PP, GPIO_PULLUP, GPIO_SPEED_LOW, GPIO_AF7_USART1}, GPIO_PIN_RESET},
     {GNSS_STATE_PORT, {GNSS_STATE_PIN, GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
     {SDN2_PORT, {SDN2_PIN, GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_SET},
+#if RX_IC_CAPTURE
+    {RX_IC_CLK_PORT, {RX_IC_CLK_PIN, GPIO_MODE_AF_PP, GPIO_NOPULL, GPIO_SPEED_LOW, GPIO_AF1_TIM2}, GPIO_PIN_RESET},
+#else
     {RX_IC_CLK_PORT, {RX_IC_CLK_PIN, GPIO_MODE_IT_RISING, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
+#endif
     {RX_IC_DATA_PORT, {RX_IC_DATA_PIN, GPIO_MODE_INPUT, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
     {TX_CTRL_PORT, {TX_CTRL_PIN, GPIO_MODE_OUTPUT_PP, GPIO_NOPULL, GPIO_SPEED_LOW, 0}, GPIO_PIN_RESET},
     {I2C_SCL_PORT, {I2C_SCL_PIN, GPIO_MODE_AF_OD, GPIO_PULLUP, GPIO_SPEED_HIGH, GPIO_AF4_I2C1}, GPIO_PIN_SET},
@@ -92,11 +130,36 @@ extern "C"
 
 void gpio_pin_init();
 
+static reset_cause resetCause = RESET_COLD;
+static uint32_t rebootUptime = 0;
+
+// Written by bsp_reboot() right before the reset, with its complement to tell it from whatever RAM powers up with
+static uint32_t rebootRecord[2] __attribute__((section(".noinit")));
+
+#if RX_IC_CAPTURE
+void rx_capture_init();
+#endif
+
 void bsp_hw_init()
 {
+  if ( __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) )
+    resetCause = RESET_WATCHDOG;
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST) )
+    resetCause = RESET_SOFTWARE;
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+
+  if ( resetCause == RESET_SOFTWARE && rebootRecord[1] == ~rebootRecord[0] )
+    rebootUptime = rebootRecord[0];
+  rebootRecord[1] = 0;
+
   HAL_Init();
   SystemClock_Config();
 
+  // The DWT cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
   __HAL_RCC_GPIOC_CLK_ENABLE();
@@ -106,6 +169,7 @@ void bsp_hw_init()
   __HAL_RCC_SPI1_CLK_ENABLE();
   __HAL_RCC_TIM2_CLK_ENABLE();
   __HAL_RCC_I2C1_CLK_ENABLE();
+  __HAL_RCC_CRC_CLK_ENABLE();
 
   gpio_pin_init();
 
@@ -113,7 +177,7 @@ void bsp_hw_init()
 
   // USART1 (main UART)
   huart1.Instance                     = USART1;
-  huart1.Init.BaudRate                = 38400;
+  huart1.Init.BaudRate                = TERMINAL_BAUD_RATE;
   huart1.Init.WordLength              = UART_WORDLENGTH_8B;
   huart1.Init.StopBits                = UART_STOPBITS_1;
   huart1.Init.Parity                  = UART_PARITY_NONE;
@@ -128,6 +192,28 @@ void bsp_hw_init()
   HAL_NVIC_EnableIRQ(USART1_IRQn);
   __HAL_UART_ENABLE_IT(&huart1, UART_IT_RXNE);
 
+  // DMA for USART1 TX
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  hdma_usart1_tx.Instance                 = DMA1_Channel4;
+  hdma_usart1_tx.Init.Request             = DMA_REQUEST_2;
+  hdma_usart1_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_usart1_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_usart1_tx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_usart1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_usart1_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdma_usart1_tx.Init.Mode                = DMA_NORMAL;
+  hdma_usart1_tx.Init.Priority            = DMA_PRIORITY_LOW;
+  if (HAL_DMA_Init(&hdma_usart1_tx) != HAL_OK)
+    {
+      Error_Handler(0);
+    }
+
+  DMA1_Channel4->CPAR = (uint32_t)&USART1->TDR;
+  SET_BIT(USART1->CR3, USART_CR3_DMAT);
+
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 7, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+
 
   // SPI
 
@@ -154,9 +240,9 @@ void bsp_hw_init()
   __HAL_SPI_ENABLE(&hspi1);
 
 
-  // USART2 (GNSS, RX only)
+  // USART2 (GNSS, RX only unless the board has GNSS_NMEA_TX_PIN)
   huart2.Instance                     = USART2;
-  huart2.Init.BaudRate                = 9600;
+  huart2.Init.BaudRate                = GNSS_DEFAULT_BAUD_RATE;
   huart2.Init.WordLength              = UART_WORDLENGTH_8B;
   huart2.Init.StopBits                = UART_STOPBITS_1;
   huart2.Init.Parity                  = UART_PARITY_NONE;
@@ -181,9 +267,15 @@ void bsp_hw_init()
   htim2.Init.CounterMode       = TIM_COUNTERMODE_UP;
   htim2.Init.Period            = period;
   htim2.Init.RepetitionCounter = 0;
+  // Slot lengths are trimmed one slot ahead, so period changes must wait for the update event
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
 
   HAL_TIM_Base_Init(&htim2);
 
+#if RX_IC_CAPTURE
+  rx_capture_init();
+#endif
+
   // I2C
   hi2c1.Instance = I2C1;
   hi2c1.Init.Timing = 0x00702991;
@@ -223,8 +315,10 @@ void bsp_hw_init()
   HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
 
+#if !RX_IC_CAPTURE
   HAL_NVIC_SetPriority(EXTI3_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(EXTI3_IRQn);
+#endif
 
   // This is our HAL tick timer now
   HAL_NVIC_SetPriority(TIM6_DAC_IRQn, 0, 0);
@@ -304,15 +398,114 @@ void gpio_pin_init()
   for ( unsigned i = 0; i < sizeof __gpios / sizeof(GPIO); ++i )
     {
       const GPIO* io = &__gpios[i];
-      HAL_GPIO_Init(io->port, (GPIO_InitTypeDef*)&io->gpio);
       if ( io->gpio.Mode == GPIO_MODE_OUTPUT_PP || io->gpio.Mode == GPIO_MODE_OUTPUT_OD )
         {
-          HAL_GPIO_WritePin(io->port, io->gpio.Pin, io->init);
+          // Set the level first, so that the GNSS stays powered (and keeps its fix) through a warm reset
+          GPIO_PinState state = io->init;
+          if ( io->port == GNSS_EN_PORT && io->gpio.Pin == GNSS_EN_PIN && resetCause != RESET_COLD )
+            state = GPIO_PIN_SET;
+          HAL_GPIO_WritePin(io->port, io->gpio.Pin, state);
         }
+      HAL_GPIO_Init(io->port, (GPIO_InitTypeDef*)&io->gpio);
 
     }
 }
 
+#if RX_IC_CAPTURE
+void rx_capture_init()
+{
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  // TIM2 channel 2 captures the rising edges of the RX IC clock and each one triggers a DMA read of the data port
+  TIM_IC_InitTypeDef ic;
+  ic.ICPolarity   = TIM_ICPOLARITY_RISING;
+  ic.ICSelection  = TIM_ICSELECTION_DIRECTTI;
+  ic.ICPrescaler  = TIM_ICPSC_DIV1;
+  ic.ICFilter     = 0;
+  HAL_TIM_IC_ConfigChannel(&htim2, &ic, TIM_CHANNEL_2);
+
+  // TIM2 channel 3 marks the bit period in every slot when the RX IC's RSSI is read (see bsp_set_rx_rssi_callback())
+  TIM_OC_InitTypeDef oc;
+  memset(&oc, 0, sizeof oc);
+  oc.OCMode       = TIM_OCMODE_TIMING;
+  oc.Pulse        = 0;
+  oc.OCPolarity   = TIM_OCPOLARITY_HIGH;
+  oc.OCFastMode   = TIM_OCFAST_DISABLE;
+  HAL_TIM_OC_ConfigChannel(&htim2, &oc, TIM_CHANNEL_3);
+
+  hdma_tim2_ch2.Instance                  = DMA1_Channel7;
+  hdma_tim2_ch2.Init.Request              = DMA_REQUEST_4;
+  hdma_tim2_ch2.Init.Direction            = DMA_PERIPH_TO_MEMORY;
+  hdma_tim2_ch2.Init.PeriphInc            = DMA_PINC_DISABLE;
+  hdma_tim2_ch2.Init.MemInc               = DMA_MINC_ENABLE;
+  hdma_tim2_ch2.Init.PeriphDataAlignment  = DMA_PDATAALIGN_HALFWORD;
+  hdma_tim2_ch2.Init.MemDataAlignment     = DMA_MDATAALIGN_HALFWORD;
+  hdma_tim2_ch2.Init.Mode                 = DMA_CIRCULAR;
+  hdma_tim2_ch2.Init.Priority             = DMA_PRIORITY_VERY_HIGH;
+  if (HAL_DMA_Init(&hdma_tim2_ch2) != HAL_OK)
+    {
+      Error_Handler(0);
+    }
+
+  // Batch decoding happens in this interrupt, so it sits below everything else
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 8, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+  __HAL_DMA_ENABLE_IT(&hdma_tim2_ch2, DMA_IT_HT | DMA_IT_TC);
+  HAL_DMA_Start(&hdma_tim2_ch2, (uint32_t)&RX_IC_DATA_PORT->IDR, (uint32_t)rxCaptureBuffer, RX_CAPTURE_BUFFER_SIZE);
+  rxCaptureDeliveryCycles = bsp_get_cycle_count();
+
+  __HAL_TIM_ENABLE_DMA(&htim2, TIM_DMA_CC2);
+  TIM_CCxChannelCmd(TIM2, TIM_CHANNEL_2, TIM_CCx_ENABLE);
+
+  // Captures need a running counter, so TIM2 runs from now on whether the SOTDMA timer is started or not
+  __HAL_TIM_ENABLE(&htim2);
+}
+
+void rx_capture_deliver()
+{
+  uint32_t head = (RX_CAPTURE_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(&hdma_tim2_ch2)) % RX_CAPTURE_BUFFER_SIZE;
+  uint32_t delivered = rxCaptureDelivered;
+  uint32_t tail = delivered % RX_CAPTURE_BUFFER_SIZE;
+  uint32_t count = (head + RX_CAPTURE_BUFFER_SIZE - tail) % RX_CAPTURE_BUFFER_SIZE;
+
+  /**
+   * The DMA counter only tells where in the buffer the capture is, not how many times it went around since
+   * the last delivery. That comes from the time it took, which is good for half a buffer either way.
+   */
+  uint32_t now = bsp_get_cycle_count();
+  uint32_t bits = (now - rxCaptureDeliveryCycles) / (SystemCoreClock / 9600);
+  rxCaptureDeliveryCycles = now;
+  if ( bits >= count + RX_CAPTURE_BUFFER_SIZE / 2 )
+    {
+      /**
+       * This interrupt was held off for too long and the capture has overwritten samples that were never
+       * delivered. Everything up to the current position is skipped, the next delivery starts from there.
+       */
+      uint32_t laps = (bits - count + RX_CAPTURE_BUFFER_SIZE / 2) / RX_CAPTURE_BUFFER_SIZE;
+      rxCaptureDelivered = delivered + count + laps * RX_CAPTURE_BUFFER_SIZE;
+      return;
+    }
+
+  if ( rxCaptureCallback && count )
+    {
+      if ( tail + count > RX_CAPTURE_BUFFER_SIZE )
+        {
+          // Wrapped around
+          uint32_t n = RX_CAPTURE_BUFFER_SIZE - tail;
+          rxCaptureCallback(&rxCaptureBuffer[tail], n, delivered);
+          rxCaptureCallback(rxCaptureBuffer, count - n, delivered + n);
+        }
+      else
+        {
+          rxCaptureCallback(&rxCaptureBuffer[tail], count, delivered);
+        }
+    }
+
+  rxCaptureDelivered = delivered + count;
+}
+#endif
+
 void HAL_MspInit(void)
 {
   /* USER CODE BEGIN MspInit 0 */
@@ -434,14 +627,148 @@ void bsp_set_terminal_input_callback(char_input_cb cb)
   terminalInputCallback = cb;
 }
 
+void bsp_set_terminal_output_callback(tx_pull_callback cb)
+{
+  terminalOutputCallback = cb;
+}
+
+void bsp_kick_terminal_output()
+{
+  // The DMA interrupt handler is the only place where transfers start
+  HAL_NVIC_SetPendingIRQ(DMA1_Channel4_IRQn);
+}
+
+void bsp_set_terminal_baud_rate(uint32_t rate)
+{
+  // Let the last character out of the shift register, a DMA transfer simply resumes after this
+  uint32_t start = HAL_GetTick();
+  while ( !(USART1->ISR & USART_ISR_TC) && HAL_GetTick() - start < 2 )
+    ;
+
+  __HAL_UART_DISABLE(&huart1);
+  huart1.Init.BaudRate = rate;
+  UART_SetConfig(&huart1);
+  __HAL_UART_ENABLE(&huart1);
+}
+
+bool bsp_gnss_can_transmit()
+{
+#ifdef GNSS_NMEA_TX_PIN
+  return true;
+#else
+  // The only USART2 TX pin (PA2) is the 1PPS input
+  return false;
+#endif
+}
+
+void bsp_write_gnss_string(const char *s)
+{
+  for ( int i = 0; s[i] != 0; ++i )
+    USART_putc(USART2, s[i]);
+
+  while ( !(USART2->ISR & USART_ISR_TC) )
+    ;
+}
+
+void bsp_set_gnss_baud_rate(uint32_t rate)
+{
+  __HAL_UART_DISABLE(&huart2);
+  huart2.Init.BaudRate = rate;
+  UART_SetConfig(&huart2);
+  __HAL_UART_ENABLE(&huart2);
+}
+
+#if GNSS_RX_DMA
+void bsp_start_gnss_rx(char *buffer, uint16_t size, gnss_rx_callback cb)
+{
+  gnssRXSize = size;
+  gnssRXCallback = cb;
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  hdma_usart2_rx.Instance                 = DMA1_Channel6;
+  hdma_usart2_rx.Init.Request             = DMA_REQUEST_2;
+  hdma_usart2_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hdma_usart2_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_usart2_rx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_usart2_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdma_usart2_rx.Init.Mode                = DMA_CIRCULAR;
+  hdma_usart2_rx.Init.Priority            = DMA_PRIORITY_LOW;
+  if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
+    {
+      Error_Handler(0);
+    }
+
+  // Same priority as the USART, so deliveries never preempt each other
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 7, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+
+  __HAL_DMA_ENABLE_IT(&hdma_usart2_rx, DMA_IT_HT | DMA_IT_TC);
+  HAL_DMA_Start(&hdma_usart2_rx, (uint32_t)&USART2->RDR, (uint32_t)buffer, size);
+
+  // Line feeds raise the character match interrupt. The match character can only be changed while the USART is disabled.
+  __HAL_UART_DISABLE(&huart2);
+  MODIFY_REG(USART2->CR2, USART_CR2_ADD, (uint32_t)'\n' << USART_CR2_ADD_Pos);
+  __HAL_UART_ENABLE(&huart2);
+
+  __HAL_UART_DISABLE_IT(&huart2, UART_IT_RXNE);
+  __HAL_UART_CLEAR_FLAG(&huart2, UART_CLEAR_CMF | UART_CLEAR_IDLEF | UART_CLEAR_OREF);
+  __HAL_UART_ENABLE_IT(&huart2, UART_IT_CM);
+  __HAL_UART_ENABLE_IT(&huart2, UART_IT_IDLE);
+  SET_BIT(USART2->CR3, USART_CR3_DMAR);
+}
+
+uint32_t bsp_get_gnss_rx_position()
+{
+  uint32_t head = (gnssRXSize - __HAL_DMA_GET_COUNTER(&hdma_usart2_rx)) % gnssRXSize;
+  uint32_t delivered = gnssRXDelivered;
+  return delivered + (head + gnssRXSize - delivered % gnssRXSize) % gnssRXSize;
+}
+
+void bsp_set_gnss_rx_paused(bool paused)
+{
+  if ( paused )
+    {
+      CLEAR_BIT(USART2->CR3, USART_CR3_DMAR);
+    }
+  else
+    {
+      // Whatever overran while we weren't reading is gone anyway
+      __HAL_UART_CLEAR_FLAG(&huart2, UART_CLEAR_OREF);
+      SET_BIT(USART2->CR3, USART_CR3_DMAR);
+    }
+}
+
+void gnss_rx_deliver()
+{
+  uint32_t position = bsp_get_gnss_rx_position();
+  gnssRXDelivered = position;
+  if ( gnssRXCallback )
+    gnssRXCallback(position);
+}
+#endif
+
 void bsp_start_sotdma_timer()
 {
+  // Restart the count and load the period for the first slot, which starts now
+  TIM2->EGR = TIM_EGR_UG;
+  __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);
+#if RX_IC_CAPTURE
+  // The counter is already running for the RX IC capture
+  __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_CC3);
+  __HAL_TIM_ENABLE_IT(&htim2, TIM_IT_UPDATE | TIM_IT_CC3);
+#else
   HAL_TIM_Base_Start_IT(&htim2);
+#endif
 }
 
 void bsp_stop_sotdma_timer()
 {
+#if RX_IC_CAPTURE
+  __HAL_TIM_DISABLE_IT(&htim2, TIM_IT_UPDATE | TIM_IT_CC3);
+#else
   HAL_TIM_Base_Stop_IT(&htim2);
+#endif
 }
 
 void bsp_set_gnss_1pps_callback(irq_callback cb)
@@ -459,6 +786,31 @@ void bsp_set_rx_clk_callback(irq_callback cb)
   rxClockCallback = cb;
 }
 
+#if RX_IC_CAPTURE
+void bsp_set_rx_capture_callback(capture_callback cb)
+{
+  rxCaptureCallback = cb;
+}
+
+uint32_t bsp_get_rx_capture_position()
+{
+  uint32_t head = (RX_CAPTURE_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(&hdma_tim2_ch2)) % RX_CAPTURE_BUFFER_SIZE;
+  uint32_t delivered = rxCaptureDelivered;
+  return delivered + (head + RX_CAPTURE_BUFFER_SIZE - delivered % RX_CAPTURE_BUFFER_SIZE) % RX_CAPTURE_BUFFER_SIZE;
+}
+
+void bsp_flush_rx_capture()
+{
+  HAL_NVIC_SetPendingIRQ(DMA1_Channel7_IRQn);
+}
+
+void bsp_set_rx_rssi_callback(irq_callback cb, uint32_t bits)
+{
+  __HAL_TIM_SET_COMPARE(&htim2, TIM_CHANNEL_3, bits * (SystemCoreClock / 9600));
+  rxRSSICallback = cb;
+}
+#endif
+
 void bsp_set_gnss_sotdma_timer_callback(irq_callback cb)
 {
   sotdmaCallback = cb;
@@ -474,11 +826,27 @@ void bsp_set_sotdma_timer_value(uint32_t v)
   TIM2->CNT = v;
 }
 
+void bsp_set_sotdma_timer_period(uint32_t counts)
+{
+  // Takes effect at the next update event
+  TIM2->ARR = counts - 1;
+}
+
 uint32_t bsp_get_system_clock()
 {
   return SystemCoreClock;
 }
 
+uint32_t bsp_get_uptime_ms()
+{
+  return HAL_GetTick();
+}
+
+uint32_t bsp_get_cycle_count()
+{
+  return DWT->CYCCNT;
+}
+
 uint8_t bsp_tx_spi_byte(uint8_t data)
 {
   uint8_t result = 0;
@@ -486,6 +854,20 @@ uint8_t bsp_tx_spi_byte(uint8_t data)
   return result;
 }
 
+bool bsp_crc16(const uint8_t *data, uint16_t length, uint16_t &crc)
+{
+  // CCITT polynomial, all ones initial value, reflected input and output. Only ever used from thread context.
+  CRC->POL = 0x1021;
+  CRC->INIT = 0xffff;
+  CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+
+  for ( uint16_t i = 0; i < length; ++i )
+    *(__IO uint8_t*)&CRC->DR = data[i];
+
+  crc = ~CRC->DR & 0xffff;
+  return true;
+}
+
 bool bsp_erase_station_data()
 {
   uint8_t b = 0xff;
@@ -516,9 +898,26 @@ bool bsp_save_station_data(const StationData &data)
 
 void bsp_reboot()
 {
+  // Give pending output (like a response to the command that caused this) a chance to go out
+  uint32_t start = HAL_GetTick();
+  while ( terminalOutputBusy && HAL_GetTick() - start < 250 )
+    ;
+
+  rebootRecord[0] = HAL_GetTick();
+  rebootRecord[1] = ~rebootRecord[0];
   NVIC_SystemReset();
 }
 
+reset_cause bsp_get_reset_cause()
+{
+  return resetCause;
+}
+
+uint32_t bsp_get_reboot_uptime()
+{
+  return rebootUptime;
+}
+
 bool bsp_read_station_data(StationData &data)
 {
   uint8_t *b = (uint8_t*)&data;
@@ -530,6 +929,70 @@ bool bsp_read_station_data(StationData &data)
   return true;
 }
 
+bool bsp_erase_config_data()
+{
+  uint8_t b = 0xff;
+  HAL_Delay(1);
+
+  for ( unsigned i = 0; i < sizeof(ConfigData); ++i )
+    {
+      HAL_I2C_Mem_Write(&hi2c1, EEPROM_ADDRESS, CONFIG_DATA_OFFSET + i, 1, &b, 1, 100);
+      HAL_Delay(6);
+    }
+
+  return true;
+}
+
+bool bsp_save_config_data(const ConfigData &data)
+{
+  HAL_Delay(1);
+
+  uint8_t *b = (uint8_t*)&data;
+  for ( unsigned i = 0; i < sizeof(ConfigData); ++i, ++b )
+    {
+      HAL_I2C_Mem_Write(&hi2c1, EEPROM_ADDRESS, CONFIG_DATA_OFFSET + i, 1, b, 1, 100);
+      HAL_Delay(6);
+    }
+
+  return true;
+}
+
+bool bsp_read_config_data(ConfigData &data)
+{
+  uint8_t *b = (uint8_t*)&data;
+  for ( unsigned i = 0; i < sizeof(ConfigData); ++i, ++b )
+    {
+      HAL_I2C_Mem_Read(&hi2c1, EEPROM_ADDRESS, CONFIG_DATA_OFFSET + i, 1, b, 1, 100);
+    }
+
+  return true;
+}
+
+bool bsp_save_gnss_fix(const GNSSFixData &data)
+{
+  HAL_Delay(1);
+
+  uint8_t *b = (uint8_t*)&data;
+  for ( unsigned i = 0; i < sizeof(GNSSFixData); ++i, ++b )
+    {
+      HAL_I2C_Mem_Write(&hi2c1, EEPROM_ADDRESS, GNSS_FIX_OFFSET + i, 1, b, 1, 100);
+      HAL_Delay(6);
+    }
+
+  return true;
+}
+
+bool bsp_read_gnss_fix(GNSSFixData &data)
+{
+  uint8_t *b = (uint8_t*)&data;
+  for ( unsigned i = 0; i < sizeof(GNSSFixData); ++i, ++b )
+    {
+      HAL_I2C_Mem_Read(&hi2c1, EEPROM_ADDRESS, GNSS_FIX_OFFSET + i, 1, b, 1, 100);
+    }
+
+  return true;
+}
+
 bool bsp_is_tx_disabled()
 {
   return HAL_GPIO_ReadPin(TX_DISABLE_PORT, TX_DISABLE_PIN) == GPIO_PIN_RESET;
@@ -577,6 +1040,31 @@ extern "C"
       }
   }
 
+  void DMA1_Channel4_IRQHandler(void)
+  {
+    if ( __HAL_DMA_GET_FLAG(&hdma_usart1_tx, DMA_FLAG_TC4) )
+      {
+        __HAL_DMA_CLEAR_FLAG(&hdma_usart1_tx, DMA_FLAG_GL4);
+        terminalOutputBusy = false;
+      }
+
+    // Either the last transfer just completed or this was a kick
+    if ( terminalOutputBusy || !terminalOutputCallback )
+      return;
+
+    const char *data = nullptr;
+    uint16_t length = terminalOutputCallback(&data);
+    if ( length == 0 )
+      return;
+
+    terminalOutputBusy = true;
+    __HAL_DMA_DISABLE(&hdma_usart1_tx);
+    DMA1_Channel4->CMAR = (uint32_t)data;
+    DMA1_Channel4->CNDTR = length;
+    __HAL_DMA_ENABLE_IT(&hdma_usart1_tx, DMA_IT_TC);
+    __HAL_DMA_ENABLE(&hdma_usart1_tx);
+  }
+
   void EXTI2_IRQHandler(void)
   {
     if ( __HAL_GPIO_EXTI_GET_IT(GPIO_PIN_2) != RESET )
@@ -589,6 +1077,17 @@ extern "C"
 
   void USART2_IRQHandler()
   {
+#if GNSS_RX_DMA
+    /*
+     * A match interrupt may come before the DMA has moved the line feed, in which case the line goes out
+     * with the next one. The idle interrupt makes sure that the last line of a burst isn't kept waiting.
+     */
+    if ( __HAL_UART_GET_FLAG(&huart2, UART_FLAG_CMF) || __HAL_UART_GET_FLAG(&huart2, UART_FLAG_IDLE) )
+      {
+        __HAL_UART_CLEAR_FLAG(&huart2, UART_CLEAR_CMF | UART_CLEAR_IDLEF);
+        gnss_rx_deliver();
+      }
+#else
     if ( __HAL_UART_GET_IT(&huart2, UART_IT_RXNE) )
       {
         __HAL_UART_CLEAR_IT(&huart2, UART_IT_RXNE);
@@ -596,6 +1095,7 @@ extern "C"
         if ( gnssInputCallback )
           gnssInputCallback(c);
       }
+#endif
   }
 
 
@@ -610,8 +1110,28 @@ extern "C"
               sotdmaCallback();
           }
       }
+#if RX_IC_CAPTURE
+    if(__HAL_TIM_GET_FLAG(&htim2, TIM_FLAG_CC3) != RESET)
+      {
+        if(__HAL_TIM_GET_IT_SOURCE(&htim2, TIM_IT_CC3) !=RESET)
+          {
+            __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_CC3);
+            if ( rxRSSICallback )
+              rxRSSICallback();
+          }
+      }
+#endif
   }
 
+#if GNSS_RX_DMA
+  void DMA1_Channel6_IRQHandler(void)
+  {
+    // Half and full transfer just make sure nothing is overwritten before it's delivered
+    __HAL_DMA_CLEAR_FLAG(&hdma_usart2_rx, DMA_FLAG_GL6);
+    gnss_rx_deliver();
+  }
+#endif
+
   void EXTI3_IRQHandler(void)
   {
     if ( __HAL_GPIO_EXTI_GET_IT(GPIO_PIN_3) != RESET )
@@ -622,6 +1142,15 @@ extern "C"
       }
   }
 
+#if RX_IC_CAPTURE
+  void DMA1_Channel7_IRQHandler(void)
+  {
+    // The half and full transfer interrupts are just wake-up calls, everything captured so far gets delivered
+    __HAL_DMA_CLEAR_FLAG(&hdma_tim2_ch2, DMA_FLAG_GL7);
+    rx_capture_deliver();
+  }
+#endif
+
   void EXTI15_10_IRQHandler(void)
   {
     if ( __HAL_GPIO_EXTI_GET_IT(GPIO_PIN_15) != RESET )
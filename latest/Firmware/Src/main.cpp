@@ -29,6 +29,8 @@
 #include "bsp.hpp"
 #include "printf_serial.h"
 #include "Stats.hpp"
+#include "WarmState.hpp"
+#include "TimeOutput.hpp"
 
 
 #ifdef RTOS
@@ -57,6 +59,8 @@ void jump_to_bootloader()
 
 void mainTask(void *params)
 {
+  // Before anything that picks up where it left off before a reset
+  WarmState::instance().init();
   EventPool::instance().init();
   EventQueue::instance().init();
   Configuration::instance().init();
@@ -69,6 +73,9 @@ void mainTask(void *params)
 #if not defined CALIBRATION_MODE && not defined TX_TEST_MODE
   GPS::instance().init();
   GPS::instance().enable();
+#if TIME_OUTPUT
+  TimeOutput::instance().init();
+#endif
 #endif
 
 
@@ -84,6 +91,10 @@ void mainTask(void *params)
   while (1)
     {
       EventQueue::instance().dispatch();
+      DataTerminal::instance().poll();
+#if not defined CALIBRATION_MODE && not defined TX_TEST_MODE
+      GPS::instance().poll();
+#endif
 #ifdef RTOS
       vTaskDelay(10);
 #endif
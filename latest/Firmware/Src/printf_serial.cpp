@@ -55,7 +55,7 @@ void printf_serial(const char *format, ...)
         {
           va_list list;
           va_start(list, format);
-          vsnprintf(e->debugMessage.buffer, sizeof e->debugMessage, format, list);
+          vsnprintf(e->debugMessage->buffer, sizeof e->debugMessage->buffer, format, list);
           va_end(list);
 
           EventQueue::instance().push(e);
@@ -68,9 +68,9 @@ void printf_serial(const char *format, ...)
       vsnprintf(__buffer, sizeof __buffer, format, list);
       va_end(list);
 #ifdef MULTIPLEXED_OUTPUT
-      DataTerminal::instance().write("DEBUG", __buffer);
+      DataTerminal::instance().write("DEBUG", __buffer, PRIORITY_PROPRIETARY);
 #else
-      bsp_write_string(__buffer);
+      DataTerminal::instance().write(__buffer, PRIORITY_PROPRIETARY);
 #endif
     }
 }
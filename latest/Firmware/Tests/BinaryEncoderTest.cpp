@@ -0,0 +1,263 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "BinaryEncoder.hpp"
+#include "BinaryDecoder.hpp"
+#include "AISChannels.h"
+#include <random>
+#include <string>
+
+
+// A whole frame: the delimiter comes last and nowhere else
+static bool isFrame(const uint8_t *buffer, uint16_t length)
+{
+  if ( length < 2 || buffer[length - 1] != 0 )
+    return false;
+  for ( uint16_t i = 0; i < length - 1; ++i )
+    {
+      if ( buffer[i] == 0 )
+        return false;
+    }
+  return true;
+}
+
+/*
+ * Packets of every size the receiver accepts, with zero bytes in them often enough to exercise COBS.
+ * The record carries the payload without its FCS, padded to a whole byte.
+ */
+static void testAISRoundTrip()
+{
+  std::mt19937 rng(1);
+  unsigned mismatches = 0, badFrames = 0;
+
+  for ( int n = 0; n < 20000; ++n )
+    {
+      RXPacket packet;
+      uint16_t bytes = 3 + rng() % (MAX_AIS_RX_PACKET_SIZE / 8 - 3);
+      for ( uint16_t i = 0; i < bytes; ++i )
+        packet.addByte(rng() % 4 ? rng() : 0);
+      packet.setChannel(rng() & 1 ? CH_87 : CH_88);
+      packet.setSlot(rng() % 2250);
+      packet.setRSSI(rng());
+
+      RXPacket expected = packet;
+      expected.discardCRC();
+
+      uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+      uint16_t length = BinaryEncoder::encode(packet, buffer, sizeof buffer);
+      if ( !isFrame(buffer, length) )
+        {
+          ++badFrames;
+          continue;
+        }
+
+      BinaryDecoder::Record r;
+      bool ok = BinaryDecoder::decode(buffer, length - 1, r) && r.type == RECORD_AIS
+          && r.channel == AIS_CHANNELS[expected.channel()].itu && r.slot == expected.slot()
+          && r.rssi == expected.rssi() && r.bits == expected.size() && r.payload.size() == (r.bits + 7u) / 8;
+
+      for ( uint16_t pos = 0; ok && pos < r.bits; ++pos )
+        ok = ((r.payload[pos / 8] >> (7 - pos % 8)) & 1) == expected.bit(pos);
+
+      if ( !ok )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, badFrames);
+  CHECK_EQUAL(0, mismatches);
+}
+
+static void testGNSSRoundTrip()
+{
+  std::mt19937 rng(2);
+  unsigned mismatches = 0;
+
+  for ( int n = 0; n < 10000; ++n )
+    {
+      GPSFix fix;
+      fix.utc = rng();
+      fix.lat = (int32_t)(rng() % 108000001) - 54000000;
+      fix.lng = (int32_t)(rng() % 216000001) - 108000000;
+      fix.speed = rng() % 1024;
+      fix.cog = rng() % 3600;
+      if ( n < 4 )
+        {
+          // Extremes, and every field zero
+          fix.lat = n & 1 ? -54000000 : 0;
+          fix.lng = n & 2 ? -108000000 : 0;
+          fix.utc = fix.speed = fix.cog = 0;
+        }
+
+      uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+      uint16_t length = BinaryEncoder::encode(fix, buffer, sizeof buffer);
+
+      BinaryDecoder::Record r;
+      if ( !isFrame(buffer, length) || !BinaryDecoder::decode(buffer, length - 1, r) || r.type != RECORD_GNSS
+          || r.fix.utc != fix.utc || r.fix.lat != fix.lat || r.fix.lng != fix.lng
+          || r.fix.speed != fix.speed || r.fix.cog != fix.cog )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+}
+
+// Text up to the largest line that fits a record, and nothing beyond it
+static void testTextRoundTrip()
+{
+  std::string text;
+  for ( int i = 0; i < BINARY_FRAME_BUFFER_SIZE; ++i )
+    text += (char)(' ' + i % 95);
+
+  uint16_t longest = 0;
+  unsigned mismatches = 0;
+  for ( uint16_t n = 0; n <= text.size(); ++n )
+    {
+      uint8_t buffer[BINARY_FRAME_BUFFER_SIZE + 4];
+      uint16_t length = BinaryEncoder::encode(text.c_str(), n, buffer, sizeof buffer);
+      if ( !length )
+        continue;
+
+      longest = n;
+      BinaryDecoder::Record r;
+      if ( !isFrame(buffer, length) || !BinaryDecoder::decode(buffer, length - 1, r) || r.type != RECORD_TEXT
+          || r.text != text.substr(0, n) )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK_EQUAL(BINARY_FRAME_BUFFER_SIZE - 3, longest);
+
+  uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+  uint16_t length = BinaryEncoder::encode("$PAISYS,hello\r\n", buffer, sizeof buffer);
+  BinaryDecoder::Record r;
+  CHECK(BinaryDecoder::decode(buffer, length - 1, r));
+  CHECK_STRING("$PAISYS,hello\r\n", r.text.c_str());
+}
+
+// A frame only goes into a buffer that can hold all of it
+static void testSmallBuffer()
+{
+  GPSFix fix = { 1600000000, 22839600, -70897200, 123, 2710 };
+  uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+  uint16_t length = BinaryEncoder::encode(fix, buffer, sizeof buffer);
+  CHECK(length > 0);
+
+  for ( uint16_t size = 0; size < length; ++size )
+    CHECK_EQUAL(0, BinaryEncoder::encode(fix, buffer, size));
+  CHECK_EQUAL(length, BinaryEncoder::encode(fix, buffer, length));
+}
+
+// Every single bit error in a frame gets it rejected
+static void testCorruption()
+{
+  std::mt19937 rng(3);
+  unsigned accepted = 0, frames = 0;
+
+  for ( int n = 0; n < 200; ++n )
+    {
+      RXPacket packet;
+      uint16_t bytes = 3 + rng() % 30;
+      for ( uint16_t i = 0; i < bytes; ++i )
+        packet.addByte(rng());
+
+      uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+      uint16_t length = BinaryEncoder::encode(packet, buffer, sizeof buffer);
+      for ( uint16_t i = 0; i < length - 1; ++i )
+        {
+          for ( int b = 0; b < 8; ++b )
+            {
+              uint8_t frame[BINARY_FRAME_BUFFER_SIZE];
+              memcpy(frame, buffer, length);
+              frame[i] ^= 1 << b;
+
+              BinaryDecoder::Record r;
+              ++frames;
+              if ( BinaryDecoder::decode(frame, length - 1, r) )
+                ++accepted;
+            }
+        }
+    }
+
+  CHECK(frames > 10000);
+  CHECK_EQUAL(0, accepted);
+}
+
+// Frames of every kind back to back, as they come off the UART, with stray delimiters in between
+static void testStream()
+{
+  std::vector<uint8_t> stream(1, 0);
+  uint8_t buffer[BINARY_FRAME_BUFFER_SIZE];
+  GPSFix fix = { 1600000000, 22839600, -70897200, 123, 2710 };
+  RXPacket packet;
+  for ( uint8_t i = 0; i < 20; ++i )
+    packet.addByte(i * 37);
+
+  for ( int n = 0; n < 100; ++n )
+    {
+      uint16_t length = 0;
+      switch ( n % 3 )
+        {
+        case 0:
+          length = BinaryEncoder::encode(fix, buffer, sizeof buffer);
+          break;
+        case 1:
+          length = BinaryEncoder::encode(packet, buffer, sizeof buffer);
+          break;
+        default:
+          length = BinaryEncoder::encode("$PAISYS,hello\r\n", buffer, sizeof buffer);
+          break;
+        }
+      stream.insert(stream.end(), buffer, buffer + length);
+      if ( n % 7 == 0 )
+        stream.push_back(0);
+    }
+
+  BinaryDecoder decoder;
+  unsigned records[4] = { 0, 0, 0, 0 }, bad = 0;
+  for ( uint8_t b : stream )
+    {
+      if ( !decoder.addByte(b) )
+        continue;
+
+      BinaryDecoder::Record r;
+      if ( BinaryDecoder::decode(decoder.frame().data(), decoder.frame().size(), r) )
+        ++records[r.type];
+      else
+        ++bad;
+    }
+
+  CHECK_EQUAL(0, bad);
+  CHECK_EQUAL(34, records[RECORD_GNSS]);
+  CHECK_EQUAL(33, records[RECORD_AIS]);
+  CHECK_EQUAL(33, records[RECORD_TEXT]);
+}
+
+int main()
+{
+  testAISRoundTrip();
+  testGNSSRoundTrip();
+  testTextRoundTrip();
+  testSmallBuffer();
+  testCorruption();
+  testStream();
+  return testResult("BinaryEncoderTest");
+}
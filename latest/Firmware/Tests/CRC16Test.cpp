@@ -0,0 +1,104 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "CRC16.hpp"
+#include <random>
+#include <vector>
+
+
+// CRC-16/X.25 the way the bits go over the air: LSB first, reflected polynomial
+static uint16_t bitwiseFCS(const uint8_t *data, size_t length)
+{
+  uint16_t crc = 0xffff;
+  for ( size_t i = 0; i < length; ++i )
+    {
+      for ( int b = 0; b < 8; ++b )
+        {
+          if ( ((data[i] >> b) ^ crc) & 1 )
+            crc = (crc >> 1) ^ 0x8408;
+          else
+            crc >>= 1;
+        }
+    }
+  return ~crc;
+}
+
+static uint16_t tableFCS(const uint8_t *data, size_t length)
+{
+  uint16_t crc = CRC16::INITIAL_VALUE;
+  for ( size_t i = 0; i < length; ++i )
+    crc = CRC16::update(crc, data[i]);
+  return ~crc;
+}
+
+// Published check values of CRC-16/X.25
+static void testVectors()
+{
+  const uint8_t *check = (const uint8_t*)"123456789";
+  CHECK_EQUAL(0x906e, tableFCS(check, 9));
+  CHECK_EQUAL(0x906e, CRC16::compute(check, 9));
+  CHECK_EQUAL(0x906e, bitwiseFCS(check, 9));
+
+  CHECK_EQUAL(0x0000, tableFCS(check, 0));
+  CHECK_EQUAL(0x0000, CRC16::compute(check, 0));
+}
+
+/*
+ * The table, the hardware CRC unit (compute() goes through bsp_crc16(), built with HARDWARE_CRC) and
+ * the bitwise definition must agree on everything, and a frame followed by its own FCS must leave
+ * GOOD_RESIDUE behind, which is what RXPacket checks received frames against.
+ */
+static void testRandomFrames()
+{
+  std::mt19937 rng(1);
+  for ( int n = 0; n < 5000; ++n )
+    {
+      std::vector<uint8_t> frame(rng() % 70);
+      for ( uint8_t &b : frame )
+        b = rng();
+
+      uint16_t fcs = bitwiseFCS(frame.data(), frame.size());
+      CHECK_EQUAL(fcs, tableFCS(frame.data(), frame.size()));
+      CHECK_EQUAL(fcs, CRC16::compute(frame.data(), frame.size()));
+
+      // The FCS goes out low byte first
+      frame.push_back(fcs & 0xff);
+      frame.push_back(fcs >> 8);
+      uint16_t crc = CRC16::INITIAL_VALUE;
+      for ( uint8_t b : frame )
+        crc = CRC16::update(crc, b);
+      CHECK_EQUAL(CRC16::GOOD_RESIDUE, crc);
+
+      // Any single bit error must show
+      frame[rng() % frame.size()] ^= 1 << (rng() % 8);
+      crc = CRC16::INITIAL_VALUE;
+      for ( uint8_t b : frame )
+        crc = CRC16::update(crc, b);
+      CHECK(crc != CRC16::GOOD_RESIDUE);
+    }
+}
+
+int main()
+{
+  testVectors();
+  testRandomFrames();
+  return testResult("CRC16Test");
+}
@@ -0,0 +1,166 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "CivilTime.hpp"
+#include <random>
+
+
+static bool sameTime(const struct tm &a, const struct tm &b)
+{
+  return a.tm_sec == b.tm_sec && a.tm_min == b.tm_min && a.tm_hour == b.tm_hour && a.tm_mday == b.tm_mday
+      && a.tm_mon == b.tm_mon && a.tm_year == b.tm_year && a.tm_wday == b.tm_wday && a.tm_yday == b.tm_yday;
+}
+
+// Both ways against timegm() and gmtime_r(), which count the same proleptic Gregorian days
+static bool matchesLibc(time_t utc)
+{
+  struct tm expected, actual;
+  if ( !gmtime_r(&utc, &expected) )
+    return false;
+
+  CivilTime::fromUTC(utc, actual);
+  if ( !sameTime(expected, actual) || actual.tm_isdst != 0 )
+    return false;
+
+  time_t back = CivilTime::toUTC(actual.tm_year + 1900, actual.tm_mon + 1, actual.tm_mday,
+                                 actual.tm_hour, actual.tm_min, actual.tm_sec);
+  return back == utc && timegm(&expected) == utc;
+}
+
+/*
+ * Every day from 1900 to 2400, which takes in the 1900 and 2100 non-leap years as well as 2000 and 2400,
+ * at a different time of day each.
+ */
+static void testEveryDay()
+{
+  unsigned mismatches = 0, days = 0;
+  time_t start = CivilTime::toUTC(1900, 1, 1, 0, 0, 0);
+  time_t end = CivilTime::toUTC(2400, 12, 31, 0, 0, 0);
+
+  for ( time_t utc = start; utc <= end; utc += 86400, ++days )
+    {
+      if ( !matchesLibc(utc + days * 7919 % 86400) )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK_EQUAL(182987, days);
+}
+
+// Every second either side of midnight at the ends of February, the year and the epoch
+static void testBoundaries()
+{
+  static const int32_t years[] = { 1600, 1900, 1969, 1970, 1999, 2000, 2024, 2038, 2100, 2106, 2400 };
+  unsigned mismatches = 0;
+
+  for ( int32_t year : years )
+    {
+      time_t marks[] = { CivilTime::toUTC(year, 2, 28, 0, 0, 0), CivilTime::toUTC(year, 3, 1, 0, 0, 0),
+                         CivilTime::toUTC(year, 12, 31, 0, 0, 0), CivilTime::toUTC(year + 1, 1, 1, 0, 0, 0) };
+      for ( time_t mark : marks )
+        {
+          for ( time_t utc = mark - 86400; utc < mark + 86400; ++utc )
+            {
+              if ( !matchesLibc(utc) )
+                ++mismatches;
+            }
+        }
+    }
+
+  CHECK_EQUAL(0, mismatches);
+
+  CHECK_EQUAL(0, CivilTime::toUTC(1970, 1, 1, 0, 0, 0));
+  CHECK_EQUAL(951782400, CivilTime::toUTC(2000, 2, 29, 0, 0, 0));
+  CHECK_EQUAL(0x7fffffff, CivilTime::toUTC(2038, 1, 19, 3, 14, 7));
+  CHECK_EQUAL(CivilTime::toUTC(2100, 3, 1, 0, 0, 0) - 86400, CivilTime::toUTC(2100, 2, 28, 0, 0, 0));
+
+  // A leap second reads as the first second of the next minute
+  CHECK_EQUAL(CivilTime::toUTC(2017, 1, 1, 0, 0, 0), CivilTime::toUTC(2016, 12, 31, 23, 59, 60));
+}
+
+// Random times over everything the day count can hold, well beyond any date a GNSS can report
+static void testFullRange()
+{
+  std::mt19937_64 rng(1);
+  unsigned mismatches = 0, daysMismatches = 0;
+
+  for ( int i = 0; i < 1000000; ++i )
+    {
+      time_t utc = (time_t)(int64_t)(rng() % (2 * 5000000ULL * 86400)) - 5000000LL * 86400;
+      if ( !matchesLibc(utc) )
+        ++mismatches;
+    }
+
+  for ( int64_t days = -5000000; days <= 5000000; days += 997 )
+    {
+      int32_t year;
+      uint32_t month, day;
+      CivilTime::civilFromDays(days, year, month, day);
+      if ( CivilTime::daysFromCivil(year, month, day) != days || month < 1 || month > 12 || day < 1 || day > 31 )
+        ++daysMismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK_EQUAL(0, daysMismatches);
+
+  // The whole of a 32-bit time_t, as the target may have one
+  CHECK(matchesLibc(INT32_MIN));
+  CHECK(matchesLibc(INT32_MAX));
+  CHECK(matchesLibc(-1));
+}
+
+static void benchmark()
+{
+  const int count = 1000000;
+  volatile int sink = 0;
+
+  uint64_t start = hostCycles();
+  for ( int i = 0; i < count; ++i )
+    {
+      time_t utc = 1600000000 + (time_t)i * 3607;
+      struct tm t;
+      gmtime_r(&utc, &t);
+      sink = sink + timegm(&t);
+    }
+  double before = double(hostCycles() - start) / count;
+
+  start = hostCycles();
+  for ( int i = 0; i < count; ++i )
+    {
+      time_t utc = 1600000000 + (time_t)i * 3607;
+      struct tm t;
+      CivilTime::fromUTC(utc, t);
+      sink = sink + CivilTime::toUTC(t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    }
+  double after = double(hostCycles() - start) / count;
+
+  printf("Converting to a date and back: %.0f host cycles with libc, %.0f with CivilTime\n", before, after);
+}
+
+int main()
+{
+  testEveryDay();
+  testBoundaries();
+  testFullRange();
+  benchmark();
+  return testResult("CivilTimeTest");
+}
@@ -0,0 +1,270 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "bsp_host.hpp"
+#include "DataTerminal.hpp"
+#include "Stats.hpp"
+#include "GNSSInput.hpp"
+#include <string>
+#include <vector>
+
+
+Stats::Stats()
+{
+}
+
+Stats &Stats::instance()
+{
+  static Stats __instance;
+  return __instance;
+}
+
+void Stats::processEvent(const Event &)
+{
+}
+
+GNSSInput &GNSSInput::instance()
+{
+  static GNSSInput *__instance = nullptr;
+  return *__instance;
+}
+
+void GNSSInput::release(const GNSSSlice &)
+{
+}
+
+// A made up AIS sentence of typical length, numbered so lost or garbled lines show
+static std::string aisLine(int n)
+{
+  char line[100];
+  snprintf(line, sizeof line, "!AIVDM,1,1,,A,%05d3wk?8mP00000000000000000000000000000000000000,0*00\r\n", n % 100000);
+  return line;
+}
+
+// Lets everything queued go out, a full buffer takes well under a second
+static void drain()
+{
+  for ( int i = 0; i < 1000; ++i )
+    host_advance_us(1000);
+}
+
+static void resetOutput()
+{
+  drain();
+  host_terminal_output().clear();
+  host_terminal_output_times().clear();
+  Stats::instance().terminalTXOverflows = 0;
+  Stats::instance().terminalTXHighWater = 0;
+}
+
+/*
+ * Writing must return at once, with the output going out in the background at the line rate
+ */
+static void testLineRate()
+{
+  resetOutput();
+  std::string expected;
+  uint64_t start = host_uptime_us();
+  for ( int i = 0; i < 10; ++i )
+    {
+      std::string line = aisLine(i);
+      DataTerminal::instance().write(line.c_str(), PRIORITY_AIS);
+      expected += line;
+    }
+  CHECK_EQUAL(start, host_uptime_us());
+  CHECK(host_terminal_output().empty());
+
+  double charUS = 10e6 / host_terminal_baud_rate();
+  unsigned offPace = 0;
+  while ( host_terminal_output().size() < expected.size() )
+    {
+      host_advance_us(1000);
+      // Give or take a character for rounding
+      long due = std::min<long>((host_uptime_us() - start) / charUS, expected.size());
+      if ( labs((long)host_terminal_output().size() - due) > 1 )
+        ++offPace;
+    }
+
+  CHECK_EQUAL(0, offPace);
+  CHECK(host_terminal_output() == expected);
+  CHECK_EQUAL(0, Stats::instance().terminalTXOverflows);
+  CHECK_EQUAL(expected.size(), Stats::instance().terminalTXHighWater);
+}
+
+/*
+ * Lines that don't fit are dropped whole and counted. The rest go out intact and in order.
+ */
+static void testOverflow()
+{
+  resetOutput();
+  std::vector<std::string> lines;
+  for ( int i = 0; i < 40; ++i )
+    {
+      lines.push_back(aisLine(100 + i));
+      DataTerminal::instance().write(lines.back().c_str(), PRIORITY_AIS);
+    }
+
+  drain();
+
+  int overflows = Stats::instance().terminalTXOverflows;
+  CHECK(overflows > 0);
+  CHECK(Stats::instance().terminalTXHighWater < TERMINAL_TX_BUFFER_SIZE);
+
+  // Whatever went out is the first lines that fit, unbroken
+  std::string expected;
+  for ( size_t i = 0; i < lines.size() - overflows; ++i )
+    expected += lines[i];
+  CHECK(host_terminal_output() == expected);
+}
+
+/*
+ * With a backlog, proprietary sentences are shed before AIS
+ */
+static void testShedding()
+{
+  resetOutput();
+
+  // About 170ms worth at 38400 bps
+  for ( int i = 0; i < 8; ++i )
+    DataTerminal::instance().write(aisLine(i).c_str(), PRIORITY_AIS);
+
+  DataTerminal::instance().write("$PAIXXX,1*00\r\n", PRIORITY_PROPRIETARY);
+  DataTerminal::instance().write(aisLine(8).c_str(), PRIORITY_AIS);
+
+  drain();
+
+  CHECK(host_terminal_output().find("$PAIXXX") == std::string::npos);
+  CHECK(host_terminal_output().find(aisLine(8)) != std::string::npos);
+  CHECK_EQUAL(0, Stats::instance().terminalTXOverflows);
+}
+
+// Runs the main loop for the given time, polling every millisecond. Returns when the baud rate was last changed.
+static uint64_t pollFor(uint32_t ms)
+{
+  uint64_t changed = 0;
+  for ( uint32_t i = 0; i < ms; ++i )
+    {
+      uint32_t rate = host_terminal_baud_rate();
+      host_advance_us(1000);
+      DataTerminal::instance().poll();
+      if ( host_terminal_baud_rate() != rate )
+        changed = host_uptime_us();
+    }
+  return changed;
+}
+
+static uint32_t savedBaudRate()
+{
+  ConfigData config;
+  bsp_read_config_data(config);
+  return config.terminalBaudRate;
+}
+
+/*
+ * A new rate is announced at the old one and only takes effect once everything queued before it has gone out.
+ * It's saved when the host confirms it and reverted if it doesn't.
+ */
+static void testBaudRate()
+{
+  resetOutput();
+  uint32_t writes = host_config_data_writes();
+
+  // Not one we support, and nothing changes
+  CHECK(!DataTerminal::instance().requestBaudRate(9600));
+  drain();
+  CHECK(host_terminal_output().find("$PAIBAU,9600,REJECTED*") == 0);
+  CHECK_EQUAL(TERMINAL_BAUD_RATE, host_terminal_baud_rate());
+
+  // A switch with some AIS ahead of it, confirmed
+  resetOutput();
+  std::string expected;
+  for ( int i = 0; i < 4; ++i )
+    {
+      expected += aisLine(i);
+      DataTerminal::instance().write(aisLine(i).c_str(), PRIORITY_AIS);
+    }
+  CHECK(DataTerminal::instance().requestBaudRate(115200));
+  CHECK(!DataTerminal::instance().requestBaudRate(230400));
+
+  uint64_t changed = pollFor(1000);
+  size_t pending = host_terminal_output().find("$PAIBAU,115200,PENDING*");
+  CHECK_EQUAL(expected.size(), pending);
+  CHECK(host_terminal_output().find("$PAIBAU,230400,REJECTED*") != std::string::npos);
+  CHECK_EQUAL(115200, host_terminal_baud_rate());
+
+  // Not before the last character went out at 38400
+  uint64_t lastChar = host_terminal_output_times()[host_terminal_output().size() - 1];
+  CHECK(changed >= lastChar);
+  CHECK(changed <= lastChar + 1000);
+  CHECK_EQUAL(writes, host_config_data_writes());
+
+  DataTerminal::instance().confirmBaudRate();
+  drain();
+  CHECK(host_terminal_output().find("$PAIBAU,115200,CONFIRMED*") != std::string::npos);
+  CHECK_EQUAL(writes + 1, host_config_data_writes());
+  CHECK_EQUAL(115200, savedBaudRate());
+
+  // Confirming twice does nothing
+  DataTerminal::instance().confirmBaudRate();
+  CHECK_EQUAL(writes + 1, host_config_data_writes());
+
+  // Not confirmed in time, so back to the last rate that worked
+  resetOutput();
+  CHECK(DataTerminal::instance().requestBaudRate(460800));
+  changed = pollFor(100);
+  CHECK_EQUAL(460800, host_terminal_baud_rate());
+  pollFor((changed + (TERMINAL_BAUD_CONFIRM_TIMEOUT - 1) * 1000ULL - host_uptime_us()) / 1000);
+  CHECK_EQUAL(460800, host_terminal_baud_rate());
+  pollFor(2);
+  CHECK_EQUAL(115200, host_terminal_baud_rate());
+  drain();
+  CHECK(host_terminal_output().find("$PAIBAU,115200,REVERTED*") != std::string::npos);
+  CHECK_EQUAL(writes + 1, host_config_data_writes());
+  CHECK_EQUAL(115200, savedBaudRate());
+
+  // Under a load that never lets the buffer empty, the switch happens anyway after a while
+  resetOutput();
+  CHECK(DataTerminal::instance().requestBaudRate(TERMINAL_BAUD_RATE));
+  uint64_t start = host_uptime_us();
+  changed = 0;
+  for ( int i = 0; i < 1500 && !changed; ++i )
+    {
+      if ( i % 5 == 0 )
+        DataTerminal::instance().write(aisLine(i).c_str(), PRIORITY_AIS);
+      changed = pollFor(1);
+    }
+  CHECK(changed >= start + 1000000);
+  CHECK(changed <= start + 1002000);
+  DataTerminal::instance().confirmBaudRate();
+  CHECK_EQUAL(TERMINAL_BAUD_RATE, savedBaudRate());
+}
+
+int main()
+{
+  host_erase_eeprom();
+  DataTerminal::instance().init();
+
+  testLineRate();
+  testOverflow();
+  testShedding();
+  testBaudRate();
+  return testResult("DataTerminalTest");
+}
@@ -0,0 +1,347 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+
+#include "Test.hpp"
+#include "bsp_host.hpp"
+#include "EventQueue.hpp"
+#include "Stats.hpp"
+#include "GNSSInput.hpp"
+#include <map>
+#include <vector>
+#include <algorithm>
+
+
+Stats::Stats()
+{
+}
+
+Stats &Stats::instance()
+{
+  static Stats __instance;
+  return __instance;
+}
+
+void Stats::processEvent(const Event &)
+{
+}
+
+GNSSInput &GNSSInput::instance()
+{
+  static GNSSInput *__instance = nullptr;
+  return *__instance;
+}
+
+void GNSSInput::release(const GNSSSlice &)
+{
+}
+
+// Event types that carry nothing the pool has to release
+static const EventType TYPES[] = { GPS_FIX_EVENT, CLOCK_EVENT, AIS_PACKET_EVENT, INTERROGATION_EVENT, DFU_EVENT,
+                                   RSSI_SAMPLE_EVENT };
+static const int TYPE_COUNT = sizeof TYPES / sizeof TYPES[0];
+
+class RecordingConsumer : public EventConsumer
+{
+public:
+  void processEvent(const Event &e)
+  {
+    received.push_back(e.type);
+  }
+
+  std::vector<uint32_t> received;
+};
+
+class CountingConsumer : public EventConsumer
+{
+public:
+  CountingConsumer()
+  : count(0)
+  {
+  }
+
+  void processEvent(const Event &)
+  {
+    ++count;
+  }
+
+  uint32_t count;
+};
+
+/**
+ * EventQueue::dispatch() as it was before the per-type subscriber table: every event visits every consumer
+ * in a map and tests its mask. The queue is the same one, so only delivery differs.
+ */
+class MapDispatcher
+{
+public:
+  void addObserver(EventConsumer *c, uint32_t eventMask)
+  {
+    mConsumers[c] = eventMask;
+  }
+
+  bool push(Event *e)
+  {
+    if ( !mQueue.push(e) )
+      {
+        EventPool::instance().deleteEvent(e);
+        return false;
+      }
+    return true;
+  }
+
+  void dispatch()
+  {
+    Event *e = nullptr;
+    while ( mQueue.pop(e) )
+      {
+        for ( std::map<EventConsumer*, uint32_t>::iterator c = mConsumers.begin(); c != mConsumers.end(); ++c )
+          {
+            if ( c->second & e->type )
+              c->first->processEvent(*e);
+          }
+
+        EventPool::instance().deleteEvent(e);
+      }
+  }
+private:
+  std::map<EventConsumer*, uint32_t> mConsumers;
+  SPSCQueue<Event*, 32> mQueue;
+};
+
+static void pushEvent(EventType type)
+{
+  Event *e = EventPool::instance().newEvent(type);
+  CHECK(e != nullptr);
+  if ( e )
+    CHECK(EventQueue::instance().push(e));
+}
+
+// Every consumer gets exactly the types it asked for, in the order they were pushed
+static void testDelivery()
+{
+  RecordingConsumer a, b, c;
+  EventQueue::instance().addObserver(&a, CLOCK_EVENT);
+  EventQueue::instance().addObserver(&b, CLOCK_EVENT|AIS_PACKET_EVENT|DFU_EVENT);
+  EventQueue::instance().addObserver(&c, RSSI_SAMPLE_EVENT);
+
+  pushEvent(AIS_PACKET_EVENT);
+  pushEvent(DFU_EVENT);
+  pushEvent(AIS_PACKET_EVENT);
+  pushEvent(INTERROGATION_EVENT);
+  EventQueue::instance().dispatch();
+
+  CHECK(a.received.empty());
+  CHECK(b.received == std::vector<uint32_t>({ AIS_PACKET_EVENT, AIS_PACKET_EVENT, DFU_EVENT }));
+  CHECK(c.received.empty());
+
+  // Registering again replaces the mask
+  EventQueue::instance().addObserver(&a, GPS_FIX_EVENT);
+  pushEvent(CLOCK_EVENT);
+  pushEvent(GPS_FIX_EVENT);
+  EventQueue::instance().dispatch();
+  CHECK(a.received == std::vector<uint32_t>({ GPS_FIX_EVENT }));
+  CHECK_EQUAL(4, b.received.size());
+  CHECK_EQUAL(CLOCK_EVENT, b.received.back());
+
+  // A removed consumer gets nothing, and its slot is reused
+  EventQueue::instance().removeObserver(&b);
+  RecordingConsumer d;
+  EventQueue::instance().addObserver(&d, CLOCK_EVENT);
+  pushEvent(CLOCK_EVENT);
+  EventQueue::instance().dispatch();
+  CHECK_EQUAL(4, b.received.size());
+  CHECK(d.received == std::vector<uint32_t>({ CLOCK_EVENT }));
+
+  EventQueue::instance().removeObserver(&a);
+  EventQueue::instance().removeObserver(&c);
+  EventQueue::instance().removeObserver(&d);
+  CHECK_EQUAL(0, EventPool::instance().utilization());
+}
+
+// All sixteen slots can be used, and every consumer of a type gets each event once
+static void testFullTable()
+{
+  CountingConsumer consumers[16];
+  for ( int i = 0; i < 16; ++i )
+    EventQueue::instance().addObserver(&consumers[i], i & 1 ? CLOCK_EVENT : CLOCK_EVENT|GPS_FIX_EVENT);
+
+  pushEvent(CLOCK_EVENT);
+  pushEvent(GPS_FIX_EVENT);
+  EventQueue::instance().dispatch();
+  for ( int i = 0; i < 16; ++i )
+    {
+      CHECK_EQUAL(i & 1 ? 1 : 2, consumers[i].count);
+      EventQueue::instance().removeObserver(&consumers[i]);
+    }
+}
+
+// A clock tick pushed behind a burst of received packets gets delivered first
+static void testLanes()
+{
+  RecordingConsumer r;
+  EventQueue::instance().addObserver(&r, CLOCK_EVENT|AIS_PACKET_EVENT|DFU_EVENT);
+  pushEvent(DFU_EVENT);
+  for ( int i = 0; i < 8; ++i )
+    pushEvent(AIS_PACKET_EVENT);
+  pushEvent(CLOCK_EVENT);
+  EventQueue::instance().dispatch();
+
+  CHECK_EQUAL(10, r.received.size());
+  CHECK_EQUAL(CLOCK_EVENT, r.received.front());
+  CHECK_EQUAL(AIS_PACKET_EVENT, r.received[1]);
+  CHECK_EQUAL(DFU_EVENT, r.received.back());
+  EventQueue::instance().removeObserver(&r);
+}
+
+/**
+ * For timing delivery on its own. Both dispatchers visit consumers in a fixed order: EventQueue in the order
+ * they registered and the map by address. So in an array that's registered in order, the first element is
+ * delivered to first and the last element last, and the time between the two is what fanning out to the
+ * consumers in between took. Queueing happens before and after, and isn't counted.
+ */
+class BenchmarkConsumer : public EventConsumer
+{
+public:
+  typedef enum {
+    COUNT,
+    START,
+    STOP
+  } Role;
+
+  BenchmarkConsumer()
+  : role(COUNT), count(0), start(nullptr), samples(nullptr)
+  {
+  }
+
+  void processEvent(const Event &)
+  {
+    switch ( role )
+      {
+      case START:
+        *start = hostCycles();
+        break;
+      case STOP:
+        samples->push_back(hostCycles() - *start);
+        break;
+      default:
+        ++count;
+        break;
+      }
+  }
+
+  Role role;
+  uint32_t count;
+  uint64_t *start;
+  std::vector<uint64_t> *samples;
+};
+
+static uint64_t median(std::vector<uint64_t> &samples)
+{
+  std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+  return samples[samples.size() / 2];
+}
+
+/*
+ * Median host cycles to deliver an event to a given number of consumers that each take a given number of the
+ * event types. Events of all types go through in turn, so with consumers that take different ones, some events
+ * reach nobody.
+ */
+template<typename Dispatcher> static double deliveryCost(Dispatcher &dispatcher, BenchmarkConsumer *consumers,
+                                                         int consumerCount, int typesEach)
+{
+  static const int ROUNDS = 5000;
+  static const int BATCH = 16;
+
+  uint32_t all = 0;
+  for ( int t = 0; t < TYPE_COUNT; ++t )
+    all |= TYPES[t];
+
+  uint64_t start = 0;
+  std::vector<uint64_t> samples;
+  consumers[0].role = BenchmarkConsumer::START;
+  consumers[consumerCount + 1].role = BenchmarkConsumer::STOP;
+  for ( int i = 0; i < consumerCount + 2; ++i )
+    {
+      consumers[i].start = &start;
+      consumers[i].samples = &samples;
+
+      uint32_t mask = all;
+      if ( consumers[i].role == BenchmarkConsumer::COUNT )
+        {
+          mask = 0;
+          for ( int t = 0; t < typesEach; ++t )
+            mask |= TYPES[(i + t) % TYPE_COUNT];
+        }
+      dispatcher.addObserver(&consumers[i], mask);
+    }
+
+  for ( int round = 0; round < ROUNDS; ++round )
+    {
+      for ( int i = 0; i < BATCH; ++i )
+        dispatcher.push(EventPool::instance().newEvent(TYPES[(round + i) % TYPE_COUNT]));
+      dispatcher.dispatch();
+    }
+
+  CHECK_EQUAL(ROUNDS * BATCH, samples.size());
+  return median(samples);
+}
+
+static void benchmark()
+{
+  static const int consumerCounts[] = { 0, 1, 4, 8, 14 };
+  static const int typeCounts[] = { 1, 3, TYPE_COUNT };
+
+  printf("Delivery in host cycles per event, the median over 80000 events. With 0 consumers, that's just\n"
+         "the cost of timing it.\n");
+  printf("consumers  types each  subscriber table  map\n");
+  for ( int consumerCount : consumerCounts )
+    {
+      for ( int typesEach : typeCounts )
+        {
+          BenchmarkConsumer tableConsumers[16], mapConsumers[16];
+          double table = deliveryCost(EventQueue::instance(), tableConsumers, consumerCount, typesEach);
+          MapDispatcher map;
+          double reference = deliveryCost(map, mapConsumers, consumerCount, typesEach);
+
+          for ( int i = 0; i < consumerCount + 2; ++i )
+            {
+              CHECK_EQUAL(mapConsumers[i].count, tableConsumers[i].count);
+              EventQueue::instance().removeObserver(&tableConsumers[i]);
+            }
+
+          printf("%9d  %10d  %16.0f  %3.0f\n", consumerCount, typesEach, table, reference);
+          if ( !consumerCount )
+            break;
+        }
+    }
+
+  CHECK_EQUAL(0, EventPool::instance().utilization());
+}
+
+int main()
+{
+  testDelivery();
+  testFullTable();
+  testLanes();
+  benchmark();
+  return testResult("EventQueueTest");
+}
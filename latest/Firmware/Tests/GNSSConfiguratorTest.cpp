@@ -0,0 +1,324 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "GNSSConfigurator.hpp"
+#include "Utils.hpp"
+#include "config.h"
+#include <string>
+#include <vector>
+#include <deque>
+
+
+/**
+ * An L70R as far as the configurator can tell: it sends RMC at its fix interval and answers PMTK commands
+ * at whatever baud rate it's at. Anything sent or received at a different rate is lost. Its behaviour can be
+ * changed to test the failure cases, and it doubles as the configurator's delegate.
+ */
+class SimulatedReceiver : public GNSSConfiguratorDelegate
+{
+public:
+  SimulatedReceiver(uint32_t baudRate = GNSS_DEFAULT_BAUD_RATE)
+  : configurator(this), powered(true), ignoreBaudRate(false), silentAcks(0), failedAcks(0), unsupported(0),
+    mBaudRate(baudRate), mUARTRate(0), mFixInterval(1000), mNextFix(0), mNow(0)
+  {
+  }
+
+  void sendGNSSCommand(const char *command)
+  {
+    commands.push_back(command);
+    if ( !powered || mUARTRate != mBaudRate )
+      return;
+
+    NMEASentence sentence(command);
+    if ( !sentence.isValid() )
+      return;
+
+    uint32_t id = sentence.digits(0, 4, 3);
+    if ( id == 251 )
+      {
+        // No acknowledgement, it just changes over
+        if ( !ignoreBaudRate )
+          mBaudRate = sentence.digits(1, 0, sentence.fieldLength(1));
+        return;
+      }
+
+    if ( silentAcks & commandBit(id) )
+      return;
+
+    int flag = 3;
+    if ( unsupported & commandBit(id) )
+      flag = 1;
+    else if ( failedAcks & commandBit(id) )
+      {
+        failedAcks &= ~commandBit(id);
+        flag = 2;
+      }
+    else if ( id == 220 )
+      mFixInterval = sentence.digits(1, 0, sentence.fieldLength(1));
+    else if ( id == 314 )
+      sentences = command;
+
+    char ack[40];
+    sprintf(ack, "$PMTK001,%u,%d*", id, flag);
+    Utils::completeNMEA(ack);
+    mPending.push_back({ mNow + 30, ack });
+  }
+
+  void setGNSSBaudRate(uint32_t rate)
+  {
+    mUARTRate = rate;
+    baudRates.push_back(rate);
+  }
+
+  // Runs for the given time in 1ms steps, the way GPS drives the configurator from its poll() and DMA callback
+  void run(uint32_t ms)
+  {
+    for ( uint32_t end = mNow + ms; mNow < end; ++mNow )
+      {
+        if ( powered && mNow >= mNextFix )
+          {
+            char rmc[80];
+            sprintf(rmc, "$GPRMC,%06u.000,A,3751.6500,N,12224.0000,W,0.00,0.00,170520,,,A*", mNow / 1000);
+            Utils::completeNMEA(rmc);
+            mPending.push_back({ mNow + 5, rmc });
+            mNextFix += mFixInterval;
+          }
+
+        while ( !mPending.empty() && mPending.front().time <= mNow )
+          {
+            std::string line = mPending.front().line;
+            mPending.pop_front();
+
+            // Heard at the wrong rate it's just noise
+            NMEASentence sentence(line.c_str());
+            if ( mUARTRate == mBaudRate && sentence.isValid() )
+              configurator.onSentence(sentence, mNow);
+          }
+
+        configurator.poll(mNow);
+      }
+  }
+
+  // Runs until the configurator is done, returning how long it took
+  uint32_t runToCompletion()
+  {
+    uint32_t start = mNow;
+    while ( configurator.busy() && mNow - start < 60000 )
+      run(1);
+
+    // It finished in the last step
+    return mNow - 1 - start;
+  }
+
+  void start()
+  {
+    configurator.start(mNow);
+  }
+
+  uint32_t baudRate() const
+  {
+    return mBaudRate;
+  }
+
+  uint32_t uartRate() const
+  {
+    return mUARTRate;
+  }
+
+  uint32_t fixInterval() const
+  {
+    return mFixInterval;
+  }
+
+  unsigned count(const char *prefix) const
+  {
+    unsigned n = 0;
+    for ( const std::string &c : commands )
+      n += c.compare(0, strlen(prefix), prefix) == 0;
+    return n;
+  }
+
+  static uint8_t commandBit(uint32_t id)
+  {
+    return id == 314 ? GNSSConfigurator::STEP_SENTENCES : id == 220 ? GNSSConfigurator::STEP_FIX_INTERVAL : 0;
+  }
+public:
+  GNSSConfigurator configurator;
+  bool powered;
+  bool ignoreBaudRate;
+  uint8_t silentAcks;     // Steps whose commands it never answers
+  uint8_t failedAcks;     // Answered with "failed" once
+  uint8_t unsupported;    // Always answered with "unsupported"
+  std::vector<std::string> commands;
+  std::vector<uint32_t> baudRates;
+  std::string sentences;
+private:
+  struct Line
+  {
+    uint32_t time;
+    std::string line;
+  };
+
+  uint32_t mBaudRate;
+  uint32_t mUARTRate;
+  uint32_t mFixInterval;
+  uint32_t mNextFix;
+  uint32_t mNow;
+  std::deque<Line> mPending;
+};
+
+static const uint8_t ALL_STEPS = GNSSConfigurator::STEP_BAUD_RATE | GNSSConfigurator::STEP_SENTENCES
+    | GNSSConfigurator::STEP_FIX_INTERVAL;
+
+// A receiver fresh from power-on takes every step, one at a time
+static void testNormal()
+{
+  SimulatedReceiver r;
+  r.start();
+  CHECK(r.configurator.busy());
+  CHECK(r.commands.empty());
+
+  uint32_t took = r.runToCompletion();
+  CHECK(!r.configurator.busy());
+  CHECK_EQUAL(ALL_STEPS, r.configurator.completedSteps());
+  CHECK_EQUAL(3, r.commands.size());
+  CHECK_EQUAL(1, r.count("$PMTK251,"));
+  CHECK_EQUAL(1, r.count("$PMTK314," GNSS_SENTENCES ","));
+  CHECK_EQUAL(1, r.count("$PMTK220,"));
+  CHECK_EQUAL(GNSS_BAUD_RATE, r.baudRate());
+  CHECK_EQUAL(GNSS_BAUD_RATE, r.uartRate());
+  CHECK_EQUAL(GNSS_BAUD_RATE, r.configurator.baudRate());
+  CHECK_EQUAL(GNSS_FIX_INTERVAL, r.fixInterval());
+  CHECK(r.sentences == r.commands[1]);
+
+  // The first fix, a fix at the new rate and two ACKs
+  CHECK(took > 1000);
+  CHECK(took < 1200);
+}
+
+// One that kept the faster rate on its backup supply is found at that rate, and isn't told it again
+static void testKeptBaudRate()
+{
+  SimulatedReceiver r(GNSS_BAUD_RATE);
+  r.start();
+  r.runToCompletion();
+
+  CHECK_EQUAL(ALL_STEPS, r.configurator.completedSteps());
+  CHECK_EQUAL(0, r.count("$PMTK251,"));
+  CHECK_EQUAL(2, r.commands.size());
+  CHECK_EQUAL(GNSS_FIX_INTERVAL, r.fixInterval());
+  CHECK_EQUAL(GNSS_BAUD_RATE, r.uartRate());
+}
+
+// Nothing goes out to a receiver that never speaks, and the UART is left at the default rate
+static void testNoReceiver()
+{
+  SimulatedReceiver r;
+  r.powered = false;
+  r.start();
+  uint32_t took = r.runToCompletion();
+
+  CHECK(!r.configurator.busy());
+  CHECK_EQUAL(0, r.configurator.completedSteps());
+  CHECK(r.commands.empty());
+  CHECK_EQUAL(GNSS_DEFAULT_BAUD_RATE, r.uartRate());
+  CHECK_EQUAL(GNSS_CONFIG_RETRIES * GNSS_PROBE_TIMEOUT, took);
+}
+
+// "Failed" is worth another go, "unsupported" isn't
+static void testFailedAndUnsupported()
+{
+  SimulatedReceiver r;
+  r.failedAcks = GNSSConfigurator::STEP_SENTENCES;
+  r.unsupported = GNSSConfigurator::STEP_FIX_INTERVAL;
+  r.start();
+  r.runToCompletion();
+
+  CHECK_EQUAL(GNSSConfigurator::STEP_BAUD_RATE | GNSSConfigurator::STEP_SENTENCES, r.configurator.completedSteps());
+  CHECK_EQUAL(2, r.count("$PMTK314,"));
+  CHECK_EQUAL(1, r.count("$PMTK220,"));
+  CHECK_EQUAL(1000, r.fixInterval());
+}
+
+// A step that's never acknowledged is retried, then skipped without holding up the rest
+static void testLostAcks()
+{
+  SimulatedReceiver r;
+  r.silentAcks = GNSSConfigurator::STEP_SENTENCES;
+  r.start();
+  r.runToCompletion();
+
+  CHECK_EQUAL(GNSSConfigurator::STEP_BAUD_RATE | GNSSConfigurator::STEP_FIX_INTERVAL, r.configurator.completedSteps());
+  CHECK_EQUAL(GNSS_CONFIG_RETRIES, r.count("$PMTK314,"));
+  CHECK_EQUAL(1, r.count("$PMTK220,"));
+  CHECK(r.sentences.empty());
+  CHECK_EQUAL(GNSS_FIX_INTERVAL, r.fixInterval());
+}
+
+/*
+ * A receiver that doesn't take the new baud rate is heard again once the UART goes back, and then
+ * only gets asked for 1 Hz
+ */
+static void testBaudRateRefused()
+{
+  SimulatedReceiver r;
+  r.ignoreBaudRate = true;
+  r.start();
+  r.runToCompletion();
+
+  CHECK_EQUAL(GNSSConfigurator::STEP_SENTENCES | GNSSConfigurator::STEP_FIX_INTERVAL, r.configurator.completedSteps());
+  CHECK_EQUAL(GNSS_CONFIG_RETRIES, r.count("$PMTK251,"));
+  CHECK_EQUAL(GNSS_DEFAULT_BAUD_RATE, r.uartRate());
+  CHECK_EQUAL(GNSS_DEFAULT_BAUD_RATE, r.configurator.baudRate());
+  CHECK_EQUAL(1000, r.fixInterval());
+  CHECK(r.sentences == r.commands[GNSS_CONFIG_RETRIES]);
+}
+
+// Stopping abandons whatever was in progress
+static void testStop()
+{
+  SimulatedReceiver r;
+  r.start();
+
+  // Waiting to hear the receiver at the new rate
+  r.run(500);
+  CHECK(r.configurator.busy());
+  CHECK_EQUAL(1, r.commands.size());
+
+  r.configurator.stop();
+  size_t sent = r.commands.size();
+  r.run(10000);
+  CHECK(!r.configurator.busy());
+  CHECK_EQUAL(sent, r.commands.size());
+}
+
+int main()
+{
+  testNormal();
+  testKeptBaudRate();
+  testNoReceiver();
+  testFailedAndUnsupported();
+  testLostAcks();
+  testBaudRateRefused();
+  testStop();
+  return testResult("GNSSConfiguratorTest");
+}
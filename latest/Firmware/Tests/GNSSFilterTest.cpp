@@ -0,0 +1,153 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "bsp_host.hpp"
+#include "GNSSFilter.hpp"
+#include "Stats.hpp"
+#include "GNSSInput.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+
+
+Stats::Stats()
+{
+}
+
+Stats &Stats::instance()
+{
+  static Stats __instance;
+  return __instance;
+}
+
+void Stats::processEvent(const Event &)
+{
+}
+
+GNSSInput &GNSSInput::instance()
+{
+  static GNSSInput *__instance = nullptr;
+  return *__instance;
+}
+
+void GNSSInput::release(const GNSSSlice &)
+{
+}
+
+/**
+ * A slice that ends right where an inaccessible page begins, like a line at the very end of the GNSS
+ * input buffer with nothing after it. Reading past its length faults.
+ */
+class GuardedSlice
+{
+public:
+  GuardedSlice()
+  {
+    mPageSize = sysconf(_SC_PAGESIZE);
+    mPages = (char *)mmap(nullptr, mPageSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mprotect(mPages + mPageSize, mPageSize, PROT_NONE);
+  }
+
+  ~GuardedSlice()
+  {
+    munmap(mPages, mPageSize * 2);
+  }
+
+  const char *place(const std::string &s)
+  {
+    char *p = mPages + mPageSize - s.size();
+    memcpy(p, s.data(), s.size());
+    return p;
+  }
+private:
+  long mPageSize;
+  char *mPages;
+};
+
+static bool isBlocked(GuardedSlice &guard, const std::string &s)
+{
+  return GNSSFilter::instance().isBlocked(guard.place(s), s.size());
+}
+
+static bool pass(GuardedSlice &guard, const std::string &s)
+{
+  return GNSSFilter::instance().pass(guard.place(s), s.size());
+}
+
+// Every prefix of a matching line, up against the guard page. Only a whole ID can match.
+static void testShortSlices()
+{
+  GuardedSlice guard;
+  GNSSFilter::instance().clear();
+  CHECK(GNSSFilter::instance().set("GPGSV", 0));
+  CHECK(GNSSFilter::instance().set("--GGA", 0));
+
+  std::string gsv = "$GPGSV,3,1,12*7A\r\n";
+  for ( size_t n = 0; n < gsv.size(); ++n )
+    CHECK_EQUAL(n >= 6, isBlocked(guard, gsv.substr(0, n)));
+
+  std::string gga = "$GNGGA,*56\r\n";
+  for ( size_t n = 0; n < gga.size(); ++n )
+    CHECK_EQUAL(n >= 6, isBlocked(guard, gga.substr(0, n)));
+
+  // Too short to match anything, so it passes
+  CHECK(pass(guard, "$GPGS"));
+  CHECK(!pass(guard, "$GPGSV"));
+  CHECK(!isBlocked(guard, "GPGSV,"));
+  CHECK(!isBlocked(guard, "$GPRMC"));
+}
+
+// Wildcards, first match wins and 1 in N decimation
+static void testMatching()
+{
+  GuardedSlice guard;
+  GNSSFilter::instance().clear();
+  CHECK(GNSSFilter::instance().set("GPRMC", 1));
+  CHECK(GNSSFilter::instance().set("----V", 3));
+  CHECK(GNSSFilter::instance().set("-----", 0));
+  CHECK(!GNSSFilter::instance().set("GPRM", 1));
+  CHECK(!GNSSFilter::instance().set("GP,MC", 1));
+
+  CHECK(!isBlocked(guard, "$GPRMC,1*00\r\n"));
+  CHECK(!isBlocked(guard, "$GLGSV,1*00\r\n"));
+  CHECK(isBlocked(guard, "$GPGGA,1*00\r\n"));
+
+  int passed = 0;
+  for ( int i = 0; i < 9; ++i )
+    {
+      CHECK(pass(guard, "$GPRMC,1*00\r\n"));
+      passed += pass(guard, "$GPGSV,1*00\r\n");
+    }
+  CHECK_EQUAL(3, passed);
+
+  GNSSFilter::instance().clear();
+  CHECK(!isBlocked(guard, "$GPGGA,1*00\r\n"));
+}
+
+int main()
+{
+  host_erase_eeprom();
+
+  testShortSlices();
+  testMatching();
+  return testResult("GNSSFilterTest");
+}
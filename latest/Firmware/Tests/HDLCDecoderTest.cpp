@@ -0,0 +1,459 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "HDLCDecoder.hpp"
+#include "config.h"
+#include <random>
+#include <vector>
+#include <algorithm>
+
+
+typedef enum
+{
+  STARTED,
+  COMPLETE,
+  ABORTED
+} Outcome;
+
+typedef struct
+{
+  Outcome outcome;
+  uint32_t level;     // Index of the level that caused it
+  uint16_t size;      // Packet size at that point
+  uint16_t crc;
+  std::vector<uint32_t> payload;
+} Record;
+
+static bool operator==(const Record &a, const Record &b)
+{
+  return a.outcome == b.outcome && a.level == b.level && a.size == b.size && a.crc == b.crc && a.payload == b.payload;
+}
+
+static Record record(Outcome outcome, uint32_t level, const RXPacket &packet)
+{
+  Record r = { outcome, level, packet.size(), packet.crc(), {} };
+  for ( uint16_t pos = 0; pos < packet.size(); pos += 32 )
+    r.payload.push_back(packet.bits(pos, std::min(32, packet.size() - pos)));
+  return r;
+}
+
+/**
+ * The per-bit state machine the Receiver used before HDLCDecoder (processNRZIBit() and addBit()),
+ * restarting the way onBitClock() did.
+ */
+class BitDecoder
+{
+public:
+  std::vector<Record> records;
+  bool keepRecords = true;
+  unsigned events = 0;
+
+  BitDecoder()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    mBitWindow = 0;
+    mBitCount = 0;
+    mOneBitCount = 0;
+    mLastNRZIBit = 0xff;
+    mRXByte = 0;
+    mInPacket = false;
+    mPacket.reset();
+  }
+
+  void onBit(uint8_t bit, uint32_t level)
+  {
+    if ( processNRZIBit(bit, level) )
+      reset();
+  }
+private:
+  void add(Outcome outcome, uint32_t level, const RXPacket &packet)
+  {
+    ++events;
+    if ( keepRecords )
+      records.push_back(record(outcome, level, packet));
+  }
+
+  bool processNRZIBit(uint8_t bit, uint32_t level)
+  {
+    if ( mLastNRZIBit == 0xff )
+      {
+        mLastNRZIBit = bit;
+        return false;
+      }
+
+    uint8_t decodedBit = !(mLastNRZIBit ^ bit);
+
+    if ( !mInPacket )
+      {
+        mLastNRZIBit = bit;
+        mBitWindow <<= 1;
+        mBitWindow |= decodedBit;
+        if ( mBitWindow == 0b1010101001111110 || mBitWindow == 0b0101010101111110 )
+          {
+            mInPacket = true;
+            add(STARTED, level, mPacket);
+          }
+        return false;
+      }
+
+    if ( mOneBitCount >= 7 || mPacket.size() >= MAX_AIS_RX_PACKET_SIZE )
+      {
+        add(ABORTED, level, mPacket);
+        return true;
+      }
+
+    mLastNRZIBit = bit;
+    mBitWindow <<= 1;
+    mBitWindow |= decodedBit;
+
+    if ( (mBitWindow & 0x00ff) == 0x7E )
+      {
+        add(COMPLETE, level, mPacket);
+        return true;
+      }
+
+    addBit(decodedBit);
+    return false;
+  }
+
+  void addBit(uint8_t bit)
+  {
+    bool result = true;
+    if ( bit )
+      {
+        ++mOneBitCount;
+      }
+    else
+      {
+        if ( mOneBitCount == 5 )
+          result = false;
+        mOneBitCount = 0;
+      }
+
+    if ( result )
+      {
+        mRXByte <<= 1;
+        mRXByte |= bit;
+        ++mBitCount;
+      }
+
+    if ( mBitCount == 8 )
+      {
+        mPacket.addByte(mRXByte);
+        mBitCount = 0;
+        mRXByte = 0;
+      }
+  }
+private:
+  uint16_t mBitWindow;
+  uint8_t mLastNRZIBit;
+  uint8_t mBitCount;
+  uint8_t mOneBitCount;
+  uint8_t mRXByte;
+  bool mInPacket;
+  RXPacket mPacket;
+};
+
+/**
+ * HDLCDecoder driven like the Receiver drives it. Levels are decoded in batches of up to 8, or up to
+ * levelsBeforeEvent() and MAX_RX_DECODE_LEVELS when bounded. Levels that follow an event go back in after
+ * the restart, so the decoder is tested with both.
+ */
+class BatchDecoder
+{
+public:
+  std::vector<Record> records;
+  bool keepRecords = true;
+  unsigned events = 0;
+
+  BatchDecoder()
+  {
+    restart();
+  }
+
+  bool bounded = false;
+  unsigned lateEvents = 0;
+  uint8_t maxLevels = 0;    // The most levels decoded in one bit period
+
+  void onLevel(uint8_t level, bool flush)
+  {
+    mLevels |= level << (7 - mLevelCount);
+    ++mLevelCount;
+    ++mFed;
+    if ( mLevelCount == (bounded ? mBatchSize : 8) || flush )
+      decode();
+  }
+
+  void decode()
+  {
+    maxLevels = std::max(maxLevels, mLevelCount);
+    while ( mLevelCount )
+      {
+        HDLCDecoder::Result result = mDecoder.decode(mLevels, mLevelCount, mPacket);
+        uint32_t level = mFed - mLevelCount - 1;
+        switch (result) {
+        case HDLCDecoder::FRAME_STARTED:
+          add(STARTED, level, mPacket);
+          break;
+        case HDLCDecoder::FRAME_COMPLETE:
+          add(COMPLETE, level, mPacket);
+          lateEvents += mLevelCount != 0;
+          restart();
+          break;
+        case HDLCDecoder::FRAME_ABORTED:
+          add(ABORTED, level, mPacket);
+          lateEvents += mLevelCount != 0;
+          restart();
+          break;
+        default:
+          break;
+        }
+      }
+
+    mBatchSize = std::min<uint8_t>(mDecoder.levelsBeforeEvent(mPacket.size()), MAX_RX_DECODE_LEVELS);
+  }
+private:
+  void add(Outcome outcome, uint32_t level, const RXPacket &packet)
+  {
+    ++events;
+    if ( keepRecords )
+      records.push_back(record(outcome, level, packet));
+  }
+
+  void restart()
+  {
+    mDecoder.reset();
+    mPacket.reset();
+  }
+private:
+  HDLCDecoder mDecoder;
+  RXPacket mPacket;
+  uint8_t mLevels = 0;
+  uint8_t mLevelCount = 0;
+  uint32_t mFed = 0;
+  uint8_t mBatchSize = MAX_RX_DECODE_LEVELS;
+};
+
+static void addFlag(std::vector<uint8_t> &bits)
+{
+  static const uint8_t FLAG[] = { 0, 1, 1, 1, 1, 1, 1, 0 };
+  bits.insert(bits.end(), FLAG, FLAG + 8);
+}
+
+/*
+ * A stream of decoded bits with noise, training sequences, frames with random (stuffed) payloads,
+ * unstuffed payloads, oversize frames and aborts.
+ */
+static std::vector<uint8_t> randomBits(std::mt19937 &rng)
+{
+  std::vector<uint8_t> bits;
+  int frames = rng() % 3;
+  for ( int f = 0; f < frames; ++f )
+    {
+      int noise = rng() % 40;
+      for ( int i = 0; i < noise; ++i )
+        bits.push_back(rng() & 1);
+
+      for ( int i = 0; i < 24; ++i )
+        bits.push_back(i & 1);
+      addFlag(bits);
+
+      int mode = rng() % 6;
+      int length = mode == 0 ? rng() % 700 : rng() % 300;
+      int ones = 0;
+      for ( int i = 0; i < length; ++i )
+        {
+          // Mode 1 is mostly 1s, mode 2 skips stuffing
+          uint8_t b = mode == 1 ? (rng() % 8) != 0 : rng() & 1;
+          bits.push_back(b);
+          if ( b && ++ones == 5 && mode != 2 )
+            {
+              bits.push_back(0);
+              ones = 0;
+            }
+          else if ( !b )
+            {
+              ones = 0;
+            }
+        }
+
+      if ( mode == 3 )
+        bits.insert(bits.end(), 9, 1);
+      else
+        addFlag(bits);
+    }
+
+  for ( int i = 0; i < 20; ++i )
+    bits.push_back(rng() & 1);
+
+  return bits;
+}
+
+// NRZI: a 0 is a transition, a 1 is none
+static std::vector<uint8_t> nrzi(const std::vector<uint8_t> &bits, uint8_t level)
+{
+  std::vector<uint8_t> levels;
+  levels.push_back(level);
+  for ( uint8_t b : bits )
+    {
+      if ( !b )
+        level ^= 1;
+      levels.push_back(level);
+    }
+  return levels;
+}
+
+static void testEquivalence()
+{
+  std::mt19937 rng(1);
+  unsigned frames = 0;
+  for ( int iteration = 0; iteration < 20000; ++iteration )
+    {
+      std::vector<uint8_t> levels = nrzi(randomBits(rng), rng() & 1);
+
+      BitDecoder reference;
+      BatchDecoder batch, bounded;
+      bounded.bounded = true;
+      for ( uint32_t i = 0; i < levels.size(); ++i )
+        {
+          reference.onBit(levels[i], i);
+          // Early flushes stand in for the RSSI bit and slot boundaries
+          batch.onLevel(levels[i], rng() % 13 == 0);
+          bounded.onLevel(levels[i], rng() % 13 == 0);
+        }
+      batch.decode();
+      bounded.decode();
+
+      bool same = reference.records == batch.records && reference.records == bounded.records;
+      CHECK(same);
+      if ( !same )
+        {
+          printf("Iteration %d: %zu events from the reference, %zu from HDLCDecoder, %zu with bounded batches\n",
+              iteration, reference.records.size(), batch.records.size(), bounded.records.size());
+          return;
+        }
+
+      // No level may follow the one that ends a frame in its batch
+      CHECK_EQUAL(0, bounded.lateEvents);
+      if ( bounded.lateEvents )
+        return;
+
+      CHECK(bounded.maxLevels <= MAX_RX_DECODE_LEVELS);
+      if ( bounded.maxLevels > MAX_RX_DECODE_LEVELS )
+        return;
+
+      frames += std::count_if(batch.records.begin(), batch.records.end(), [](const Record &r) { return r.outcome == COMPLETE; });
+    }
+
+  CHECK(frames > 10000);
+}
+
+/*
+ * Returns the worst case cost of a bit period. Host cycle counts include whatever interrupted the host, so every
+ * bit period is replayed a few times from a copy of the decoder as it was, and the cheapest replay counts. The
+ * slowest few of those can still be noise, so the worst case is taken at 99.99%.
+ */
+template<typename Decoder, typename Feed> static uint32_t measure(const char *name, const std::vector<uint8_t> &levels, Feed feed)
+{
+  // The mean comes from an untimed pass
+  double mean = 1e9;
+  for ( int run = 0; run < 3; ++run )
+    {
+      Decoder decoder;
+      decoder.keepRecords = false;
+      uint64_t start = hostCycles();
+      for ( uint32_t i = 0; i < levels.size(); ++i )
+        feed(decoder, levels[i], i);
+      mean = std::min(mean, (double)(hostCycles() - start) / levels.size());
+    }
+
+  uint64_t overhead = ~0ull;
+  for ( int i = 0; i < 1000; ++i )
+    {
+      uint64_t t = hostCycles();
+      overhead = std::min(overhead, hostCycles() - t);
+    }
+
+  std::vector<uint32_t> samples(levels.size());
+  Decoder decoder;
+  decoder.keepRecords = false;
+  for ( uint32_t i = 0; i < levels.size(); ++i )
+    {
+      uint64_t best = ~0ull;
+      for ( int replay = 0; replay < 20; ++replay )
+        {
+          Decoder copy = decoder;
+          uint64_t t = hostCycles();
+          feed(copy, levels[i], i);
+          best = std::min(best, hostCycles() - t);
+        }
+      samples[i] = best > overhead ? best - overhead : 0;
+      feed(decoder, levels[i], i);
+    }
+
+  std::sort(samples.begin(), samples.end());
+  uint32_t worst = samples[samples.size() * 9999 / 10000];
+  printf("%-16s %6.1f mean, %5u median, %5u at 99.9%%, %5u at 99.99%% host cycles per bit period\n", name, mean,
+      samples[samples.size() / 2], samples[samples.size() * 999 / 1000], worst);
+  return worst;
+}
+
+/*
+ * Cost per bit period (with levels collected and decoded the way onBitClock() does it) over a stream that's
+ * about half frames and half noise. These are host cycles, so only the comparison means much for the target.
+ * The worst bit period is one that ends a frame, with the decoding of the rest of its batch on top of what the
+ * per-bit decoder does there. Bounded batches keep that to MAX_RX_DECODE_LEVELS levels.
+ */
+static void measureCycles()
+{
+  std::mt19937 rng(2);
+  std::vector<uint8_t> levels;
+  while ( levels.size() < 200000 )
+    {
+      std::vector<uint8_t> l = nrzi(randomBits(rng), rng() & 1);
+      levels.insert(levels.end(), l.begin(), l.end());
+    }
+
+  uint32_t perBit = measure<BitDecoder>("Per-bit decoder", levels, [](BitDecoder &d, uint8_t level, uint32_t i) { d.onBit(level, i); });
+  uint32_t batches = measure<BatchDecoder>("HDLCDecoder", levels, [](BatchDecoder &d, uint8_t level, uint32_t) { d.onLevel(level, false); });
+  uint32_t bounded = measure<BatchDecoder>("Bounded batches", levels, [](BatchDecoder &d, uint8_t level, uint32_t) {
+    d.bounded = true;
+    d.onLevel(level, false);
+  });
+
+  /*
+   * On the host, a restart costs next to nothing, so the decoder call on top of it stands out. On the target,
+   * the bit period that pushes a packet is mostly pushPacket() and the SPI commands of the restart either way.
+   */
+  CHECK(bounded < batches);
+  CHECK(bounded <= 3 * perBit);
+}
+
+int main()
+{
+  testEquivalence();
+  measureCycles();
+  return testResult("HDLCDecoderTest");
+}
@@ -0,0 +1,208 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "NMEAEncoder.hpp"
+#include "AISChannels.h"
+#include <random>
+#include <vector>
+#include <string>
+
+
+/**
+ * The encoder as it was before it wrote into a caller's buffer: a std::string per sentence, with the header
+ * and checksum formatted by sprintf(). RXPacketProcessor terminated every sentence with CRLF.
+ */
+class StringEncoder
+{
+public:
+  void encode(RXPacket &packet, std::vector<std::string> &sentences)
+  {
+    static uint16_t MAX_SENTENCE_BYTES = 56;
+    static uint16_t MAX_SENTENCE_BITS = MAX_SENTENCE_BYTES * 6;
+
+    packet.discardCRC();
+
+    uint16_t numBits = packet.size();
+    uint16_t fillBits = 0;
+
+    if ( numBits % 6 )
+      {
+        fillBits = 6 - (numBits%6);
+        packet.addFillBits(fillBits);
+        numBits = packet.size();
+      }
+
+    uint16_t numSentences = 1;
+    while ( numBits > MAX_SENTENCE_BITS )
+      {
+        ++numSentences;
+        numBits -= MAX_SENTENCE_BITS;
+      }
+
+    numBits = packet.size();
+    if ( numSentences > 1 )
+      {
+        ++mSequence;
+
+        if ( mSequence > 9 )
+          mSequence = 0;
+      }
+
+    char sentence[85];
+    uint16_t pos = 0;
+
+    for ( uint16_t i = 1; i <= numSentences; ++i )
+      {
+        uint8_t k = 0;
+        if ( numSentences > 1 )
+          sprintf(sentence, "!AIVDM,%d,%d,%d,%c,", numSentences, i, mSequence, AIS_CHANNELS[packet.channel()].designation);
+        else
+          sprintf(sentence, "!AIVDM,%d,%d,,%c,", numSentences, i, AIS_CHANNELS[packet.channel()].designation);
+
+        k = strlen(sentence);
+        uint16_t sentenceBits = 0;
+
+        for ( ; pos < numBits && sentenceBits < MAX_SENTENCE_BITS; pos += 6, sentenceBits += 6 )
+          {
+            uint8_t nmeaByte = (uint8_t)packet.bits(pos, 6);
+            nmeaByte += (nmeaByte < 40) ? 48 : 56;
+            sentence[k++] = nmeaByte;
+          }
+
+        sentence[k++] = ',';
+        if ( numSentences > 1 && i == numSentences )
+          sentence[k++] = '0' + fillBits;
+        else
+          sentence[k++] = '0';
+
+        sentence[k++] = '*';
+        sprintf(sentence+k, "%.2X", nmeaCRC(sentence));
+        sentences.push_back(std::string(sentence));
+      }
+  }
+private:
+  uint8_t nmeaCRC(const char* buff)
+  {
+    uint8_t p = 1;
+    uint8_t crc = buff[p++];
+    while ( buff[p] != '*' )
+      crc ^= buff[p++];
+    return crc;
+  }
+private:
+  uint8_t mSequence = 0;
+};
+
+// Received packets of every size the receiver accepts, with their FCS still attached
+static std::vector<RXPacket> randomPackets(int count, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<RXPacket> packets(count);
+  for ( RXPacket &p : packets )
+    {
+      uint16_t bytes = 3 + rng() % (MAX_AIS_RX_PACKET_SIZE / 8 - 3);
+      for ( uint16_t i = 0; i < bytes; ++i )
+        p.addByte(rng());
+      p.setChannel(rng() & 1 ? CH_87 : CH_88);
+    }
+  return packets;
+}
+
+static std::string joined(const std::vector<std::string> &sentences)
+{
+  std::string s;
+  for ( const std::string &sentence : sentences )
+    s += sentence + "\r\n";
+  return s;
+}
+
+/*
+ * Byte for byte the same output as the string encoder, including the sequence numbers of multi-sentence
+ * messages. A smaller buffer gets as many whole sentences as fit.
+ */
+static void testEquivalence()
+{
+  std::vector<RXPacket> packets = randomPackets(20000, 1);
+  NMEAEncoder encoder, smallEncoder;
+  StringEncoder reference;
+  unsigned mismatches = 0, multiSentence = 0;
+
+  for ( const RXPacket &packet : packets )
+    {
+      RXPacket p1 = packet, p2 = packet, p3 = packet;
+      char buffer[NMEA_ENCODER_BUFFER_SIZE];
+      uint16_t length = encoder.encode(p1, buffer, sizeof buffer);
+
+      std::vector<std::string> sentences;
+      reference.encode(p2, sentences);
+      std::string expected = joined(sentences);
+      if ( expected != buffer || length != expected.size() )
+        ++mismatches;
+      if ( sentences.size() > 1 )
+        ++multiSentence;
+
+      // Room for the first sentence only
+      char small[100];
+      length = smallEncoder.encode(p3, small, sizeof small);
+      std::string first = sentences[0] + "\r\n";
+      if ( first != small || length != first.size() )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK(multiSentence > 1000);
+}
+
+static void benchmark()
+{
+  std::vector<RXPacket> packets = randomPackets(5000, 2);
+  std::vector<RXPacket> copies = packets;
+  NMEAEncoder encoder;
+  StringEncoder reference;
+  volatile size_t sink = 0;
+
+  uint64_t start = hostCycles();
+  for ( RXPacket &p : copies )
+    {
+      std::vector<std::string> sentences;
+      reference.encode(p, sentences);
+      sink = sink + sentences.size();
+    }
+  double before = double(hostCycles() - start) / copies.size();
+
+  copies = packets;
+  start = hostCycles();
+  for ( RXPacket &p : copies )
+    {
+      char buffer[NMEA_ENCODER_BUFFER_SIZE];
+      sink = sink + encoder.encode(p, buffer, sizeof buffer);
+    }
+  double after = double(hostCycles() - start) / copies.size();
+
+  printf("Encoding a packet: %.0f host cycles with strings, %.0f into a buffer\n", before, after);
+}
+
+int main()
+{
+  testEquivalence();
+  benchmark();
+  return testResult("NMEAEncoderTest");
+}
@@ -0,0 +1,385 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "NMEASentence.hpp"
+#include <stdlib.h>
+#include <random>
+#include <vector>
+#include <string>
+#include <new>
+
+
+// Every allocation the program makes, so the benchmark can tell how many parsing takes
+static uint64_t gAllocations = 0;
+
+void *operator new(size_t size)
+{
+  ++gAllocations;
+  void *p = malloc(size ? size : 1);
+  if ( !p )
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+/**
+ * The parser as it was before it worked in place: the line was checked with strstr() and sscanf(),
+ * then split into a vector of strings by Utils::tokenize().
+ */
+class StringSentence
+{
+public:
+  StringSentence(const std::string &raw)
+  : mValid(false)
+  {
+    const char *buff = raw.c_str();
+    if ( buff[0] != '$' || buff[1] == '$' )
+      return;
+
+    unsigned reportedHash;
+    const char *starPos = strstr(buff, "*");
+    if ( !starPos || sscanf(starPos + 1, "%x", &reportedHash) != 1 )
+      return;
+
+    unsigned actualHash = 0;
+    for ( const char* c = buff + 1; c < starPos; ++c )
+      actualHash ^= *c;
+    if ( reportedHash != actualHash )
+      return;
+
+    std::string token;
+    for ( unsigned i = 0; i < raw.length(); ++i )
+      {
+        if ( raw[i] == ',' )
+          {
+            mFields.push_back(token);
+            token.erase();
+          }
+        else
+          token += raw[i];
+      }
+    if ( !token.empty() )
+      mFields.push_back(token);
+
+    mFields[0] = mFields[0].substr(1);
+    std::string &lastField = *mFields.rbegin();
+    lastField = lastField.substr(0, lastField.find("*"));
+    mValid = true;
+  }
+
+  bool isValid() const
+  {
+    return mValid;
+  }
+
+  const std::vector<std::string> &fields() const
+  {
+    return mFields;
+  }
+private:
+  bool mValid;
+  std::vector<std::string> mFields;
+};
+
+static std::string withChecksum(const std::string &body)
+{
+  uint8_t crc = 0;
+  for ( size_t i = 1; i < body.size(); ++i )
+    crc ^= body[i];
+
+  char tail[8];
+  snprintf(tail, sizeof tail, "*%02X\r\n", crc);
+  return body + tail;
+}
+
+/*
+ * One second of L70R output at the default settings (RMC, VTG, GGA, GSA, 3 GSV and GLL), with the values
+ * varying from second to second. Some seconds have no fix, with the empty fields that go with that.
+ */
+static std::vector<std::string> l70rOutput(int seconds, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<std::string> lines;
+  char b[120];
+
+  for ( int s = 0; s < seconds; ++s )
+    {
+      int hh = s / 3600 % 24, mm = s / 60 % 60, ss = s % 60;
+      bool fix = rng() % 10 != 0;
+      double lat = 3748.0 + (rng() % 100000) / 10000.0, lng = 12224.0 + (rng() % 100000) / 10000.0;
+      double sog = (rng() % 2000) / 100.0, cog = (rng() % 36000) / 100.0;
+
+      if ( fix )
+        {
+          snprintf(b, sizeof b, "$GPRMC,%02d%02d%02d.000,A,%.4f,N,%.4f,W,%.2f,%.2f,170520,,,A", hh, mm, ss, lat, lng, sog, cog);
+          lines.push_back(withChecksum(b));
+          snprintf(b, sizeof b, "$GPVTG,%.2f,T,,M,%.2f,N,%.2f,K,A", cog, sog, sog * 1.852);
+          lines.push_back(withChecksum(b));
+          snprintf(b, sizeof b, "$GPGGA,%02d%02d%02d.000,%.4f,N,%.4f,W,1,%d,0.93,%.1f,M,-25.5,M,,", hh, mm, ss, lat, lng,
+                   (int)(4 + rng() % 8), (rng() % 1000) / 10.0);
+          lines.push_back(withChecksum(b));
+          lines.push_back(withChecksum("$GPGSA,A,3,10,32,26,21,08,16,27,20,,,,,1.21,0.93,0.77"));
+        }
+      else
+        {
+          snprintf(b, sizeof b, "$GPRMC,%02d%02d%02d.000,V,,,,,0.00,0.00,170520,,,N", hh, mm, ss);
+          lines.push_back(withChecksum(b));
+          lines.push_back(withChecksum("$GPVTG,0.00,T,,M,0.00,N,0.00,K,N"));
+          snprintf(b, sizeof b, "$GPGGA,%02d%02d%02d.000,,,,,0,0,,,M,,M,,", hh, mm, ss);
+          lines.push_back(withChecksum(b));
+          lines.push_back(withChecksum("$GPGSA,A,1,,,,,,,,,,,,,,,"));
+        }
+
+      for ( int i = 1; i <= 3; ++i )
+        {
+          std::string gsv = "$GPGSV,3," + std::to_string(i) + ",12";
+          for ( int sat = 0; sat < 4; ++sat )
+            {
+              snprintf(b, sizeof b, ",%02d,%02d,%03d,%02d", (int)(1 + rng() % 32), (int)(rng() % 90), (int)(rng() % 360), (int)(rng() % 50));
+              gsv += b;
+            }
+          lines.push_back(withChecksum(gsv));
+        }
+
+      snprintf(b, sizeof b, "$GPGLL,%.4f,N,%.4f,W,%02d%02d%02d.000,%c,%c", lat, lng, hh, mm, ss, fix ? 'A' : 'V', fix ? 'A' : 'N');
+      lines.push_back(withChecksum(b));
+    }
+
+  return lines;
+}
+
+// The fields between the '$' and the '*', empty ones included
+static std::vector<std::string> split(const std::string &line)
+{
+  std::vector<std::string> fields(1);
+  for ( size_t i = 1; i < line.size() && line[i] != '*'; ++i )
+    {
+      if ( line[i] == ',' )
+        fields.push_back("");
+      else
+        fields.back() += line[i];
+    }
+  return fields;
+}
+
+static std::string fieldString(const NMEASentence &sentence, uint8_t index)
+{
+  return std::string(sentence.field(index), sentence.fieldLength(index));
+}
+
+/*
+ * Every field of real output comes out the same as a plain split, and the string parser agrees on each
+ * field it reports (it drops a trailing empty field).
+ */
+static void testFields()
+{
+  std::vector<std::string> lines = l70rOutput(600, 1);
+  unsigned invalid = 0, mismatches = 0;
+
+  for ( const std::string &line : lines )
+    {
+      NMEASentence sentence(line.c_str());
+      StringSentence reference(line);
+      if ( !sentence.isValid() || !reference.isValid() )
+        {
+          ++invalid;
+          continue;
+        }
+
+      std::vector<std::string> fields = split(line);
+      if ( sentence.numFields() != fields.size() || sentence.length() != line.size() )
+        ++mismatches;
+
+      for ( uint8_t i = 0; i < sentence.numFields(); ++i )
+        {
+          if ( fieldString(sentence, i) != fields[i] )
+            ++mismatches;
+          if ( i < reference.fields().size() && fieldString(sentence, i) != reference.fields()[i] )
+            ++mismatches;
+        }
+    }
+
+  CHECK_EQUAL(0, invalid);
+  CHECK_EQUAL(0, mismatches);
+
+  NMEASentence rmc(lines[0].c_str());
+  CHECK(rmc.is("RMC"));
+  CHECK(!rmc.is("GGA"));
+  CHECK_EQUAL(0, rmc.digits(1, 0, 2));
+  CHECK_EQUAL(170520, rmc.digits(9, 0, 6));
+  CHECK_EQUAL(-1, rmc.digits(9, 1, 6));
+  CHECK_EQUAL(-1, rmc.digits(2, 0, 1));
+
+  // Missing fields read as empty
+  CHECK_STRING("", rmc.field(rmc.numFields()));
+  CHECK_EQUAL(0, rmc.fieldLength(rmc.numFields()));
+}
+
+// Any change to the sentence or its checksum is caught, and hex digits can be either case
+static void testChecksum()
+{
+  std::string line = withChecksum("$GPRMC,092750.000,A,5321.6802,N,00630.3372,W,0.02,31.66,280511,,,A");
+  CHECK(NMEASentence(line.c_str()).isValid());
+
+  unsigned accepted = 0;
+  size_t star = line.find('*');
+  for ( size_t i = 1; i < star + 3; ++i )
+    {
+      if ( i == star )
+        continue;
+      for ( int b = 0; b < 7; ++b )
+        {
+          std::string corrupt = line;
+          corrupt[i] ^= 1 << b;
+          if ( corrupt[i] == '*' || corrupt[i] == 0 )
+            continue;
+          if ( i > star && tolower(corrupt[i]) == tolower(line[i]) )
+            continue;
+          if ( NMEASentence(corrupt.c_str()).isValid() )
+            ++accepted;
+        }
+    }
+  CHECK_EQUAL(0, accepted);
+
+  std::string lower = line;
+  for ( size_t i = star + 1; i < star + 3; ++i )
+    lower[i] = tolower(lower[i]);
+  CHECK(NMEASentence(lower.c_str()).isValid());
+}
+
+// No '*', or not two hex digits after it
+static void testMalformed()
+{
+  std::string line = withChecksum("$GPGLL,5321.6802,N,00630.3372,W,092750.000,A,A");
+  size_t star = line.find('*');
+
+  CHECK(!NMEASentence(line.substr(0, star).c_str()).isValid());
+  CHECK(!NMEASentence((line.substr(0, star) + "\r\n").c_str()).isValid());
+  CHECK(!NMEASentence(line.substr(0, star + 1).c_str()).isValid());
+  CHECK(!NMEASentence(line.substr(0, star + 2).c_str()).isValid());
+  CHECK(!NMEASentence((line.substr(0, star + 1) + "G0\r\n").c_str()).isValid());
+  CHECK(!NMEASentence((line.substr(0, star + 2) + "\r\n").c_str()).isValid());
+  CHECK(!NMEASentence(("GPGLL" + line.substr(6)).c_str()).isValid());
+  CHECK(!NMEASentence("").isValid());
+  CHECK(!NMEASentence("$*").isValid());
+
+  // A slice stops at its length, whatever follows in the buffer
+  CHECK(NMEASentence(line.c_str(), line.size()).isValid());
+  CHECK(NMEASentence(line.c_str(), star + 3).isValid());
+  CHECK(!NMEASentence(line.c_str(), star + 2).isValid());
+  CHECK(!NMEASentence(line.c_str(), star).isValid());
+
+  // Not a sentence we know, but well formed
+  NMEASentence empty(withChecksum("$").c_str());
+  CHECK(empty.isValid());
+  CHECK_EQUAL(1, empty.numFields());
+  CHECK(!empty.is("RMC"));
+}
+
+// Fields past NMEA_MAX_FIELDS are ignored, but still count towards the checksum
+static void testTooManyFields()
+{
+  std::string body = "$GPXXX";
+  for ( int i = 1; i < 40; ++i )
+    body += "," + std::to_string(i * 11);
+  std::string line = withChecksum(body);
+
+  NMEASentence sentence(line.c_str());
+  CHECK(sentence.isValid());
+  CHECK_EQUAL(NMEA_MAX_FIELDS, sentence.numFields());
+  for ( uint8_t i = 1; i < NMEA_MAX_FIELDS; ++i )
+    CHECK(fieldString(sentence, i) == std::to_string(i * 11));
+  CHECK_EQUAL(0, sentence.fieldLength(NMEA_MAX_FIELDS));
+
+  // Exactly as many as fit, the last one running up to the '*'
+  body = "$GPXXX";
+  for ( int i = 1; i < NMEA_MAX_FIELDS; ++i )
+    body += ",7";
+  sentence = NMEASentence(withChecksum(body).c_str());
+  CHECK(sentence.isValid());
+  CHECK_EQUAL(NMEA_MAX_FIELDS, sentence.numFields());
+  CHECK_EQUAL(1, sentence.fieldLength(NMEA_MAX_FIELDS - 1));
+
+  std::string corrupt = line;
+  corrupt[corrupt.size() - 10] ^= 1;
+  CHECK(!NMEASentence(corrupt.c_str()).isValid());
+}
+
+/*
+ * Lines per second and allocations per line, over 10 minutes of output. The old figure includes checking
+ * the line and splitting it up, as both are done by the new parser.
+ */
+static void benchmark()
+{
+  std::vector<std::string> lines = l70rOutput(600, 2);
+  volatile size_t sink = 0;
+  const int rounds = 20;
+
+  uint64_t allocations = gAllocations;
+  double start = hostSeconds();
+  for ( int r = 0; r < rounds; ++r )
+    {
+      for ( const std::string &line : lines )
+        {
+          StringSentence sentence(line);
+          sink = sink + sentence.fields().size();
+        }
+    }
+  double before = lines.size() * rounds / (hostSeconds() - start);
+  double beforeAllocations = double(gAllocations - allocations) / (lines.size() * rounds);
+
+  allocations = gAllocations;
+  start = hostSeconds();
+  for ( int r = 0; r < rounds; ++r )
+    {
+      for ( const std::string &line : lines )
+        {
+          NMEASentence sentence(line.c_str(), line.size());
+          sink = sink + sentence.numFields();
+        }
+    }
+  double after = lines.size() * rounds / (hostSeconds() - start);
+  double afterAllocations = double(gAllocations - allocations) / (lines.size() * rounds);
+
+  CHECK_EQUAL(0, gAllocations - allocations);
+  printf("Parsing L70R output: %.0f lines/s and %.1f allocations/line with strings, %.0f lines/s and %.1f in place\n",
+         before, beforeAllocations, after, afterAllocations);
+}
+
+int main()
+{
+  testFields();
+  testChecksum();
+  testMalformed();
+  testTooManyFields();
+  benchmark();
+  return testResult("NMEASentenceTest");
+}
@@ -0,0 +1,334 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+
+#include "Test.hpp"
+#include "SPSCQueue.hpp"
+#include "MPMCQueue.hpp"
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <functional>
+
+
+/**
+ * Stress tests of the lock-free rings with host threads standing in for ISRs and tasks. On a multi-core host
+ * threads run truly in parallel, which is harsher than preemption on a single core: every interleaving
+ * preemption can produce can also happen, and many more besides. A thread that finds the queue full (or
+ * empty) yields, so the test also runs on a single core.
+ *
+ * Elements carry their producer in the top byte and a sequence number below, so every consumer can check
+ * that it sees each producer's elements in order and that nothing is lost or duplicated.
+ */
+
+#define ELEMENTS_PER_PRODUCER     200000
+
+static inline uint32_t element(uint32_t producer, uint32_t sequence)
+{
+  return producer << 24 | sequence;
+}
+
+// The baseline for throughput: a deque behind a mutex
+template<typename T, size_t N> class LockedQueue
+{
+public:
+  bool push(const T &element)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if ( mQueue.size() == N )
+      return false;
+    mQueue.push_back(element);
+    return true;
+  }
+
+  bool pop(T &element)
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if ( mQueue.empty() )
+      return false;
+    element = mQueue.front();
+    mQueue.pop_front();
+    return true;
+  }
+private:
+  std::mutex mMutex;
+  std::deque<T> mQueue;
+};
+
+// Capacity and order without any concurrency
+template<typename Queue, size_t N> static void testSequential(Queue &queue)
+{
+  uint32_t e = 0;
+  CHECK(!queue.pop(e));
+
+  // Enough rounds for the free running indices to wrap the ring many times
+  for ( uint32_t round = 0; round < 1000; ++round )
+    {
+      uint32_t count = round % 3 ? N : round % N + 1;
+      for ( uint32_t i = 0; i < count; ++i )
+        CHECK(queue.push(round * N + i));
+      if ( count == N )
+        CHECK(!queue.push(0));
+
+      for ( uint32_t i = 0; i < count; ++i )
+        CHECK(queue.pop(e) && e == round * N + i);
+      CHECK(!queue.pop(e));
+    }
+}
+
+static void testSPSCPeek()
+{
+  SPSCQueue<uint32_t, 4> queue;
+  uint32_t e = 0;
+  CHECK(queue.empty());
+  CHECK(!queue.peek(e));
+
+  queue.push(7);
+  queue.push(8);
+  CHECK(!queue.empty());
+  CHECK(queue.peek(e) && e == 7);
+  CHECK(queue.peek(e) && e == 7);
+  CHECK(queue.pop(e) && e == 7);
+  CHECK(queue.peek(e) && e == 8);
+}
+
+/**
+ * An element whose assignment runs a nested context once, like an interrupt arriving while push() or pop()
+ * copies it. That's after the cell has been claimed and before it's handed over, which is the window the
+ * rings' comments reason about.
+ */
+static std::function<void()> gPreemption;
+
+class PreemptedElement
+{
+public:
+  PreemptedElement(uint32_t v = 0)
+  : value(v)
+  {
+  }
+
+  PreemptedElement &operator=(const PreemptedElement &other)
+  {
+    value = other.value;
+    if ( gPreemption )
+      {
+        std::function<void()> preemption = gPreemption;
+        gPreemption = nullptr;
+        preemption();
+      }
+    return *this;
+  }
+
+  uint32_t value;
+};
+
+// A higher priority context's push goes ahead, but nobody can pop past a cell that isn't published yet
+static void testPreemptedProducer()
+{
+  MPMCQueue<PreemptedElement, 4> mpmc;
+  bool pushed = false, popped = true;
+  PreemptedElement e;
+  gPreemption = [&]() {
+    pushed = mpmc.push(2);
+    popped = mpmc.pop(e);
+  };
+  CHECK(mpmc.push(1));
+  CHECK(pushed);
+  CHECK(!popped);
+  CHECK(mpmc.pop(e) && e.value == 1);
+  CHECK(mpmc.pop(e) && e.value == 2);
+
+  SPSCQueue<PreemptedElement, 4> spsc;
+  gPreemption = [&]() {
+    popped = spsc.pop(e);
+  };
+  CHECK(spsc.push(1));
+  CHECK(!popped);
+  CHECK(spsc.pop(e) && e.value == 1);
+}
+
+// Other consumers carry on past a cell that's being popped, but it isn't free until the pop is done
+static void testPreemptedConsumer()
+{
+  MPMCQueue<PreemptedElement, 4> mpmc;
+  for ( uint32_t i = 1; i <= 4; ++i )
+    mpmc.push(i);
+
+  bool pushed = true, popped = false;
+  PreemptedElement inner, outer;
+  gPreemption = [&]() {
+    pushed = mpmc.push(5);
+    popped = mpmc.pop(inner);
+  };
+  CHECK(mpmc.pop(outer) && outer.value == 1);
+  CHECK(!pushed);
+  CHECK(popped && inner.value == 2);
+  CHECK(mpmc.push(5));
+  for ( uint32_t i = 3; i <= 5; ++i )
+    CHECK(mpmc.pop(outer) && outer.value == i);
+
+  SPSCQueue<PreemptedElement, 4> spsc;
+  for ( uint32_t i = 1; i <= 4; ++i )
+    spsc.push(i);
+  gPreemption = [&]() {
+    pushed = spsc.push(5);
+  };
+  CHECK(spsc.pop(outer) && outer.value == 1);
+  CHECK(!pushed);
+  CHECK(spsc.push(5));
+}
+
+typedef struct {
+  uint64_t received;
+  uint64_t outOfOrder;
+  uint64_t duplicates;
+  uint64_t lost;
+  double seconds;
+} StressResult;
+
+/*
+ * Every producer pushes ELEMENTS_PER_PRODUCER elements, retrying when the queue is full, while the consumers
+ * pop until they've had them all between them.
+ */
+template<typename Queue> static StressResult stress(Queue &queue, uint32_t producers, uint32_t consumers)
+{
+  uint64_t total = (uint64_t)producers * ELEMENTS_PER_PRODUCER;
+  std::atomic<uint64_t> received(0);
+  std::vector<std::vector<uint32_t> > seen(producers, std::vector<uint32_t>(ELEMENTS_PER_PRODUCER, 0));
+  std::vector<uint64_t> outOfOrder(consumers, 0);
+  std::vector<std::thread> threads;
+
+  double start = hostSeconds();
+  for ( uint32_t c = 0; c < consumers; ++c )
+    {
+      threads.emplace_back([&, c]() {
+        std::vector<int64_t> last(producers, -1);
+        uint64_t count = 0;
+        uint32_t e = 0;
+        while ( received.load(std::memory_order_relaxed) < total )
+          {
+            if ( !queue.pop(e) )
+              {
+                if ( count )
+                  {
+                    received.fetch_add(count);
+                    count = 0;
+                  }
+                std::this_thread::yield();
+                continue;
+              }
+
+            uint32_t producer = e >> 24, sequence = e & 0xffffff;
+            if ( (int64_t)sequence <= last[producer] )
+              ++outOfOrder[c];
+            last[producer] = sequence;
+
+            // Each element is written by one consumer only, unless it was delivered twice
+            ++seen[producer][sequence];
+            if ( ++count == 1000 )
+              {
+                received.fetch_add(count);
+                count = 0;
+              }
+          }
+        received.fetch_add(count);
+      });
+    }
+
+  for ( uint32_t p = 0; p < producers; ++p )
+    {
+      threads.emplace_back([&queue, p]() {
+        for ( uint32_t i = 0; i < ELEMENTS_PER_PRODUCER; ++i )
+          {
+            while ( !queue.push(element(p, i)) )
+              std::this_thread::yield();
+          }
+      });
+    }
+
+  for ( std::thread &t : threads )
+    t.join();
+
+  StressResult result = { received.load(), 0, 0, 0, hostSeconds() - start };
+  for ( uint64_t o : outOfOrder )
+    result.outOfOrder += o;
+  for ( std::vector<uint32_t> &s : seen )
+    {
+      for ( uint32_t count : s )
+        {
+          if ( count == 0 )
+            ++result.lost;
+          else if ( count > 1 )
+            result.duplicates += count - 1;
+        }
+    }
+
+  return result;
+}
+
+static void checkStress(const char *name, const StressResult &result, uint32_t producers, uint32_t consumers)
+{
+  CHECK_EQUAL((uint64_t)producers * ELEMENTS_PER_PRODUCER, result.received);
+  CHECK_EQUAL(0, result.outOfOrder);
+  CHECK_EQUAL(0, result.duplicates);
+  CHECK_EQUAL(0, result.lost);
+  printf("%-6s %u producer(s), %u consumer(s): %5.1fM elements/s\n", name, producers, consumers,
+         result.received / result.seconds / 1e6);
+}
+
+static void testSPSCStress()
+{
+  SPSCQueue<uint32_t, 32> queue;
+  checkStress("SPSC", stress(queue, 1, 1), 1, 1);
+}
+
+/*
+ * The ISR queue's real use is several producers and one consumer, but the ring claims to take any number
+ * of either, so it's tried with several consumers as well.
+ */
+static void testMPMCStress()
+{
+  static const uint32_t configurations[][2] = { { 1, 1 }, { 2, 1 }, { 4, 1 }, { 4, 2 }, { 2, 4 } };
+  for ( const uint32_t *c : configurations )
+    {
+      MPMCQueue<uint32_t, 64> queue;
+      checkStress("MPMC", stress(queue, c[0], c[1]), c[0], c[1]);
+
+      LockedQueue<uint32_t, 64> locked;
+      checkStress("Locked", stress(locked, c[0], c[1]), c[0], c[1]);
+    }
+}
+
+int main()
+{
+  SPSCQueue<uint32_t, 32> spsc;
+  testSequential<SPSCQueue<uint32_t, 32>, 32>(spsc);
+  MPMCQueue<uint32_t, 64> mpmc;
+  testSequential<MPMCQueue<uint32_t, 64>, 64>(mpmc);
+  testSPSCPeek();
+  testPreemptedProducer();
+  testPreemptedConsumer();
+
+  testSPSCStress();
+  testMPMCStress();
+  return testResult("QueueTest");
+}
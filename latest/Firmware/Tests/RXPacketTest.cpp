@@ -0,0 +1,250 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "RXPacket.hpp"
+#include <random>
+#include <vector>
+
+
+/**
+ * The packet storage RXPacket had before it was packed in 32-bit words: one bit at a time, LSB first in
+ * bytes, with bits() looping through bit() and the CRC updated one bit at a time too.
+ */
+class BitPacket
+{
+public:
+  BitPacket()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    memset(mPacket, 0, sizeof mPacket);
+    mSize = 0;
+    mCRC = 0xffff;
+  }
+
+  void addByte(uint8_t byte)
+  {
+    for ( int i = 0; i < 8; ++i )
+      addBit(byte & (1 << i));
+
+    for ( int i = 7; i >= 0; --i )
+      addBitCRC((byte >> i) & 1);
+  }
+
+  void addFillBits(uint8_t numBits)
+  {
+    for ( uint8_t i = 0; i < numBits; ++i )
+      addBit(0);
+  }
+
+  void discardCRC()
+  {
+    if ( mCRC == 0xffff )
+      return;
+    mSize -= 16;
+    mCRC = 0xffff;
+    for ( uint8_t i = 0; i < 16; ++i )
+      addBit(0);
+    mSize -= 16;
+  }
+
+  uint8_t bit(uint16_t pos) const
+  {
+    if ( pos < mSize )
+      return (mPacket[pos / 8] & (1 << (pos % 8))) != 0;
+    else
+      return 0;
+  }
+
+  uint32_t bits(uint16_t pos, uint8_t count) const
+  {
+    uint32_t result = 0;
+    for ( uint16_t i = pos; i < pos + count; ++i )
+      {
+        result <<= 1;
+        result |= bit(i);
+      }
+    return result;
+  }
+
+  uint16_t size() const
+  {
+    return mSize;
+  }
+
+  uint16_t crc() const
+  {
+    return mCRC;
+  }
+private:
+  void addBit(uint8_t bit)
+  {
+    if ( bit )
+      mPacket[mSize / 8] |= 1 << (mSize % 8);
+    else
+      mPacket[mSize / 8] &= ~(1 << (mSize % 8));
+    ++mSize;
+  }
+
+  void addBitCRC(uint8_t data)
+  {
+    if ( (data ^ mCRC) & 0x0001 )
+      mCRC = (mCRC >> 1) ^ 0x8408;
+    else
+      mCRC >>= 1;
+  }
+private:
+  uint8_t mPacket[MAX_AIS_RX_PACKET_SIZE/8+1];
+  uint16_t mSize;
+  uint16_t mCRC;
+};
+
+// The fields of a position report (message 1), as the NMEA encoder and the message decoders extract them
+static const uint8_t FIELDS[][2] =
+{
+  {0, 6}, {6, 2}, {8, 30}, {38, 4}, {42, 8}, {50, 10}, {60, 1}, {61, 28},
+  {89, 27}, {116, 12}, {128, 9}, {137, 6}, {143, 2}, {145, 3}, {148, 1}, {149, 19}
+};
+
+template<typename Packet> static void fill(Packet &p, const std::vector<uint8_t> &bytes)
+{
+  p.reset();
+  for ( uint8_t b : bytes )
+    p.addByte(b);
+}
+
+/*
+ * Both must hold the same bits after the same bytes, fill bits and CRC removal, wherever a field starts and
+ * however long it is, including past the end of the payload.
+ */
+static void testEquivalence()
+{
+  std::mt19937 rng(1);
+  RXPacket packet;
+  BitPacket reference;
+
+  for ( int n = 0; n < 2000; ++n )
+    {
+      std::vector<uint8_t> bytes(1 + rng() % (MAX_AIS_RX_PACKET_SIZE / 8 - 2));
+      for ( uint8_t &b : bytes )
+        b = rng();
+
+      fill(packet, bytes);
+      fill(reference, bytes);
+      CHECK_EQUAL(reference.crc(), packet.crc());
+
+      if ( bytes.size() > 2 && n % 2 )
+        {
+          packet.discardCRC();
+          reference.discardCRC();
+        }
+
+      uint8_t fill = rng() % 6;
+      if ( reference.size() + fill <= MAX_AIS_RX_PACKET_SIZE )
+        {
+          packet.addFillBits(fill);
+          reference.addFillBits(fill);
+        }
+
+      CHECK_EQUAL(reference.size(), packet.size());
+
+      unsigned mismatches = 0;
+      for ( uint16_t pos = 0; pos < reference.size() + 40; ++pos )
+        {
+          for ( uint8_t count = 0; count <= 32; ++count )
+            {
+              if ( packet.bits(pos, count) != reference.bits(pos, count) )
+                ++mismatches;
+            }
+          if ( packet.bit(pos) != reference.bit(pos) )
+            ++mismatches;
+        }
+      CHECK_EQUAL(0, mismatches);
+
+      CHECK_EQUAL(reference.bits(0, 6), packet.messageType());
+      CHECK_EQUAL(reference.bits(6, 2), packet.repeatIndicator());
+      CHECK_EQUAL(reference.bits(8, 30), packet.mmsi());
+    }
+}
+
+template<typename Packet> static double cyclesPerPacket(Packet &p, const std::vector<std::vector<uint8_t>> &packets, bool extract)
+{
+  volatile uint32_t sink = 0;
+  uint64_t start = hostCycles();
+  for ( int round = 0; round < 20; ++round )
+    {
+      for ( const std::vector<uint8_t> &bytes : packets )
+        {
+          if ( !extract )
+            {
+              fill(p, bytes);
+              sink = sink + p.crc();
+            }
+          else
+            {
+              uint32_t sum = 0;
+              for ( const uint8_t *f : FIELDS )
+                sum += p.bits(f[0], f[1]);
+              sink = sink + sum;
+            }
+        }
+    }
+  return double(hostCycles() - start) / (20 * packets.size());
+}
+
+/*
+ * Host cycles to fill a packet with 23 received bytes (a position report and its FCS), and to extract all
+ * the fields of a position report from it
+ */
+static void benchmark()
+{
+  std::mt19937 rng(2);
+  std::vector<std::vector<uint8_t>> packets(10000, std::vector<uint8_t>(23));
+  for ( std::vector<uint8_t> &bytes : packets )
+    {
+      for ( uint8_t &b : bytes )
+        b = rng();
+    }
+
+  RXPacket packet;
+  BitPacket reference;
+  double fillBefore = cyclesPerPacket(reference, packets, false);
+  double fillAfter = cyclesPerPacket(packet, packets, false);
+
+  fill(packet, packets[0]);
+  fill(reference, packets[0]);
+  double extractBefore = cyclesPerPacket(reference, packets, true);
+  double extractAfter = cyclesPerPacket(packet, packets, true);
+
+  printf("Filling a 23 byte packet: %.0f host cycles bit by bit, %.0f by words\n", fillBefore, fillAfter);
+  printf("Extracting %u position report fields: %.0f host cycles bit by bit, %.0f by words\n",
+      (unsigned)(sizeof FIELDS / sizeof FIELDS[0]), extractBefore, extractAfter);
+}
+
+int main()
+{
+  testEquivalence();
+  benchmark();
+  return testResult("RXPacketTest");
+}
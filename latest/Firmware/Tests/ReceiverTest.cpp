@@ -0,0 +1,503 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "Test.hpp"
+#include "bsp_host.hpp"
+#include "Receiver.hpp"
+#include "EventQueue.hpp"
+#include "NoiseFloorDetector.hpp"
+#include "GNSSInput.hpp"
+#include "Stats.hpp"
+#include "CRC16.hpp"
+#include "EZRadioPRO.h"
+#include <random>
+#include <vector>
+
+
+// Microseconds per bit at 9600 bps
+#define BIT_US    104
+
+/*
+ * Test doubles for what the Receiver reports to
+ */
+
+NoiseFloorDetector::NoiseFloorDetector()
+{
+}
+
+NoiseFloorDetector &NoiseFloorDetector::instance()
+{
+  static NoiseFloorDetector __instance;
+  return __instance;
+}
+
+static std::vector<uint8_t> gNoiseReports;
+
+void NoiseFloorDetector::report(char, uint8_t rssi)
+{
+  gNoiseReports.push_back(rssi);
+}
+
+void NoiseFloorDetector::processEvent(const Event &)
+{
+}
+
+Stats::Stats()
+{
+}
+
+Stats &Stats::instance()
+{
+  static Stats __instance;
+  return __instance;
+}
+
+void Stats::processEvent(const Event &)
+{
+}
+
+GNSSInput &GNSSInput::instance()
+{
+  static GNSSInput *__instance = nullptr;
+  return *__instance;
+}
+
+void GNSSInput::release(const GNSSSlice &)
+{
+}
+
+/*
+ * Collects the packets the Receiver pushes
+ */
+class PacketCollector : public EventConsumer
+{
+public:
+  std::vector<RXPacket> packets;
+
+  PacketCollector()
+  {
+    EventQueue::instance().addObserver(this, AIS_PACKET_EVENT);
+  }
+
+  void processEvent(const Event &e)
+  {
+    packets.push_back(*e.rxPacket);
+  }
+};
+
+/*
+ * An AIS frame on the air: training sequence, start flag, stuffed payload and FCS (each byte LSB first),
+ * end flag. The levels are NRZI, starting from the given one.
+ */
+class Frame
+{
+public:
+  std::vector<uint8_t> payload;
+  std::vector<uint8_t> levels;
+  uint32_t endLevel;            // Index of the last level of the end flag
+
+  Frame(const std::vector<uint8_t> &bytes, uint8_t level)
+    : payload(bytes), mLevel(level)
+  {
+    for ( int i = 0; i < 24; ++i )
+      addBit(i & 1);
+    addFlag();
+
+    std::vector<uint8_t> frame(bytes);
+    uint16_t fcs = CRC16::compute(bytes.data(), bytes.size());
+    frame.push_back(fcs & 0xff);
+    frame.push_back(fcs >> 8);
+
+    uint8_t ones = 0;
+    for ( uint8_t b : frame )
+      {
+        for ( int i = 0; i < 8; ++i )
+          {
+            uint8_t bit = (b >> i) & 1;
+            addBit(bit);
+            ones = bit ? ones + 1 : 0;
+            if ( ones == 5 )
+              {
+                addBit(0);
+                ones = 0;
+              }
+          }
+      }
+
+    addFlag();
+    endLevel = levels.size() - 1;
+  }
+private:
+  void addBit(uint8_t bit)
+  {
+    if ( !bit )
+      mLevel ^= 1;
+    levels.push_back(mLevel);
+  }
+
+  void addFlag()
+  {
+    static const uint8_t FLAG[] = { 0, 1, 1, 1, 1, 1, 1, 0 };
+    for ( uint8_t b : FLAG )
+      addBit(b);
+  }
+private:
+  uint8_t mLevel;
+};
+
+static std::vector<uint8_t> randomPayload(std::mt19937 &rng)
+{
+  std::vector<uint8_t> bytes(21 + rng() % 20);
+  for ( uint8_t &b : bytes )
+    b = rng();
+  return bytes;
+}
+
+/*
+ * Drives a Receiver through its bit clock, one level per bit period
+ */
+class BitClock
+{
+public:
+  BitClock(Receiver &receiver)
+    : mReceiver(receiver)
+  {
+  }
+
+  // Returns the time of the bit period
+  uint64_t clock(uint8_t level)
+  {
+    host_advance_us(BIT_US);
+    if ( level )
+      RX_IC_DATA_PORT->IDR |= RX_IC_DATA_PIN;
+    else
+      RX_IC_DATA_PORT->IDR &= ~RX_IC_DATA_PIN;
+
+    uint64_t now = host_uptime_us();
+    mReceiver.onBitClock();
+    return now;
+  }
+private:
+  Receiver &mReceiver;
+};
+
+/*
+ * Drives a capturing Receiver the way the board does: the SOTDMA timer starts a slot every 256 bits and
+ * latches the RSSI in it, samples are captured on every clock and delivered when half the buffer is full
+ * or a flush was requested. Deliveries can be held off to overrun the buffer.
+ */
+class CaptureClock
+{
+public:
+  uint32_t slot = 0;
+  bool heldOff = false;
+
+  CaptureClock(Receiver &receiver, int radio)
+    : mReceiver(receiver), mRadio(radio)
+  {
+  }
+
+  // Starts a slot with the given RSSI on the air. After it has been latched, the radio reads 0.
+  void startSlot(uint8_t rssi)
+  {
+    host_set_radio_rssi(mRadio, rssi);
+    mReceiver.timeSlotStarted(++slot);
+    mSlotBits = 0;
+    deliver();
+  }
+
+  void clock(uint8_t level)
+  {
+    host_advance_us(BIT_US);
+    if ( level )
+      RX_IC_DATA_PORT->IDR |= RX_IC_DATA_PIN;
+    else
+      RX_IC_DATA_PORT->IDR &= ~RX_IC_DATA_PIN;
+    host_capture_rx_sample();
+
+    // As RadioManager sets it up, in the bit period of CCA_SLOT_BIT
+    if ( ++mSlotBits == CCA_SLOT_BIT + 1 )
+      {
+        mReceiver.latchRSSI();
+        host_set_radio_rssi(mRadio, 0);
+      }
+
+    if ( bsp_get_rx_capture_position() % (HOST_RX_CAPTURE_SIZE / 2) == 0 )
+      deliver();
+  }
+
+  // Clocks to the end of the slot
+  void finishSlot()
+  {
+    while ( mSlotBits < 256 )
+      clock(mSlotBits & 1);
+  }
+
+  void deliver()
+  {
+    if ( !heldOff )
+      host_deliver_rx_capture();
+  }
+private:
+  Receiver &mReceiver;
+  int mRadio;
+  uint32_t mSlotBits = 0;
+};
+
+static Receiver *gCapturingReceiver = nullptr;
+
+static void captureCallback(const uint16_t *samples, uint32_t count, uint32_t position)
+{
+  gCapturingReceiver->processCapturedSamples(samples, count, position);
+}
+
+// START_RX commands sent to a radio in the bit periods after the given time
+static std::vector<uint64_t> startRXTimes(int radio, uint64_t since)
+{
+  std::vector<uint64_t> times;
+  for ( const HostRadioCommand &c : host_radio_commands() )
+    {
+      if ( c.radio == radio && c.command == START_RX && c.us > since )
+        times.push_back(c.us);
+    }
+  return times;
+}
+
+/*
+ * Every received frame must come out intact, and the receiver must be restarted in the very bit period
+ * that ends it, as it was when each bit was decoded in its own clock interrupt.
+ */
+static void testRestartTiming(Receiver &receiver, int radio, PacketCollector &collector)
+{
+  std::mt19937 rng(3);
+  BitClock clock(receiver);
+  receiver.startReceiving(CH_87, false);
+
+  unsigned late = 0;
+  for ( int f = 0; f < 500; ++f )
+    {
+      // Random noise ahead of the frame shifts it against the batches
+      uint8_t level = 0;
+      int noise = 8 + rng() % 31;
+      for ( int i = 0; i < noise; ++i )
+        {
+          level = rng() & 1;
+          clock.clock(level);
+        }
+
+      Frame frame(randomPayload(rng), level);
+      uint64_t start = host_uptime_us();
+      uint64_t endTime = 0;
+      for ( uint32_t i = 0; i < frame.levels.size(); ++i )
+        {
+          uint64_t t = clock.clock(frame.levels[i]);
+          if ( i == frame.endLevel )
+            endTime = t;
+        }
+
+      std::vector<uint64_t> restarts = startRXTimes(radio, start);
+      CHECK_EQUAL(1, restarts.size());
+      if ( restarts.size() == 1 && restarts[0] != endTime )
+        ++late;
+
+      EventQueue::instance().dispatch();
+      CHECK_EQUAL(f + 1, collector.packets.size());
+      if ( collector.packets.size() == (size_t)f + 1 )
+        {
+          const RXPacket &p = collector.packets.back();
+          CHECK(p.checkCRC());
+          CHECK_EQUAL((frame.payload.size() + 2) * 8, p.size());
+          for ( size_t i = 0; i < frame.payload.size(); ++i )
+            {
+              if ( p.bits(i * 8, 8) != frame.payload[i] )
+                {
+                  CHECK_EQUAL(frame.payload[i], p.bits(i * 8, 8));
+                  break;
+                }
+            }
+        }
+    }
+
+  CHECK_EQUAL(0, late);
+}
+
+/*
+ * An abort (seven 1s) must restart the receiver in the bit period after the seventh 1, wherever it falls in a batch.
+ */
+static void testAbortTiming(Receiver &receiver, int radio)
+{
+  std::mt19937 rng(4);
+  BitClock clock(receiver);
+  receiver.startReceiving(CH_87, false);
+
+  unsigned late = 0;
+  for ( int f = 0; f < 200; ++f )
+    {
+      Frame frame(randomPayload(rng), 0);
+
+      // Cut the frame short somewhere in its payload and keep the line at one level
+      uint32_t cut = 40 + rng() % (frame.endLevel - 60);
+      uint64_t start = host_uptime_us();
+      for ( uint32_t i = 0; i < cut; ++i )
+        clock.clock(frame.levels[i]);
+
+      // No transitions decode to 1s. The frame is aborted by the level that follows the seventh 1 in a row,
+      // and the 1s before the cut count too.
+      int ones = 0;
+      for ( uint32_t i = cut - 1; i > 0 && frame.levels[i] == frame.levels[i - 1]; --i )
+        ++ones;
+
+      uint8_t level = frame.levels[cut - 1];
+      uint64_t expected = 0;
+      for ( int i = 0; i < 20; ++i )
+        {
+          uint64_t t = clock.clock(level);
+          if ( ++ones == 8 )
+            expected = t;
+        }
+
+      std::vector<uint64_t> restarts = startRXTimes(radio, start);
+      CHECK_EQUAL(1, restarts.size());
+
+      // A restart must come from the bit period that completes the abort, never later
+      if ( restarts.size() == 1 && restarts[0] != expected )
+        ++late;
+
+      for ( int i = 0; i < 40; ++i )
+        clock.clock(rng() & 1);
+      EventQueue::instance().dispatch();
+    }
+
+  CHECK_EQUAL(0, late);
+}
+
+/*
+ * With capture, every frame that starts a slot must come out intact with the RSSI that was on the air in
+ * the CCA bit period, not whatever the radio reads when the samples are processed. Interrupts are only
+ * masked to restart the receiver.
+ */
+static void testCapture(Receiver &receiver, int radio, PacketCollector &collector)
+{
+  std::mt19937 rng(5);
+  CaptureClock clock(receiver, radio);
+  size_t packets = collector.packets.size();
+  uint64_t start = host_uptime_us();
+  uint32_t criticalSections = host_critical_sections();
+
+  for ( int f = 0; f < 300; ++f )
+    {
+      // Short enough for a slot with the worst case stuffing
+      std::vector<uint8_t> bytes(10 + rng() % 11);
+      for ( uint8_t &b : bytes )
+        b = rng();
+
+      uint8_t rssi = 60 + f % 100;
+      clock.startSlot(rssi);
+      Frame frame(bytes, 0);
+      for ( uint8_t level : frame.levels )
+        clock.clock(level);
+      clock.finishSlot();
+
+      CHECK_EQUAL(rssi, gNoiseReports.back());
+      EventQueue::instance().dispatch();
+      CHECK_EQUAL(packets + f + 1, collector.packets.size());
+      if ( collector.packets.size() == packets + f + 1 )
+        {
+          const RXPacket &p = collector.packets.back();
+          CHECK(p.checkCRC());
+          CHECK_EQUAL(rssi, p.rssi());
+          CHECK_EQUAL(clock.slot, p.slot());
+          CHECK_EQUAL((bytes.size() + 2) * 8, p.size());
+          CHECK_EQUAL(bytes[0], p.bits(0, 8));
+        }
+    }
+
+  CHECK_EQUAL(0, Stats::instance().rxCaptureOverruns);
+  CHECK_EQUAL(startRXTimes(radio, start).size(), host_critical_sections() - criticalSections);
+}
+
+/*
+ * A frame that overruns the capture buffer is lost, and counted, but the receiver picks up again
+ * with the next one.
+ */
+static void testCaptureOverrun(Receiver &receiver, int radio, PacketCollector &collector)
+{
+  std::mt19937 rng(6);
+  CaptureClock clock(receiver, radio);
+  clock.slot = 1000;
+  size_t packets = collector.packets.size();
+  int overruns = 0;
+
+  for ( int f = 0; f < 100; ++f )
+    {
+      std::vector<uint8_t> bytes(10 + rng() % 11);
+      for ( uint8_t &b : bytes )
+        b = rng();
+
+      bool overrun = f % 4 == 1;
+      clock.startSlot(100);
+      Frame frame(bytes, 0);
+      for ( uint32_t i = 0; i < frame.levels.size(); ++i )
+        {
+          // Hold off deliveries for more than a buffer's worth in the middle of the frame
+          clock.heldOff = overrun && i >= 60 && i < 60 + HOST_RX_CAPTURE_SIZE + 10;
+          clock.clock(frame.levels[i]);
+        }
+      clock.finishSlot();
+
+      EventQueue::instance().dispatch();
+      if ( overrun )
+        ++overruns;
+      else
+        ++packets;
+
+      CHECK_EQUAL(overruns, Stats::instance().rxCaptureOverruns);
+      CHECK_EQUAL(packets, collector.packets.size());
+      if ( !overrun && collector.packets.size() == packets )
+        {
+          CHECK(collector.packets.back().checkCRC());
+          CHECK_EQUAL(bytes.back(), collector.packets.back().bits((bytes.size() - 1) * 8, 8));
+        }
+    }
+}
+
+int main()
+{
+  host_add_radio(CS1_PORT, CS1_PIN);
+  int radio = host_add_radio(CS2_PORT, CS2_PIN);
+
+  Receiver receiver(SDN2_PORT, SDN2_PIN, CS2_PORT, CS2_PIN, RX_IC_DATA_PORT, RX_IC_DATA_PIN, RX_IC_CLK_PORT, RX_IC_CLK_PIN, 1);
+  receiver.init();
+  PacketCollector collector;
+
+  testRestartTiming(receiver, radio, collector);
+  testAbortTiming(receiver, radio);
+
+  Receiver capturing(SDN2_PORT, SDN2_PIN, CS2_PORT, CS2_PIN, RX_IC_DATA_PORT, RX_IC_DATA_PIN, RX_IC_CLK_PORT, RX_IC_CLK_PIN, 1);
+  capturing.init();
+  gCapturingReceiver = &capturing;
+  capturing.enableCapture();
+  bsp_set_rx_capture_callback(captureCallback);
+  capturing.startReceiving(CH_88, false);
+
+  testCapture(capturing, radio, collector);
+  testCaptureOverrun(capturing, radio, collector);
+  return testResult("ReceiverTest");
+}
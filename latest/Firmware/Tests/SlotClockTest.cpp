@@ -0,0 +1,325 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "SlotClock.hpp"
+#include "config.h"
+#include <math.h>
+#include <random>
+#include <functional>
+
+
+#define TIMER_CLOCK     80000000
+
+/**
+ * The SOTDMA timer as GPS drives it, counting an MCU clock that's off by a given (and possibly changing)
+ * number of ppm. ARR is preloaded, so the length returned at a slot boundary is for the slot after the one
+ * that's starting. PPS arrives after a random interrupt latency, and the counter is stepped the way
+ * GPS::onPPS() does when SlotClock can't slew the error out.
+ *
+ * Slot boundaries are compared with where they should be: every 2/75 of a second from a PPS.
+ */
+class SlotTimerSimulation
+{
+public:
+  SlotTimerSimulation(uint32_t seed)
+  : clock(TIMER_CLOCK), drift([](double) { return 0.0; }), ppsMissing([](uint32_t) { return false; }),
+    minLatency(1e-6), maxLatency(10e-6), mRNG(seed), mTime(0), mSlotStart(0), mNextPPS(1), mPPSTime(0),
+    mSteps(0), mMaxError(0), mCurrent(0), mNext(0)
+  {
+  }
+
+  // The timer starts on a slot boundary at an even PPS
+  void start(double startError = 0)
+  {
+    clock.start();
+    mCurrent = mNext = clock.slotLength();
+    mTime = mSlotStart = startError;
+    mNextPPS = 1;
+    mPPSTime = mNextPPS + latency();
+  }
+
+  /*
+   * Runs until the given time, stopping early if the clock expires. The largest boundary error seen
+   * from the given time onwards is kept.
+   */
+  void run(double until, double measureFrom = 1e9)
+  {
+    mMaxError = 0;
+    while ( mTime < until && clock.state() != SLOT_CLOCK_EXPIRED )
+      {
+        double slotEnd = mSlotStart + mCurrent / rate(mSlotStart);
+        if ( slotEnd <= mPPSTime )
+          {
+            mTime = mSlotStart = slotEnd;
+            mCurrent = mNext;
+            mNext = clock.onSlot();
+
+            if ( mTime >= measureFrom )
+              mMaxError = std::max(mMaxError, fabs(boundaryError(mTime)));
+          }
+        else
+          {
+            mTime = mPPSTime;
+            uint32_t second = mNextPPS++;
+            mPPSTime = mNextPPS + latency();
+            if ( !ppsMissing(second) )
+              onPPS(second);
+          }
+      }
+  }
+
+  // In seconds, of the largest error since measuring started
+  double maxError() const
+  {
+    return mMaxError;
+  }
+
+  double time() const
+  {
+    return mTime;
+  }
+
+  uint32_t steps() const
+  {
+    return mSteps;
+  }
+public:
+  SlotClock clock;
+  std::function<double(double)> drift;            // In ppm, at a given time
+  std::function<bool(uint32_t)> ppsMissing;       // For a given second
+  double minLatency;
+  double maxLatency;
+private:
+  double rate(double t)
+  {
+    return TIMER_CLOCK * (1 + drift(t) * 1e-6);
+  }
+
+  double latency()
+  {
+    return minLatency + (maxLatency - minLatency) * (mRNG() % 1001) / 1000.0;
+  }
+
+  static double boundaryError(double t)
+  {
+    double slot = 2.0 / 75;
+    return t - round(t / slot) * slot;
+  }
+
+  void onPPS(uint32_t second)
+  {
+    uint32_t period = clock.slotLength();
+    uint32_t counter = (uint32_t)((mTime - mSlotStart) * rate(mSlotStart));
+    if ( counter >= mCurrent )
+      counter = mCurrent - 1;
+
+    if ( clock.onPPS(counter, !(second & 1)) )
+      return;
+
+    ++mSteps;
+    if ( second & 1 )
+      counter = period / 2;
+    else if ( counter >= period / 2 )
+      counter = period - 1;
+    else
+      counter = 0;
+    mSlotStart = mTime - counter / rate(mTime);
+  }
+private:
+  std::mt19937 mRNG;
+  double mTime;
+  double mSlotStart;
+  uint32_t mNextPPS;
+  double mPPSTime;
+  uint32_t mSteps;
+  double mMaxError;
+  uint32_t mCurrent;
+  uint32_t mNext;
+};
+
+// Constant offsets as large as the HSI16 ever gets, either way
+static void testConstantOffset()
+{
+  static const double offsets[] = { 5000, -9000, 0, 37 };
+  for ( double ppm : offsets )
+    {
+      SlotTimerSimulation sim(1);
+      sim.drift = [ppm](double) { return ppm; };
+      sim.start();
+      sim.run(10);
+      CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+
+      sim.run(600, 10);
+      CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+      CHECK(sim.maxError() < 15e-6);
+      // PPS jitter keeps the estimate wandering by about a ppm
+      CHECK(fabs(sim.clock.frequencyError() - ppm * 1000) < 2500);
+      printf("%+.0f ppm: locked error %.1f us, estimate %+ld ppb\n", ppm, sim.maxError() * 1e6, (long)sim.clock.frequencyError());
+    }
+}
+
+// Temperature changes while locked
+static void testRamp()
+{
+  static const double ramps[] = { 0.1, 1.0 };
+  for ( double ramp : ramps )
+    {
+      SlotTimerSimulation sim(2);
+      sim.drift = [ramp](double t) { return 2000 + ramp * t; };
+      sim.start();
+      sim.run(10);
+      uint32_t steps = sim.steps();
+      sim.run(600, 10);
+      CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+      CHECK(sim.maxError() < 15e-6);
+      CHECK_EQUAL(steps, sim.steps());
+      printf("%.1f ppm/s ramp: locked error %.1f us\n", ramp, sim.maxError() * 1e6);
+    }
+}
+
+// A second here and there without PPS is absorbed without leaving lock for long
+static void testSporadicDropouts()
+{
+  SlotTimerSimulation sim(3);
+  sim.drift = [](double) { return -3000; };
+  sim.ppsMissing = [](uint32_t s) { return s > 20 && s % 17 == 0; };
+  sim.start();
+  sim.run(10);
+  uint32_t steps = sim.steps();
+  sim.run(600, 10);
+  CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+  CHECK(sim.maxError() < 20e-6);
+  CHECK_EQUAL(steps, sim.steps());
+}
+
+/*
+ * Through a 20s dropout, slots stay well within a bit period. PPS coming back doesn't need a step,
+ * and the clock locks again. This takes a quiet PPS, as the jitter is all the clock knows of how far
+ * its estimate can be trusted.
+ */
+static void testHoldover()
+{
+  SlotTimerSimulation sim(4);
+  sim.minLatency = 1e-6;
+  sim.maxLatency = 2e-6;
+  sim.drift = [](double t) { return 5000 + 0.1 * t; };
+  sim.ppsMissing = [](uint32_t s) { return s >= 300 && s < 320; };
+  sim.start();
+  sim.run(299.5);
+  CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+  uint32_t steps = sim.steps();
+
+  sim.run(319.5, 299.5);
+  CHECK_EQUAL(SLOT_CLOCK_HOLDOVER, sim.clock.state());
+  CHECK(sim.clock.holdoverTime() >= 18);
+  CHECK(sim.maxError() < 40e-6);
+  printf("20s holdover: error %.1f us\n", sim.maxError() * 1e6);
+
+  sim.run(330);
+  CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+  CHECK_EQUAL(0, sim.clock.holdoverTime());
+  CHECK_EQUAL(steps, sim.steps());
+}
+
+/*
+ * Without PPS for good, the clock expires no later than SOTDMA_HOLDOVER and before its error could exceed
+ * the budget. Faster drift makes it expire sooner.
+ */
+static void testExpiry()
+{
+  static const double ramps[] = { 0, 1.0 };
+  double expiry[2];
+  for ( int i = 0; i < 2; ++i )
+    {
+      double ramp = ramps[i];
+      SlotTimerSimulation sim(5);
+      sim.drift = [ramp](double t) { return -2000 + ramp * t; };
+      sim.ppsMissing = [](uint32_t s) { return s >= 200; };
+      sim.start();
+      sim.run(1000, 199.5);
+
+      CHECK_EQUAL(SLOT_CLOCK_EXPIRED, sim.clock.state());
+      CHECK(sim.time() < 200 + SOTDMA_HOLDOVER + 2);
+      CHECK(sim.maxError() < SOTDMA_HOLDOVER_BUDGET * 1e-6);
+      expiry[i] = sim.time() - 200;
+      printf("%.1f ppm/s ramp without PPS: expired after %.0fs with error %.1f us\n", ramp, expiry[i], sim.maxError() * 1e6);
+    }
+  CHECK(expiry[1] < expiry[0]);
+}
+
+// Before it has a frequency estimate there's nothing to hold over with
+static void testExpiryWhileAcquiring()
+{
+  SlotTimerSimulation sim(6);
+  sim.drift = [](double) { return 8000; };
+  sim.ppsMissing = [](uint32_t s) { return s >= 2; };
+  sim.start();
+  sim.run(100);
+  CHECK_EQUAL(SLOT_CLOCK_EXPIRED, sim.clock.state());
+  CHECK(sim.time() < 3.5);
+}
+
+// A timer started well off the PPS is stepped into place, then locks
+static void testStep()
+{
+  SlotTimerSimulation sim(7);
+  sim.drift = [](double) { return 1000; };
+  sim.start(500e-6);
+  sim.run(20);
+  CHECK(sim.steps() >= 1);
+  CHECK_EQUAL(SLOT_CLOCK_LOCKED, sim.clock.state());
+
+  sim.run(100, 20);
+  CHECK(sim.maxError() < 15e-6);
+}
+
+// What's carried across a warm reset gets the clock locked without a step even at a large offset
+static void testWarmStart()
+{
+  SlotTimerSimulation cold(8);
+  cold.drift = [](double) { return -9000; };
+  cold.start();
+  cold.run(100);
+
+  SlotTimerSimulation warm(8);
+  warm.drift = cold.drift;
+  warm.clock.setFrequency(cold.clock.frequency());
+  warm.start();
+  warm.run(1.5, 0);
+  CHECK(warm.maxError() < 15e-6);
+  warm.run(10);
+  CHECK_EQUAL(SLOT_CLOCK_LOCKED, warm.clock.state());
+  CHECK_EQUAL(0, warm.steps());
+}
+
+int main()
+{
+  testConstantOffset();
+  testRamp();
+  testSporadicDropouts();
+  testHoldover();
+  testExpiry();
+  testExpiryWhileAcquiring();
+  testStep();
+  testWarmStart();
+  return testResult("SlotClockTest");
+}
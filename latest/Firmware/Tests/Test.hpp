@@ -0,0 +1,91 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef TEST_HPP_
+#define TEST_HPP_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Minimal support for the host tests. Every test is a program that returns non-zero if a check failed.
+ */
+
+static unsigned gChecks = 0;
+static unsigned gFailures = 0;
+
+#define CHECK(cond) \
+  do { \
+    ++gChecks; \
+    if ( !(cond) ) \
+      { \
+        ++gFailures; \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      } \
+  } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+  do { \
+    ++gChecks; \
+    long long __e = (long long)(expected), __a = (long long)(actual); \
+    if ( __e != __a ) \
+      { \
+        ++gFailures; \
+        printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, __a, __e); \
+      } \
+  } while (0)
+
+#define CHECK_STRING(expected, actual) \
+  do { \
+    ++gChecks; \
+    if ( strcmp((expected), (actual)) ) \
+      { \
+        ++gFailures; \
+        printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, (actual), (expected)); \
+      } \
+  } while (0)
+
+static inline int testResult(const char *name)
+{
+  printf("%s: %u checks, %u failed\n", name, gChecks, gFailures);
+  return gFailures ? 1 : 0;
+}
+
+// Host CPU cycles (the TSC on x86), for relative cost figures only. These are not Cortex-M4 cycles.
+static inline uint64_t hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static inline double hostSeconds()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif /* TEST_HPP_ */
@@ -0,0 +1,185 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+#include "Test.hpp"
+#include "Utils.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <random>
+#include <string>
+
+
+/*
+ * The same conversion in double precision, from the whole field as strtod() reads it. Extra decimals are
+ * truncated; the small bias keeps values that are exact in decimal from landing just below an integer.
+ */
+static int32_t referenceCoordinate(const std::string &field, bool negative)
+{
+  double value = strtod(field.c_str(), nullptr);
+  double degrees = floor(value / 100.0);
+  double minutes = degrees * 60.0 + (value - degrees * 100.0);
+  int32_t result = (int32_t)floor(minutes * 10000.0 + 1e-6);
+  return negative ? -result : result;
+}
+
+static uint32_t referenceTenths(const std::string &field)
+{
+  return (uint32_t)floor(strtod(field.c_str(), nullptr) * 10.0 + 1e-6);
+}
+
+// A field as the GNSS would send it, for a position in 1/10000 minutes with the given number of decimals
+static std::string coordinateField(uint32_t units, uint8_t degreeDigits, uint8_t decimals, std::mt19937 &rng)
+{
+  uint32_t degrees = units / 600000;
+  uint32_t minutes = units % 600000 / 10000;
+  uint32_t fraction = units % 10000;
+
+  char field[32];
+  int n = snprintf(field, sizeof field, "%0*u%02u", degreeDigits, degrees, minutes);
+  if ( decimals )
+    {
+      field[n++] = '.';
+      char digits[8];
+      snprintf(digits, sizeof digits, "%04u", fraction);
+      for ( uint8_t i = 0; i < decimals; ++i )
+        field[n++] = i < 4 ? digits[i] : '0' + rng() % 10;
+    }
+
+  // Not NUL terminated in a sentence, the next field follows
+  field[n++] = ',';
+  field[n] = 0;
+  return field;
+}
+
+/*
+ * Positions in all four hemispheres, with 0 to 6 decimals, bit for bit against the double-precision
+ * reference. With 4 or more decimals they must come back as the exact units they were made from.
+ */
+static void testCoordinates()
+{
+  std::mt19937 rng(1);
+  unsigned mismatches = 0, inexact = 0;
+
+  for ( int i = 0; i < 2000000; ++i )
+    {
+      bool latitude = i & 1;
+      uint8_t degreeDigits = latitude ? 2 : 3;
+      uint32_t units = rng() % ((latitude ? 90 : 180) * 600000 + 1);
+      uint8_t decimals = rng() % 7;
+      bool negative = rng() & 1;
+      std::string field = coordinateField(units, degreeDigits, decimals, rng);
+
+      int32_t actual = Utils::coordinateFromNMEA(field.c_str(), degreeDigits, negative);
+      if ( actual != referenceCoordinate(field, negative) )
+        ++mismatches;
+
+      char hemisphere = latitude ? (negative ? 'S' : 'N') : (negative ? 'W' : 'E');
+      int32_t viaHemisphere = latitude ? Utils::latitudeFromNMEA(field.c_str(), hemisphere)
+                                       : Utils::longitudeFromNMEA(field.c_str(), hemisphere);
+      if ( viaHemisphere != actual )
+        ++mismatches;
+
+      if ( decimals >= 4 && actual != (negative ? -(int32_t)units : (int32_t)units) )
+        ++inexact;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK_EQUAL(0, inexact);
+}
+
+static void testCoordinateEdges()
+{
+  CHECK_EQUAL(0, Utils::latitudeFromNMEA("0000.0000,N", 'N'));
+  CHECK_EQUAL(54000000, Utils::latitudeFromNMEA("9000.0000", 'N'));
+  CHECK_EQUAL(-54000000, Utils::latitudeFromNMEA("9000.0000", 'S'));
+  CHECK_EQUAL(108000000, Utils::longitudeFromNMEA("18000.0000", 'E'));
+  CHECK_EQUAL(-108000000, Utils::longitudeFromNMEA("18000.0000", 'W'));
+  CHECK_EQUAL(-(179 * 600000 + 59 * 10000 + 9999), Utils::longitudeFromNMEA("17959.99999,W", 'W'));
+  CHECK_EQUAL(48 * 600000 + 7 * 10000 + 380, Utils::latitudeFromNMEA("4807.038,N", 'N'));
+  CHECK_EQUAL(48 * 600000 + 7 * 10000, Utils::latitudeFromNMEA("4807,N", 'N'));
+  CHECK_EQUAL(48 * 600000 + 7 * 10000, Utils::latitudeFromNMEA("4807.,N", 'N'));
+  CHECK_EQUAL(0, Utils::latitudeFromNMEA(",N", 'N'));
+}
+
+// SOG and COG as the GNSS sends them, to tenths
+static void testTenths()
+{
+  std::mt19937 rng(2);
+  unsigned mismatches = 0;
+
+  for ( int i = 0; i < 1000000; ++i )
+    {
+      char field[32];
+      uint32_t whole = rng() % 1000;
+      int n = snprintf(field, sizeof field, "%u", whole);
+      uint8_t decimals = rng() % 4;
+      if ( decimals )
+        {
+          field[n++] = '.';
+          for ( uint8_t d = 0; d < decimals; ++d )
+            field[n++] = '0' + rng() % 10;
+        }
+      field[n++] = ',';
+      field[n] = 0;
+
+      if ( Utils::tenthsFromNMEA(field) != referenceTenths(field) )
+        ++mismatches;
+    }
+
+  CHECK_EQUAL(0, mismatches);
+  CHECK_EQUAL(316, Utils::tenthsFromNMEA("31.66,"));
+  CHECK_EQUAL(0, Utils::tenthsFromNMEA("0.02,"));
+  CHECK_EQUAL(1230, Utils::tenthsFromNMEA("123,"));
+  CHECK_EQUAL(0, Utils::tenthsFromNMEA(","));
+}
+
+/*
+ * For the record, how far off the old path was: degrees and minutes in float, then scaled to AIS units.
+ * Longitudes near the antimeridian lose the most.
+ */
+static void floatError()
+{
+  std::mt19937 rng(3);
+  int32_t worst = 0;
+
+  for ( int i = 0; i < 1000000; ++i )
+    {
+      uint32_t units = rng() % (180 * 600000 + 1);
+      std::string field = coordinateField(units, 3, 4, rng);
+      float deg = atof(field.substr(0, 3).c_str());
+      float min = atof(field.substr(3).c_str());
+      float value = deg + min / 60.0f;
+      int32_t old = (int32_t)(fabs(value) * 600000);
+      worst = std::max(worst, abs(old - (int32_t)units));
+    }
+
+  CHECK(worst > 0);
+  printf("Worst longitude error through float: %d/10000 minutes\n", worst);
+}
+
+int main()
+{
+  testCoordinates();
+  testCoordinateEdges();
+  testTenths();
+  floatError();
+  return testResult("UtilsTest");
+}
@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+
+#include "BinaryDecoder.hpp"
+#include "CRC16.hpp"
+
+
+bool BinaryDecoder::decode(const uint8_t *frame, uint16_t length, Record &record)
+{
+  std::vector<uint8_t> body;
+  if ( !unstuff(frame, length, body) || body.size() < 3 )
+    return false;
+
+  uint16_t fcs = get16(&body[body.size() - 2]);
+  body.resize(body.size() - 2);
+  if ( CRC16::compute(body.data(), body.size()) != fcs )
+    return false;
+
+  record = Record();
+  record.type = body[0];
+  switch ( record.type )
+    {
+    case RECORD_AIS:
+      if ( body.size() < 6 || body[5] > 7 )
+        return false;
+      record.channel = body[1];
+      record.slot = get16(&body[2]);
+      record.rssi = body[4];
+      record.bits = (body.size() - 6) * 8 - body[5];
+      record.payload.assign(body.begin() + 6, body.end());
+      return true;
+    case RECORD_GNSS:
+      if ( body.size() != 17 )
+        return false;
+      record.fix.utc = get32(&body[1]);
+      record.fix.lat = get32(&body[5]);
+      record.fix.lng = get32(&body[9]);
+      record.fix.speed = get16(&body[13]);
+      record.fix.cog = get16(&body[15]);
+      return true;
+    case RECORD_TEXT:
+      record.text.assign(body.begin() + 1, body.end());
+      return true;
+    default:
+      return false;
+    }
+}
+
+bool BinaryDecoder::addByte(uint8_t b)
+{
+  if ( b )
+    {
+      mBuffer.push_back(b);
+      return false;
+    }
+
+  if ( mBuffer.empty() )
+    return false;
+
+  mFrame.swap(mBuffer);
+  mBuffer.clear();
+  return true;
+}
+
+const std::vector<uint8_t> &BinaryDecoder::frame() const
+{
+  return mFrame;
+}
+
+bool BinaryDecoder::unstuff(const uint8_t *frame, uint16_t length, std::vector<uint8_t> &out)
+{
+  uint16_t i = 0;
+  while ( i < length )
+    {
+      uint8_t code = frame[i];
+      if ( code == 0 || i + code > length )
+        return false;
+      for ( uint16_t j = i + 1; j < i + code; ++j )
+        {
+          if ( frame[j] == 0 )
+            return false;
+          out.push_back(frame[j]);
+        }
+      i += code;
+      if ( code < 0xff && i < length )
+        out.push_back(0);
+    }
+  return true;
+}
+
+uint16_t BinaryDecoder::get16(const uint8_t *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+uint32_t BinaryDecoder::get32(const uint8_t *p)
+{
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
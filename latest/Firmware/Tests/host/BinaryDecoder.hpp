@@ -0,0 +1,70 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+
+
+#ifndef BINARYDECODER_HPP_
+#define BINARYDECODER_HPP_
+
+#include "BinaryEncoder.hpp"
+#include <vector>
+#include <string>
+
+/**
+ * The host side of the binary output mode (see Inc/BinaryEncoder.hpp), as Python/binary_output.py does it.
+ * It links with Src/CRC16.cpp, so frames are checked with the same CRC as the firmware computes them.
+ */
+class BinaryDecoder
+{
+public:
+  struct Record
+  {
+    uint8_t type;
+    uint8_t channel;                // ITU channel number
+    uint16_t slot;
+    uint8_t rssi;
+    uint16_t bits;
+    std::vector<uint8_t> payload;   // MSB first, padded to a whole byte
+    GPSFix fix;
+    std::string text;
+  };
+
+  /*
+   * Takes a frame without its delimiter and recovers the record. Returns false if the frame is malformed
+   * or corrupt, or the record is of an unknown type.
+   */
+  static bool decode(const uint8_t *frame, uint16_t length, Record &record);
+
+  /*
+   * Splits a byte stream into frames, like frames() in binary_output.py. Returns true when the byte completes
+   * a frame, which is then in frame() without its delimiter. Empty frames are skipped.
+   */
+  bool addByte(uint8_t b);
+  const std::vector<uint8_t> &frame() const;
+private:
+  static bool unstuff(const uint8_t *frame, uint16_t length, std::vector<uint8_t> &out);
+  static uint16_t get16(const uint8_t *p);
+  static uint32_t get32(const uint8_t *p);
+private:
+  std::vector<uint8_t> mBuffer;
+  std::vector<uint8_t> mFrame;
+};
+
+#endif /* BINARYDECODER_HPP_ */
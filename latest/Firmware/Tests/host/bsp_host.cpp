@@ -0,0 +1,452 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#include "bsp_host.hpp"
+#include "EZRadioPRO.h"
+#include <string.h>
+
+
+GPIO_TypeDef host_gpioa, host_gpiob, host_gpioc;
+
+static uint64_t __uptimeUS = 0;
+static bool __isr = false;
+static uint32_t __primask = 0;
+static uint32_t __criticalSections = 0;
+
+static void updateRadios();
+static void updateTerminal();
+
+void host_advance_us(uint32_t us)
+{
+  __uptimeUS += us;
+  updateTerminal();
+}
+
+void host_set_uptime_ms(uint32_t ms)
+{
+  __uptimeUS = (uint64_t)ms * 1000;
+}
+
+uint64_t host_uptime_us()
+{
+  return __uptimeUS;
+}
+
+void host_set_isr(bool isr)
+{
+  __isr = isr;
+}
+
+uint32_t host_critical_sections()
+{
+  return __criticalSections;
+}
+
+uint32_t __get_IPSR()
+{
+  return __isr ? 16 : 0;
+}
+
+uint32_t __get_PRIMASK()
+{
+  return __primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+  __primask = primask;
+}
+
+void __disable_irq()
+{
+  __primask = 1;
+  ++__criticalSections;
+}
+
+void __enable_irq()
+{
+  __primask = 0;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+  return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+  if ( state == GPIO_PIN_SET )
+    port->ODR |= pin;
+  else
+    port->ODR &= ~pin;
+
+  updateRadios();
+}
+
+void HAL_Delay(uint32_t ms)
+{
+  __uptimeUS += (uint64_t)ms * 1000;
+  updateTerminal();
+}
+
+uint32_t HAL_GetTick()
+{
+  return bsp_get_uptime_ms();
+}
+
+uint32_t bsp_get_system_clock()
+{
+  return HOST_SYSTEM_CLOCK;
+}
+
+uint32_t bsp_get_uptime_ms()
+{
+  return __uptimeUS / 1000;
+}
+
+uint32_t bsp_get_cycle_count()
+{
+  return __uptimeUS * (HOST_SYSTEM_CLOCK / 1000000);
+}
+
+static uint8_t reverse8(uint8_t b)
+{
+  uint8_t r = 0;
+  for ( int i = 0; i < 8; ++i )
+    r |= ((b >> i) & 1) << (7 - i);
+  return r;
+}
+
+/*
+ * A model of the STM32L4 CRC unit as bsp_crc16() on the boards sets it up: 16-bit polynomial 0x1021,
+ * initial value 0xffff, input bit-reversed by byte, output bit-reversed. The unit itself shifts MSB first.
+ */
+bool bsp_crc16(const uint8_t *data, uint16_t length, uint16_t &crc)
+{
+  uint16_t dr = 0xffff;
+  for ( uint16_t i = 0; i < length; ++i )
+    {
+      dr ^= reverse8(data[i]) << 8;
+      for ( int b = 0; b < 8; ++b )
+        dr = dr & 0x8000 ? (dr << 1) ^ 0x1021 : dr << 1;
+    }
+
+  uint16_t out = reverse8(dr >> 8) | reverse8(dr & 0xff) << 8;
+  crc = ~out & 0xffff;
+  return true;
+}
+
+typedef struct
+{
+  GPIO_TypeDef *csPort;
+  uint16_t csPin;
+  bool selected;
+  std::vector<uint8_t> command;
+  std::vector<uint8_t> reply;
+  uint8_t rssi;
+} HostRadio;
+
+static std::vector<HostRadio> __radios;
+static std::vector<HostRadioCommand> __radioCommands;
+
+int host_add_radio(GPIO_TypeDef *csPort, uint16_t csPin)
+{
+  csPort->ODR |= csPin;
+  __radios.push_back({ csPort, csPin, false, {}, {}, 0 });
+  return __radios.size() - 1;
+}
+
+void host_set_radio_rssi(int radio, uint8_t rssi)
+{
+  __radios[radio].rssi = rssi;
+}
+
+std::vector<HostRadioCommand> &host_radio_commands()
+{
+  return __radioCommands;
+}
+
+// Chip selects are active low. A radio acts on a command when it's deselected.
+static void updateRadios()
+{
+  for ( size_t i = 0; i < __radios.size(); ++i )
+    {
+      HostRadio &r = __radios[i];
+      bool selected = !(r.csPort->ODR & r.csPin);
+      if ( r.selected && !selected )
+        {
+          if ( !r.command.empty() && r.command[0] != READ_CMD_BUFFER )
+            {
+              __radioCommands.push_back({ (int)i, r.command[0], __uptimeUS });
+              r.reply.clear();
+              if ( r.command[0] == GET_MODEM_STATUS )
+                r.reply = { 0, 0, r.rssi };
+            }
+          r.command.clear();
+        }
+      r.selected = selected;
+    }
+}
+
+uint8_t bsp_tx_spi_byte(uint8_t b)
+{
+  HostRadio *r = nullptr;
+  for ( HostRadio &radio : __radios )
+    {
+      if ( radio.selected )
+        r = &radio;
+    }
+
+  if ( !r )
+    return 0;
+
+  r->command.push_back(b);
+  if ( r->command[0] != READ_CMD_BUFFER || r->command.size() == 1 )
+    return 0;
+
+  // Clear to send, then the reply
+  if ( r->command.size() == 2 )
+    return 0xff;
+
+  size_t i = r->command.size() - 3;
+  return i < r->reply.size() ? r->reply[i] : 0;
+}
+
+static tx_pull_callback __terminalCallback = nullptr;
+static uint32_t __terminalBaudRate = TERMINAL_BAUD_RATE;
+static const char *__terminalChunk = nullptr;
+static uint16_t __terminalChunkSize = 0;
+static uint16_t __terminalChunkSent = 0;
+static double __terminalCharEndUS = 0;       // When the character being shifted out is done
+static std::string __terminalOutput;
+static std::vector<uint64_t> __terminalOutputTimes;
+
+std::string &host_terminal_output()
+{
+  return __terminalOutput;
+}
+
+uint32_t host_terminal_baud_rate()
+{
+  return __terminalBaudRate;
+}
+
+std::vector<uint64_t> &host_terminal_output_times()
+{
+  return __terminalOutputTimes;
+}
+
+// Starts on the next chunk from the transfer complete interrupt, the first character of which goes out at the given time
+static void pullTerminalChunk(double startUS)
+{
+  __terminalChunkSize = 0;
+  if ( __terminalCallback )
+    {
+      bool isr = __isr;
+      __isr = true;
+      __terminalChunkSize = __terminalCallback(&__terminalChunk);
+      __isr = isr;
+    }
+
+  __terminalChunkSent = 0;
+  if ( __terminalChunkSize )
+    {
+      __terminalOutputTimes.push_back(startUS);
+      __terminalCharEndUS = startUS + 10e6 / __terminalBaudRate;
+    }
+}
+
+static void updateTerminal()
+{
+  while ( __terminalChunkSize && __terminalCharEndUS <= __uptimeUS )
+    {
+      __terminalOutput += __terminalChunk[__terminalChunkSent++];
+      double end = __terminalCharEndUS;
+      if ( __terminalChunkSent == __terminalChunkSize )
+        {
+          pullTerminalChunk(end);
+        }
+      else
+        {
+          __terminalOutputTimes.push_back(end);
+          __terminalCharEndUS = end + 10e6 / __terminalBaudRate;
+        }
+    }
+}
+
+void bsp_set_terminal_output_callback(tx_pull_callback cb)
+{
+  __terminalCallback = cb;
+}
+
+void bsp_set_terminal_input_callback(char_input_cb)
+{
+}
+
+void bsp_kick_terminal_output()
+{
+  if ( !__terminalChunkSize )
+    pullTerminalChunk(__uptimeUS);
+}
+
+void bsp_set_terminal_baud_rate(uint32_t rate)
+{
+  // The character being shifted out finishes at the old rate
+  __terminalBaudRate = rate;
+}
+
+static StationData __stationData;
+static ConfigData __configData;
+static GNSSFixData __gnssFix;
+static uint32_t __configDataWrites = 0;
+static uint32_t __gnssFixWrites = 0;
+
+void host_erase_eeprom()
+{
+  memset(&__stationData, 0xff, sizeof __stationData);
+  memset(&__configData, 0xff, sizeof __configData);
+  memset(&__gnssFix, 0xff, sizeof __gnssFix);
+  __configDataWrites = 0;
+  __gnssFixWrites = 0;
+}
+
+uint32_t host_config_data_writes()
+{
+  return __configDataWrites;
+}
+
+uint32_t host_gnss_fix_writes()
+{
+  return __gnssFixWrites;
+}
+
+bool bsp_erase_station_data()
+{
+  memset(&__stationData, 0xff, sizeof __stationData);
+  return true;
+}
+
+bool bsp_save_station_data(const StationData &data)
+{
+  __stationData = data;
+  return true;
+}
+
+bool bsp_read_station_data(StationData &data)
+{
+  data = __stationData;
+  return true;
+}
+
+bool bsp_erase_config_data()
+{
+  memset(&__configData, 0xff, sizeof __configData);
+  return true;
+}
+
+bool bsp_save_config_data(const ConfigData &data)
+{
+  __configData = data;
+  ++__configDataWrites;
+  return true;
+}
+
+bool bsp_read_config_data(ConfigData &data)
+{
+  data = __configData;
+  return true;
+}
+
+bool bsp_save_gnss_fix(const GNSSFixData &data)
+{
+  __gnssFix = data;
+  ++__gnssFixWrites;
+  return true;
+}
+
+bool bsp_read_gnss_fix(GNSSFixData &data)
+{
+  data = __gnssFix;
+  return true;
+}
+
+void bsp_reboot()
+{
+}
+
+#if RX_IC_CAPTURE
+static uint16_t __rxCapture[HOST_RX_CAPTURE_SIZE];
+static uint32_t __rxCaptured = 0;
+static uint32_t __rxDelivered = 0;
+static bool __rxFlushed = false;
+static capture_callback __rxCaptureCallback = nullptr;
+
+void host_capture_rx_sample()
+{
+  __rxCapture[__rxCaptured++ % HOST_RX_CAPTURE_SIZE] = RX_IC_DATA_PORT->IDR;
+}
+
+void host_deliver_rx_capture()
+{
+  __rxFlushed = false;
+  uint32_t count = __rxCaptured - __rxDelivered;
+  if ( count > HOST_RX_CAPTURE_SIZE )
+    {
+      // Overwritten
+      __rxDelivered = __rxCaptured;
+      return;
+    }
+
+  while ( count )
+    {
+      uint32_t tail = __rxDelivered % HOST_RX_CAPTURE_SIZE;
+      uint32_t n = tail + count > HOST_RX_CAPTURE_SIZE ? HOST_RX_CAPTURE_SIZE - tail : count;
+      uint32_t position = __rxDelivered;
+      __rxDelivered += n;
+      count -= n;
+      if ( __rxCaptureCallback )
+        __rxCaptureCallback(&__rxCapture[tail], n, position);
+    }
+}
+
+bool host_rx_capture_flushed()
+{
+  return __rxFlushed;
+}
+
+void bsp_set_rx_capture_callback(capture_callback cb)
+{
+  __rxCaptureCallback = cb;
+}
+
+uint32_t bsp_get_rx_capture_position()
+{
+  return __rxCaptured;
+}
+
+void bsp_flush_rx_capture()
+{
+  __rxFlushed = true;
+}
+
+void bsp_set_rx_rssi_callback(irq_callback, uint32_t)
+{
+}
+#endif
@@ -0,0 +1,96 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef BSP_HOST_HPP_
+#define BSP_HOST_HPP_
+
+#include "bsp.hpp"
+#include "stm32l4xx_hal.h"
+#include <vector>
+#include <string>
+
+/**
+ * Controls for the host implementation of the BSP (bsp_host.cpp). Time only moves when a test moves it.
+ */
+
+// Simulated system clock, as returned by bsp_get_system_clock()
+#define HOST_SYSTEM_CLOCK     80000000
+
+// Advances bsp_get_uptime_ms() and bsp_get_cycle_count()
+void host_advance_us(uint32_t us);
+void host_set_uptime_ms(uint32_t ms);
+uint64_t host_uptime_us();
+
+// Makes Utils::inISR() true or false
+void host_set_isr(bool isr);
+
+// How many times interrupts have been disabled
+uint32_t host_critical_sections();
+
+/*
+ * A model of the command interface of the Si4463s on the SPI bus. Every command a radio receives is logged,
+ * and it answers GET_MODEM_STATUS with the RSSI it has been given. Everything else gets an empty reply.
+ */
+typedef struct
+{
+  int radio;
+  uint8_t command;
+  uint64_t us;          // host_uptime_us() when the command was sent
+} HostRadioCommand;
+
+int host_add_radio(GPIO_TypeDef *csPort, uint16_t csPin);
+void host_set_radio_rssi(int radio, uint8_t rssi);
+std::vector<HostRadioCommand> &host_radio_commands();
+
+/*
+ * A model of the main UART as the boards drive it with DMA. Once kicked, it pulls chunks from the output callback
+ * and shifts them out at 10 bits per character at the current baud rate, as time advances.
+ */
+std::string &host_terminal_output();
+uint32_t host_terminal_baud_rate();
+
+// Time (host_uptime_us()) at which each character of host_terminal_output() started going out
+std::vector<uint64_t> &host_terminal_output_times();
+
+/*
+ * The EEPROM, initially erased. Counts writes of each kind of data.
+ */
+void host_erase_eeprom();
+uint32_t host_config_data_writes();
+uint32_t host_gnss_fix_writes();
+
+#if RX_IC_CAPTURE
+/*
+ * A model of the RX IC capture: a circular buffer of HOST_RX_CAPTURE_SIZE samples that the capture callback is
+ * served from, like the DMA buffer on the board. Samples that are overwritten before delivery are skipped.
+ */
+#define HOST_RX_CAPTURE_SIZE  64
+
+// Captures the RX IC data pin, as a rising edge of the RX IC clock would
+void host_capture_rx_sample();
+
+// Delivers everything captured so far, as the capture interrupt would
+void host_deliver_rx_capture();
+
+// Whether bsp_flush_rx_capture() was called since the last delivery
+bool host_rx_capture_flushed();
+#endif
+
+#endif /* BSP_HOST_HPP_ */
@@ -0,0 +1,44 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef HOST_LIBC_H_
+#define HOST_LIBC_H_
+
+#include <string.h>
+
+/**
+ * What the firmware uses from newlib that older versions of glibc don't have. Included ahead of every source.
+ */
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+static inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+  size_t length = strlen(src);
+  if ( size )
+    {
+      size_t n = length < size - 1 ? length : size - 1;
+      memcpy(dst, src, n);
+      dst[n] = 0;
+    }
+  return length;
+}
+#endif
+
+#endif /* HOST_LIBC_H_ */
@@ -0,0 +1,51 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef STM32L4XX_H_
+#define STM32L4XX_H_
+
+#include <stdint.h>
+
+/**
+ * Host stand-in for the CMSIS device header. Only what the modules under test use is here.
+ */
+
+#define __IO volatile
+
+typedef struct
+{
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef host_gpioa, host_gpiob, host_gpioc;
+
+#define GPIOA (&host_gpioa)
+#define GPIOB (&host_gpiob)
+#define GPIOC (&host_gpioc)
+
+// Interrupts can't happen on the host, unless a test says it's in one (see host_set_isr())
+uint32_t __get_IPSR();
+uint32_t __get_PRIMASK();
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq();
+void __enable_irq();
+
+#endif /* STM32L4XX_H_ */
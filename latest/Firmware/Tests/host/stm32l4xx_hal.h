@@ -0,0 +1,58 @@
+/*
+  Copyright (c) 2016-2020 Peter Antypas
+
+  This file is part of the MAIANA™ transponder firmware.
+
+  The firmware is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+
+#ifndef STM32L4XX_HAL_H_
+#define STM32L4XX_HAL_H_
+
+#include "stm32l4xx.h"
+
+/**
+ * Host stand-in for the HAL. GPIOs are plain memory, so tests can drive input pins and watch output pins.
+ */
+
+#define GPIO_PIN_0    ((uint16_t)0x0001)
+#define GPIO_PIN_1    ((uint16_t)0x0002)
+#define GPIO_PIN_2    ((uint16_t)0x0004)
+#define GPIO_PIN_3    ((uint16_t)0x0008)
+#define GPIO_PIN_4    ((uint16_t)0x0010)
+#define GPIO_PIN_5    ((uint16_t)0x0020)
+#define GPIO_PIN_6    ((uint16_t)0x0040)
+#define GPIO_PIN_7    ((uint16_t)0x0080)
+#define GPIO_PIN_8    ((uint16_t)0x0100)
+#define GPIO_PIN_9    ((uint16_t)0x0200)
+#define GPIO_PIN_10   ((uint16_t)0x0400)
+#define GPIO_PIN_11   ((uint16_t)0x0800)
+#define GPIO_PIN_12   ((uint16_t)0x1000)
+#define GPIO_PIN_13   ((uint16_t)0x2000)
+#define GPIO_PIN_14   ((uint16_t)0x4000)
+#define GPIO_PIN_15   ((uint16_t)0x8000)
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+void HAL_Delay(uint32_t ms);
+uint32_t HAL_GetTick();
+
+#endif /* STM32L4XX_HAL_H_ */